@@ -0,0 +1,542 @@
+// Needed for clock_gettime()
+#define _POSIX_C_SOURCE 200809L
+
+#include "cipher.h"
+#include "cryptanalysis.h"
+#include <getopt.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC 1
+#else
+#define HAVE_TSC 0
+#endif
+
+
+// Each case is repeated until it has run for at least this long
+#define MIN_SECONDS 0.1
+#define DEFAULT_MAX_SIZE ((size_t) 1 << 30)
+#define CAESAR_KEY 'J'
+#define CRIB "Four score and seven years ago"
+
+static const size_t sizes[] = { 64, 0x1000, 0x40000, 0x1000000, (size_t) 1 << 30 };
+static const size_t key_lengths[] = { 1, 16, 256, 4096 };
+// Fraction of the text that is letters, from prose-like down to mostly punctuation
+static const double alpha_densities[] = { 1.0, 0.75, 0.25, 0.05 };
+
+static const char punctuation[] = " .,;:!?'\"-()0123456789\n";
+
+// Letters of ciphertext the substitution solver is given, and how many hill
+// climbs it runs for each solve
+static const size_t solver_letter_counts[] = { 100, 250, 500, 1000, 4000 };
+// 1 thread, and then every CPU
+static const size_t solver_threads[] = { 1, 0 };
+#define SOLVER_RESTARTS 16
+
+// Random words tried as Vigenère keys on the solver's plaintext, with the real
+// key halfway through
+#define WORDLIST_WORDS 0x200000
+#define WORDLIST_KEY "ARAGON"
+
+// Kept out of the sample the built-in quadgram table is built from, and
+// repeated for the longer ciphertexts
+static const char solver_plaintext[] =
+    "Four score and seven years ago our fathers brought forth on this continent, a new nation, "
+    "conceived in Liberty, and dedicated to the proposition that all men are created equal. "
+    "Now we are engaged in a great civil war, testing whether that nation, or any nation so "
+    "conceived and so dedicated, can long endure. We are met on a great battle-field of that "
+    "war. We have come to dedicate a portion of that field, as a final resting place for those "
+    "who here gave their lives that that nation might live. It is altogether fitting and "
+    "proper that we should do this. But, in a larger sense, we can not dedicate, we can not "
+    "consecrate, we can not hallow this ground. The brave men, living and dead, who struggled "
+    "here, have consecrated it, far above our poor power to add or detract. The world will "
+    "little note, nor long remember what we say here, but it can never forget what they did "
+    "here. ";
+
+typedef enum BenchFunction {
+        BENCH_CAESAR,
+        BENCH_DECIPHER_CAESAR,
+        BENCH_VIGENERE,
+        BENCH_DECIPHER_VIGENERE,
+        BENCH_BEAUFORT,
+        BENCH_AFFINE,
+        BENCH_AUTOKEY,
+        // Only the ASCII fast path, as the generated text is all ASCII
+        BENCH_UTF8_VALIDATE,
+        // Dragging a crib over the text on 1 thread, which finds no key in random text
+        BENCH_CRIB_SCAN,
+} BenchFunction;
+
+static const char* const function_names[] = {
+        [BENCH_CAESAR] = "caesar",
+        [BENCH_DECIPHER_CAESAR] = "decipher_caesar",
+        [BENCH_VIGENERE] = "vigenere",
+        [BENCH_DECIPHER_VIGENERE] = "decipher_vigenere",
+        [BENCH_BEAUFORT] = "beaufort",
+        [BENCH_AFFINE] = "affine",
+        [BENCH_AUTOKEY] = "autokey",
+        [BENCH_UTF8_VALIDATE] = "utf8_validate",
+        [BENCH_CRIB_SCAN] = "crib_scan",
+};
+
+typedef struct BenchCase {
+        BenchFunction function;
+        size_t size;
+        size_t key_len;
+        double alpha_density;
+} BenchCase;
+
+typedef struct BenchResult {
+        size_t iterations;
+        double seconds;
+        uint64_t cycles;
+} BenchResult;
+
+
+// xorshift64, so every run benchmarks the same text
+static inline uint64_t next_random(uint64_t* state) {
+        *state ^= *state << 13;
+        *state ^= *state >> 7;
+        *state ^= *state << 17;
+
+        return *state;
+}
+
+static void fill_text(size_t len, char text[len], double alpha_density, uint64_t seed) {
+        const uint64_t threshold = (uint64_t) (alpha_density * (double) UINT32_MAX);
+        uint64_t state = seed;
+
+        for (size_t i = 0; i < len; i++) {
+                const uint64_t r = next_random(&state);
+
+                if ((r & UINT32_MAX) <= threshold)
+                        text[i] = (char) ((r >> 40 & 1 ? 'a' : 'A') + (char) ((r >> 32) % 26));
+                else
+                        text[i] = punctuation[(r >> 32) % (sizeof(punctuation) - 1)];
+        }
+}
+
+static void fill_key(size_t len, char key[len], uint64_t seed) {
+        uint64_t state = seed;
+
+        for (size_t i = 0; i < len; i++)
+                key[i] = (char) ('A' + (char) (next_random(&state) % 26));
+}
+
+static inline double now_seconds(void) {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+
+        return (double) now.tv_sec + (double) now.tv_nsec * 1e-9;
+}
+
+static inline uint64_t read_cycles(void) {
+#if HAVE_TSC
+        return __rdtsc();
+#else
+        return 0;
+#endif
+}
+
+
+// Compiles the key on every call, like the plain Vigenère functions
+// WARNING: mutates 'text'!
+static inline void run_poly(poly_cipher cipher,
+                            const BenchCase* bench,
+                            const char* key,
+                            char* text) {
+        const poly_params params = {
+                .cipher = cipher,
+                .key_len = bench->key_len,
+                .key = key,
+                .multiplier = 7,
+                .increment = 3,
+        };
+        poly_ctx ctx;
+
+        poly_ctx_init(&ctx, &params);
+        poly_ctx_update(&ctx, bench->size, text);
+        poly_ctx_free(&ctx);
+}
+
+// WARNING: mutates 'text'!
+static inline void run_function(const BenchCase* bench, const char* key, char* text) {
+        switch (bench->function) {
+                case BENCH_CAESAR:
+                        caesar(CAESAR_KEY, bench->size, text);
+                        break;
+                case BENCH_DECIPHER_CAESAR:
+                        decipher_caesar(CAESAR_KEY, bench->size, text);
+                        break;
+                case BENCH_VIGENERE:
+                        vigenere(bench->key_len, key, bench->size, text);
+                        break;
+                case BENCH_DECIPHER_VIGENERE:
+                        decipher_vigenere(bench->key_len, key, bench->size, text);
+                        break;
+                case BENCH_BEAUFORT:
+                        run_poly(POLY_BEAUFORT, bench, key, text);
+                        break;
+                case BENCH_AFFINE:
+                        run_poly(POLY_AFFINE, bench, key, text);
+                        break;
+                case BENCH_AUTOKEY:
+                        run_poly(POLY_AUTOKEY, bench, key, text);
+                        break;
+                case BENCH_UTF8_VALIDATE:
+                        utf8_validate(bench->size, text, NULL);
+                        break;
+                case BENCH_CRIB_SCAN: {
+                        crib_candidate found;
+
+                        crack_vigenere_crib(bench->size, text, strlen(CRIB), CRIB, 1, &found, 1);
+                        break;
+                }
+        }
+}
+
+// Doubles the iteration count until a batch runs for MIN_SECONDS, so small
+// inputs aren't dominated by timer overhead
+static BenchResult run_case(const BenchCase* bench, const char* key, char* text) {
+        // Warm up the caches and fault in the pages
+        run_function(bench, key, text);
+
+        for (size_t iterations = 1;; iterations *= 2) {
+                const double start = now_seconds();
+                const uint64_t start_cycles = read_cycles();
+
+                for (size_t i = 0; i < iterations; i++)
+                        run_function(bench, key, text);
+
+                const uint64_t cycles = read_cycles() - start_cycles;
+                const double seconds = now_seconds() - start;
+
+                if (seconds >= MIN_SECONDS)
+                        return (BenchResult) {
+                                .iterations = iterations,
+                                .seconds = seconds,
+                                .cycles = cycles,
+                        };
+        }
+}
+
+static void print_result(const BenchCase* bench, const BenchResult* result, bool first) {
+        const double bytes = (double) bench->size * (double) result->iterations;
+
+        printf("%s\n    {\"function\": \"%s\", \"size\": %zu, \"key_length\": %zu, "
+               "\"alpha_density\": %.2f, \"iterations\": %zu, \"mb_per_s\": %.2f, ",
+               first ? "" : ",",
+               function_names[bench->function],
+               bench->size,
+               bench->key_len,
+               bench->alpha_density,
+               result->iterations,
+               bytes / result->seconds / 1e6);
+
+        if (HAVE_TSC)
+                printf("\"cycles_per_byte\": %.4f}", (double) result->cycles / bytes);
+        else
+                printf("\"cycles_per_byte\": null}");
+
+        fflush(stdout);
+}
+
+
+static void run_kernel(cipher_kernel kernel, size_t max_size, char* text, const char* key) {
+        cipher_select_kernel(kernel);
+
+        printf("{\"kernel\": \"%s\", \"results\": [", cipher_kernel_name(kernel));
+
+        const size_t num_sizes = sizeof(sizes) / sizeof(sizes[0]);
+        const size_t num_densities = sizeof(alpha_densities) / sizeof(alpha_densities[0]);
+        bool first = true;
+
+        for (BenchFunction function = BENCH_CAESAR; function <= BENCH_CRIB_SCAN; function++) {
+                // Only the Vigenère family has keys of more than a single character
+                const bool vigenere = function == BENCH_VIGENERE ||
+                                      function == BENCH_DECIPHER_VIGENERE ||
+                                      function == BENCH_BEAUFORT || function == BENCH_AUTOKEY;
+                const size_t num_key_lengths =
+                    vigenere ? sizeof(key_lengths) / sizeof(key_lengths[0]) : 1;
+
+                for (size_t s = 0; s < num_sizes; s++) {
+                        if (sizes[s] > max_size) continue;
+
+                        for (size_t d = 0; d < num_densities; d++) {
+                                fill_text(sizes[s], text, alpha_densities[d], 0x9E3779B97F4A7C15);
+
+                                for (size_t k = 0; k < num_key_lengths; k++) {
+                                        const BenchCase bench = {
+                                                .function = function,
+                                                .size = sizes[s],
+                                                .key_len = key_lengths[k],
+                                                .alpha_density = alpha_densities[d],
+                                        };
+                                        const BenchResult result = run_case(&bench, key, text);
+
+                                        print_result(&bench, &result, first);
+                                        first = false;
+                                }
+                        }
+                }
+        }
+
+        printf("\n]}");
+}
+
+
+// Enciphers the plaintext, repeated as needed, with a random substitution key
+// until it has 'letters' letters. Returns the length of the ciphertext
+static size_t fill_substitution_text(size_t letters, char text[], char key[26]) {
+        uint64_t state = 0x2545F4914F6CDD1D;
+
+        for (size_t letter = 0; letter < 26; letter++)
+                key[letter] = (char) ('A' + letter);
+
+        for (size_t letter = 25; letter > 0; letter--) {
+                const size_t other = next_random(&state) % (letter + 1);
+                const char swap = key[letter];
+
+                key[letter] = key[other];
+                key[other] = swap;
+        }
+
+        size_t len = 0;
+
+        for (size_t i = 0; letters > 0; i = (i + 1) % (sizeof(solver_plaintext) - 1)) {
+                const char c = solver_plaintext[i];
+                const unsigned letter = (unsigned char) ((c | 0x20) - 'a');
+
+                text[len++] = letter < 26 ? (char) (key[letter] | (c & 0x20)) : c;
+                letters -= letter < 26;
+        }
+
+        return len;
+}
+
+// Solves per second, and the fraction of the key recovered for the letters the
+// ciphertext uses, over a different set of random starting keys each solve
+static void run_solver(const float* quadgrams) {
+        printf(",\n\"substitution_solver\": [");
+
+        const size_t num_letter_counts = sizeof(solver_letter_counts) / sizeof(size_t);
+        const size_t num_threads = sizeof(solver_threads) / sizeof(size_t);
+        const size_t plaintext_len = sizeof(solver_plaintext) - 1;
+        const size_t plaintext_letters = count_letters(plaintext_len, solver_plaintext);
+        // Enough whole copies of the plaintext for the most letters
+        const size_t copies = solver_letter_counts[num_letter_counts - 1] / plaintext_letters + 1;
+        char* text = malloc(copies * plaintext_len);
+        bool first = true;
+
+        if (text == NULL) {
+                fprintf(stderr, "Error: Failed to allocate the solver's ciphertext\n");
+                exit(EXIT_FAILURE);
+        }
+
+        for (size_t l = 0; l < num_letter_counts; l++) {
+                char key[26];
+                const size_t len = fill_substitution_text(solver_letter_counts[l], text, key);
+                size_t used = 0;
+
+                for (size_t letter = 0; letter < 26; letter++)
+                        used += memchr(solver_plaintext, 'a' + (int) letter,
+                                       sizeof(solver_plaintext)) != NULL;
+
+                for (size_t t = 0; t < num_threads; t++) {
+                        size_t solves = 0;
+                        size_t correct = 0;
+                        const double start = now_seconds();
+                        double seconds = 0;
+
+                        while (seconds < MIN_SECONDS) {
+                                substitution_candidate best;
+
+                                crack_substitution(len, text, quadgrams, SOLVER_RESTARTS, solves,
+                                                   solver_threads[t], &best);
+
+                                for (size_t letter = 0; letter < 26; letter++)
+                                        correct += best.key[letter] == key[letter] &&
+                                                   memchr(solver_plaintext, 'a' + (int) letter,
+                                                          sizeof(solver_plaintext)) != NULL;
+
+                                solves++;
+                                seconds = now_seconds() - start;
+                        }
+
+                        printf("%s\n    {\"letters\": %zu, \"threads\": %zu, \"restarts\": %d, "
+                               "\"solves\": %zu, \"solves_per_s\": %.2f, \"key_accuracy\": %.3f}",
+                               first ? "" : ",",
+                               solver_letter_counts[l],
+                               solver_threads[t],
+                               SOLVER_RESTARTS,
+                               solves,
+                               (double) solves / seconds,
+                               (double) correct / (double) (solves * used));
+                        fflush(stdout);
+                        first = false;
+                }
+        }
+
+        printf("\n]");
+        free(text);
+}
+
+
+// Words per second through the wordlist attack, on 1 thread and on every CPU
+static void run_wordlist(const float* quadgrams) {
+        printf(",\n\"wordlist\": [");
+
+        // Up to 12 letters and a newline per word
+        char* wordlist = malloc(WORDLIST_WORDS * 13);
+        char text[sizeof(solver_plaintext)];
+        uint64_t state = 0x9E3779B97F4A7C15;
+        size_t wordlist_len = 0;
+
+        if (wordlist == NULL) {
+                fprintf(stderr, "Error: Failed to allocate the wordlist\n");
+                exit(EXIT_FAILURE);
+        }
+
+        for (size_t word = 0; word < WORDLIST_WORDS; word++) {
+                if (word == WORDLIST_WORDS / 2) {
+                        memcpy(wordlist + wordlist_len, WORDLIST_KEY, strlen(WORDLIST_KEY));
+                        wordlist_len += strlen(WORDLIST_KEY);
+                } else {
+                        for (size_t i = next_random(&state) % 10 + 3; i > 0; i--)
+                                wordlist[wordlist_len++] = (char) ('a' + next_random(&state) % 26);
+                }
+
+                wordlist[wordlist_len++] = '\n';
+        }
+
+        memcpy(text, solver_plaintext, sizeof(text));
+        vigenere(strlen(WORDLIST_KEY), WORDLIST_KEY, sizeof(text) - 1, text);
+
+        for (size_t t = 0; t < sizeof(solver_threads) / sizeof(size_t); t++) {
+                wordlist_candidate best;
+                const double start = now_seconds();
+                const size_t found = crack_vigenere_wordlist(sizeof(text) - 1, text, wordlist_len,
+                                                             wordlist, quadgrams, 1, &best,
+                                                             solver_threads[t]);
+                const double seconds = now_seconds() - start;
+                const bool correct = found == 1 && best.word_len == strlen(WORDLIST_KEY) &&
+                                     memcmp(best.word, WORDLIST_KEY, best.word_len) == 0;
+
+                printf("%s\n    {\"words\": %d, \"threads\": %zu, \"words_per_s\": %.0f, "
+                       "\"found_key\": %s}",
+                       t == 0 ? "" : ",",
+                       WORDLIST_WORDS,
+                       solver_threads[t],
+                       WORDLIST_WORDS / seconds,
+                       correct ? "true" : "false");
+                fflush(stdout);
+        }
+
+        printf("\n]");
+        free(wordlist);
+}
+
+
+static void write_usage(const char* program) {
+        fprintf(stderr,
+                "Usage: %s [--max-size <bytes>] [--all-kernels]\n\n"
+                "Benchmarks the ciphers over a range of input sizes, key lengths and\n"
+                "densities of letters, the substitution solver over a range of\n"
+                "ciphertext lengths and the wordlist attack, and writes the results to\n"
+                "stdout as JSON. Solver and wordlist results with 0 threads use every CPU.\n\n"
+                "    -m, --max-size <bytes>   Skip inputs larger than this (default 1 GiB)\n"
+                "    -a, --all-kernels        Benchmark every kernel the CPU supports, not just\n"
+                "                             the fastest\n",
+                program);
+}
+
+int main(const int argc, char* const argv[]) {
+        size_t max_size = DEFAULT_MAX_SIZE;
+        bool all_kernels = false;
+
+        static struct option long_options[] = {
+                {    "max-size", required_argument, NULL, 'm' },
+                { "all-kernels",       no_argument, NULL, 'a' },
+                {          NULL,                 0, NULL,   0 }
+        };
+
+        int opt = 0;
+
+        while ((opt = getopt_long(argc, argv, "m:a", long_options, NULL)) != -1) {
+                switch (opt) {
+                        case 'm': {
+                                char* end = NULL;
+                                max_size = strtoull(optarg, &end, 10);
+
+                                if (end == optarg || *end != '\0' || max_size == 0) {
+                                        fprintf(stderr, "Error: Invalid maximum size\n");
+                                        exit(EXIT_FAILURE);
+                                }
+
+                                break;
+                        }
+                        case 'a':
+                                all_kernels = true;
+                                break;
+                        default:
+                                write_usage(argv[0]);
+                                exit(EXIT_FAILURE);
+                }
+        }
+
+        size_t buffer_size = 0;
+
+        for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+                if (sizes[s] <= max_size && sizes[s] > buffer_size) buffer_size = sizes[s];
+
+        const size_t max_key_len = key_lengths[sizeof(key_lengths) / sizeof(key_lengths[0]) - 1];
+        char* text = malloc(buffer_size);
+        char* key = malloc(max_key_len);
+
+        if (text == NULL || key == NULL) {
+                fprintf(stderr, "Error: Failed to allocate %zu bytes for the benchmark\n",
+                        buffer_size);
+                exit(EXIT_FAILURE);
+        }
+
+        fill_key(max_key_len, key, 0xD1B54A32D192ED03);
+
+        const cipher_kernel fastest = cipher_active_kernel();
+
+        printf("{\"cycles_source\": \"%s\", \"runs\": [\n", HAVE_TSC ? "tsc" : "none");
+
+        if (all_kernels) {
+                bool first = true;
+
+                for (cipher_kernel kernel = CIPHER_KERNEL_SCALAR; kernel < CIPHER_KERNEL_COUNT;
+                     kernel++) {
+                        if (!cipher_kernel_supported(kernel)) continue;
+
+                        if (!first) printf(",\n");
+
+                        run_kernel(kernel, max_size, text, key);
+                        first = false;
+                }
+        } else {
+                run_kernel(fastest, max_size, text, key);
+        }
+
+        printf("\n]");
+
+        // The solver and the wordlist attack don't use the cipher kernels, so
+        // they're only run once. Building the table isn't part of either
+        run_solver(english_quadgrams());
+        run_wordlist(english_quadgrams());
+
+        printf("}\n");
+
+        cipher_select_kernel(fastest);
+        free(key);
+        free(text);
+}
@@ -0,0 +1,401 @@
+// Needed for clock_gettime() and nanosleep()
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <getopt.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+
+/*
+  Load generator for 'cipher --serve'. Each connection runs on its own thread,
+  and keeps a window of requests in flight: it sends the whole window, reading
+  results as they arrive, until all of them are back, timing the round trip. The requests
+  are binary batch records (see 'src/batch.h').
+*/
+
+#define HEADER_SIZE 10
+#define RESPONSE_HEADER_SIZE 4
+// How long to keep retrying while the server starts up
+#define CONNECT_TIMEOUT_SECONDS 5.0
+#define CONNECT_RETRY_NS 10000000
+
+typedef struct LoadConfig {
+        const char* socket_path;
+        size_t connections;
+        size_t pipeline;
+        size_t size;
+        size_t key_len;
+        bool caesar;
+        double duration;
+} LoadConfig;
+
+typedef struct Connection {
+        pthread_t thread;
+        const LoadConfig* config;
+        size_t requests;
+        double seconds;
+        // Round trip of every window, in seconds
+        double* latencies;
+        size_t latency_count;
+        size_t latency_capacity;
+} Connection;
+
+
+static inline double now_seconds(void) {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+
+        return (double) now.tv_sec + (double) now.tv_nsec * 1e-9;
+}
+
+static inline void write_u32_le(uint32_t value, unsigned char bytes[4]) {
+        for (int i = 0; i < 4; i++)
+                bytes[i] = (unsigned char) (value >> (8 * i));
+}
+
+static void* checked_malloc(size_t size) {
+        void* memory = malloc(size);
+
+        if (memory == NULL) {
+                fprintf(stderr, "Error: Out of memory\n");
+                exit(EXIT_FAILURE);
+        }
+
+        return memory;
+}
+
+static int connect_to_server(const char* socket_path) {
+        struct sockaddr_un address = { .sun_family = AF_UNIX };
+
+        if (strlen(socket_path) >= sizeof(address.sun_path)) {
+                fprintf(stderr, "Error: Socket path is too long\n");
+                exit(EXIT_FAILURE);
+        }
+
+        strcpy(address.sun_path, socket_path);
+
+        const double deadline = now_seconds() + CONNECT_TIMEOUT_SECONDS;
+
+        for (;;) {
+                const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+                if (fd >= 0 && connect(fd, (struct sockaddr*) &address, sizeof(address)) == 0)
+                        return fd;
+
+                const int error = errno;
+
+                if (fd >= 0) close(fd);
+
+                if ((error != ENOENT && error != ECONNREFUSED) || now_seconds() > deadline) {
+                        fprintf(stderr, "Error: Failed to connect to '%s': %s\n", socket_path,
+                                strerror(error));
+                        exit(EXIT_FAILURE);
+                }
+
+                nanosleep(&(struct timespec) { .tv_nsec = CONNECT_RETRY_NS }, NULL);
+        }
+}
+
+// Sends 'requests' while receiving 'results', as a server stops reading once
+// enough results are waiting, so sending everything first could deadlock
+// Whether a failed send() or recv() just needs retrying
+static inline bool would_block(void) {
+        return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+}
+
+static void exchange(int fd,
+                     size_t requests_len,
+                     const char requests[requests_len],
+                     size_t results_len,
+                     char results[results_len]) {
+        size_t sent = 0;
+        size_t received = 0;
+
+        while (received < results_len) {
+                struct pollfd poll_fd = {
+                        .fd = fd,
+                        .events = (short) (sent < requests_len ? POLLIN | POLLOUT : POLLIN),
+                };
+
+                if (poll(&poll_fd, 1, -1) < 0) {
+                        if (errno == EINTR) continue;
+
+                        fprintf(stderr, "Error: Failed to wait for the server\n");
+                        exit(EXIT_FAILURE);
+                }
+
+                if (poll_fd.revents & POLLOUT) {
+                        const ssize_t bytes = send(
+                            fd, requests + sent, requests_len - sent, MSG_NOSIGNAL | MSG_DONTWAIT);
+
+                        if (bytes < 0 && !would_block()) {
+                                fprintf(stderr, "Error: Failed to send requests\n");
+                                exit(EXIT_FAILURE);
+                        }
+
+                        if (bytes > 0) sent += (size_t) bytes;
+                }
+
+                if (poll_fd.revents & (POLLIN | POLLHUP)) {
+                        const ssize_t bytes =
+                            recv(fd, results + received, results_len - received, MSG_DONTWAIT);
+
+                        if (bytes == 0 || (bytes < 0 && !would_block())) {
+                                fprintf(stderr, "Error: The server closed the connection\n");
+                                exit(EXIT_FAILURE);
+                        }
+
+                        if (bytes > 0) received += (size_t) bytes;
+                }
+        }
+}
+
+// Every request in the window is the same record
+static char* build_window(const LoadConfig* config, size_t* len) {
+        const size_t record_size = HEADER_SIZE + config->key_len + config->size;
+        char* window = checked_malloc(record_size * config->pipeline);
+
+        for (size_t i = 0; i < config->pipeline; i++) {
+                unsigned char* record = (unsigned char*) window + i * record_size;
+
+                record[0] = 'e';
+                record[1] = config->caesar ? 'c' : 'v';
+                write_u32_le((uint32_t) config->key_len, record + 2);
+                write_u32_le((uint32_t) config->size, record + 6);
+
+                for (size_t k = 0; k < config->key_len; k++)
+                        record[HEADER_SIZE + k] = (unsigned char) ('A' + (k * 7 + 3) % 26);
+
+                for (size_t c = 0; c < config->size; c++)
+                        record[HEADER_SIZE + config->key_len + c] =
+                            (unsigned char) (c % 6 == 5 ? ' ' : 'a' + (c * 11) % 26);
+        }
+
+        *len = record_size * config->pipeline;
+
+        return window;
+}
+
+static void* run_connection(void* arg) {
+        Connection* connection = arg;
+        const LoadConfig* config = connection->config;
+        const int fd = connect_to_server(config->socket_path);
+
+        size_t window_len = 0;
+        char* window = build_window(config, &window_len);
+        const size_t results_len = (RESPONSE_HEADER_SIZE + config->size) * config->pipeline;
+        char* results = checked_malloc(results_len);
+
+        const double start = now_seconds();
+        const double end = start + config->duration;
+        double now = 0;
+
+        while ((now = now_seconds()) < end) {
+                exchange(fd, window_len, window, results_len, results);
+
+                if (connection->latency_count == connection->latency_capacity) {
+                        connection->latency_capacity =
+                            connection->latency_capacity > 0 ? 2 * connection->latency_capacity
+                                                             : 0x1000;
+
+                        double* grown = realloc(connection->latencies,
+                                                connection->latency_capacity * sizeof(double));
+
+                        if (grown == NULL) {
+                                fprintf(stderr, "Error: Out of memory\n");
+                                exit(EXIT_FAILURE);
+                        }
+
+                        connection->latencies = grown;
+                }
+
+                connection->latencies[connection->latency_count++] = now_seconds() - now;
+                connection->requests += config->pipeline;
+        }
+
+        connection->seconds = now_seconds() - start;
+
+        free(results);
+        free(window);
+        close(fd);
+
+        return NULL;
+}
+
+
+static int compare_doubles(const void* a, const void* b) {
+        const double x = *(const double*) a;
+        const double y = *(const double*) b;
+
+        return (x > y) - (x < y);
+}
+
+static void print_results(const LoadConfig* config, const Connection connections[]) {
+        size_t requests = 0;
+        size_t count = 0;
+        // Time spent connecting (e.g. while the server starts up) isn't counted
+        double seconds = 0;
+
+        for (size_t i = 0; i < config->connections; i++) {
+                requests += connections[i].requests;
+                count += connections[i].latency_count;
+
+                if (connections[i].seconds > seconds) seconds = connections[i].seconds;
+        }
+
+        double* latencies = checked_malloc((count > 0 ? count : 1) * sizeof(double));
+
+        for (size_t i = 0, offset = 0; i < config->connections; i++) {
+                memcpy(latencies + offset, connections[i].latencies,
+                       connections[i].latency_count * sizeof(double));
+                offset += connections[i].latency_count;
+        }
+
+        qsort(latencies, count, sizeof(double), compare_doubles);
+
+        const double p50 = count > 0 ? latencies[count / 2] : 0;
+        const double p99 = count > 0 ? latencies[count * 99 / 100] : 0;
+        const double max = count > 0 ? latencies[count - 1] : 0;
+
+        printf("{\"cipher\": \"%s\", \"connections\": %zu, \"pipeline\": %zu, \"size\": %zu, "
+               "\"key_length\": %zu, \"requests\": %zu, \"seconds\": %.3f, "
+               "\"requests_per_s\": %.0f, \"mb_per_s\": %.2f, "
+               "\"window_latency_us\": {\"p50\": %.1f, \"p99\": %.1f, \"max\": %.1f}}\n",
+               config->caesar ? "caesar" : "vigenere",
+               config->connections,
+               config->pipeline,
+               config->size,
+               config->key_len,
+               requests,
+               seconds,
+               (double) requests / seconds,
+               (double) requests * (double) config->size / seconds / 1e6,
+               p50 * 1e6,
+               p99 * 1e6,
+               max * 1e6);
+
+        free(latencies);
+}
+
+
+static size_t parse_count(const char* arg, const char* name) {
+        char* end = NULL;
+        const unsigned long long value = strtoull(arg, &end, 10);
+
+        if (end == arg || *end != '\0' || arg[0] == '-' || value > UINT32_MAX) {
+                fprintf(stderr, "Error: Invalid %s\n", name);
+                exit(EXIT_FAILURE);
+        }
+
+        return (size_t) value;
+}
+
+static void write_usage(const char* program) {
+        fprintf(stderr,
+                "Usage: %s [options] <socket>\n\n"
+                "Sends requests to a server started with 'cipher --serve <socket>', and writes\n"
+                "the throughput and round-trip latency to stdout as JSON.\n\n"
+                "    -c, --connections <n>       Concurrent connections (default 4)\n"
+                "    -p, --pipeline <n>          Requests in flight per connection (default 32)\n"
+                "    -s, --size <bytes>          Text length of each request (default 256)\n"
+                "    -k, --key-length <n>        Vigenère key length (default 16)\n"
+                "        --caesar                Send Caesar requests instead of Vigenère\n"
+                "    -d, --duration <seconds>    How long to run for (default 5)\n",
+                program);
+}
+
+int main(const int argc, char* const argv[]) {
+        LoadConfig config = {
+                .connections = 4,
+                .pipeline = 32,
+                .size = 256,
+                .key_len = 16,
+                .duration = 5,
+        };
+
+        static struct option long_options[] = {
+                { "connections", required_argument, NULL, 'c' },
+                {    "pipeline", required_argument, NULL, 'p' },
+                {        "size", required_argument, NULL, 's' },
+                {  "key-length", required_argument, NULL, 'k' },
+                {      "caesar",       no_argument, NULL, 'C' },
+                {    "duration", required_argument, NULL, 'd' },
+                {          NULL,                 0, NULL,   0 }
+        };
+
+        int opt = 0;
+
+        while ((opt = getopt_long(argc, argv, "c:p:s:k:d:", long_options, NULL)) != -1) {
+                switch (opt) {
+                        case 'c':
+                                config.connections = parse_count(optarg, "number of connections");
+                                break;
+                        case 'p':
+                                config.pipeline = parse_count(optarg, "pipeline depth");
+                                break;
+                        case 's':
+                                config.size = parse_count(optarg, "request size");
+                                break;
+                        case 'k':
+                                config.key_len = parse_count(optarg, "key length");
+                                break;
+                        case 'C':
+                                config.caesar = true;
+                                break;
+                        case 'd':
+                                config.duration = (double) parse_count(optarg, "duration");
+                                break;
+                        default:
+                                write_usage(argv[0]);
+                                exit(EXIT_FAILURE);
+                }
+        }
+
+        if (optind != argc - 1 || config.connections == 0 || config.pipeline == 0 ||
+            config.key_len == 0) {
+                write_usage(argv[0]);
+                exit(EXIT_FAILURE);
+        }
+
+        config.socket_path = argv[optind];
+
+        // Caesar keys are a single letter
+        if (config.caesar) config.key_len = 1;
+
+        Connection* connections = calloc(config.connections, sizeof(Connection));
+
+        if (connections == NULL) {
+                fprintf(stderr, "Error: Out of memory\n");
+                exit(EXIT_FAILURE);
+        }
+
+        for (size_t i = 0; i < config.connections; i++) {
+                connections[i].config = &config;
+
+                if (pthread_create(&connections[i].thread, NULL, run_connection, &connections[i]) !=
+                    0) {
+                        fprintf(stderr, "Error: Failed to start a connection thread\n");
+                        exit(EXIT_FAILURE);
+                }
+        }
+
+        for (size_t i = 0; i < config.connections; i++)
+                pthread_join(connections[i].thread, NULL);
+
+        print_results(&config, connections);
+
+        for (size_t i = 0; i < config.connections; i++)
+                free(connections[i].latencies);
+
+        free(connections);
+}
@@ -1,6 +1,7 @@
 #ifndef CIPHER_H
 #define CIPHER_H
 
+#include <stdbool.h>
 #include <stddef.h>
 
 
@@ -16,4 +17,200 @@ void vigenere(size_t key_len, const char key[key_len], size_t len, char plaintex
 // WARNING: mutates 'ciphertext'!
 void decipher_vigenere(size_t key_len, const char key[key_len], size_t len, char ciphertext[len]);
 
+// Out-of-place variants, which read 'in' and write the result to 'out' in a
+// single pass, leaving 'in' unchanged. 'in' and 'out' may be the same buffer,
+// but must not otherwise overlap. Large outputs are written with non-temporal
+// stores, so they don't evict everything else from the cache
+void caesar_to(char key, size_t len, const char in[len], char out[len]);
+void decipher_caesar_to(char key, size_t len, const char in[len], char out[len]);
+void vigenere_to(
+    size_t key_len, const char key[key_len], size_t len, const char in[len], char out[len]);
+void decipher_vigenere_to(
+    size_t key_len, const char key[key_len], size_t len, const char in[len], char out[len]);
+
+
+// Vigenère key compiled into a dense schedule of rotations. The key position is
+// carried across calls, so a long stream can be processed in arbitrary chunks
+typedef struct vigenere_ctx {
+        unsigned char* shifts; // Rotation (0 - 25) for each alphabetic key character, repeated
+        size_t period;         // Number of alphabetic characters in the key
+        size_t span;           // Multiple of 'period' at which 'position' wraps
+        size_t position;       // Index into 'shifts' for the next letter
+} vigenere_ctx;
+
+// Returns false if the key has no alphabetic characters or memory couldn't be
+// allocated; the context then leaves text unchanged
+bool vigenere_ctx_init(vigenere_ctx* ctx, size_t key_len, const char key[key_len], bool decipher);
+// Bytes of schedule the key compiles to, or 0 if it has no alphabetic characters
+size_t vigenere_schedule_size(size_t key_len, const char key[key_len]);
+// As vigenere_ctx_init(), but builds the schedule into 'shifts', which must
+// hold vigenere_schedule_size() bytes and stays the caller's to free, so one
+// buffer can be reused for many keys. The context mustn't be freed
+bool vigenere_ctx_init_in(vigenere_ctx* ctx,
+                          size_t key_len,
+                          const char key[key_len],
+                          bool decipher,
+                          unsigned char shifts[]);
+// WARNING: mutates 'text'!
+void vigenere_ctx_update(vigenere_ctx* ctx, size_t len, char text[len]);
+void vigenere_ctx_update_to(vigenere_ctx* ctx, size_t len, const char in[len], char out[len]);
+// Restart from the beginning of the key
+void vigenere_ctx_reset(vigenere_ctx* ctx);
+// Advance the key as if 'letters' letters had been processed
+void vigenere_ctx_skip(vigenere_ctx* ctx, size_t letters);
+void vigenere_ctx_free(vigenere_ctx* ctx);
+
+
+// Polyalphabetic ciphers built from the same two steps: each letter is
+// substituted by a fixed multiple of itself, then shifted by the next rotation
+// of a key schedule (deciphering undoes the steps in reverse). Each step runs
+// over the whole text with its own kernel, and is skipped when it does nothing.
+// Non-alphabetic characters pass through without using up a rotation
+typedef enum poly_cipher {
+        POLY_CAESAR,           // Letter plus the first key letter
+        POLY_VIGENERE,         // Letter plus each key letter in turn
+        POLY_BEAUFORT,         // Key letter minus the letter, so it's its own inverse
+        POLY_VARIANT_BEAUFORT, // Letter minus the key letter
+        POLY_AFFINE,           // Letter times 'multiplier', plus 'increment'
+        POLY_AUTOKEY,          // Vigenère, with the key continued by the plaintext
+        POLY_RUNNING_KEY,      // Vigenère, with the letters of a text at least as long as the key
+} poly_cipher;
+
+typedef struct poly_params {
+        poly_cipher cipher;
+        size_t key_len;
+        const char* key;     // Ignored by Affine
+        unsigned multiplier; // Affine only, and must be coprime with 26
+        unsigned increment;  // Affine only
+        bool decipher;
+} poly_params;
+
+typedef struct poly_ctx {
+        poly_cipher cipher;
+        bool decipher;
+        // Letter each letter (0 - 25) becomes, before the shifts when
+        // enciphering and after them when deciphering
+        unsigned char substitution[26];
+        bool substitute;
+        // Rotations, repeated like a Vigenère key; a period of 0 shifts nothing
+        vigenere_ctx schedule;
+        // Autokey only: the rotations for the next 'schedule.period' letters,
+        // starting at 'next', and room to lay out a whole chunk's rotations
+        unsigned char* pending;
+        size_t next;
+        unsigned char* scratch;
+        size_t scratch_size;
+} poly_ctx;
+
+// Returns false if the key has no alphabetic characters, the Affine
+// multiplier isn't coprime with 26 or memory couldn't be allocated; the
+// context then leaves text unchanged
+bool poly_ctx_init(poly_ctx* ctx, const poly_params* params);
+// WARNING: mutates 'text'!
+void poly_ctx_update(poly_ctx* ctx, size_t len, char text[len]);
+void poly_ctx_update_to(poly_ctx* ctx, size_t len, const char in[len], char out[len]);
+void poly_ctx_free(poly_ctx* ctx);
+
+// Number of alphabetic characters in 'text', i.e. how far a Vigenère key advances over it
+size_t count_letters(size_t len, const char text[len]);
+// Adds the number of times each letter appears in 'text' to 'counts', with
+// both cases counted together ('a' and 'A' at index 0)
+void letter_histogram(size_t len, const char text[len], size_t counts[26]);
+
+// Bytes past the last letter that letter_slots() may write
+#define LETTER_SLOTS_PAD 64
+// Writes the index (0 - 25) of each letter in 'text' to 'slots', in order,
+// returning the number of letters. 'slots' needs room for
+// 'len + LETTER_SLOTS_PAD' bytes
+size_t letter_slots(size_t len, const char text[len], unsigned char slots[]);
+
+// Longest crib crib_scan() slides, in letters
+#define CRIB_MAX_LETTERS 64
+
+// Called by crib_scan() for each offset where the key repeats
+typedef void (*crib_match_fn)(size_t offset, size_t period, void* arg);
+
+// Slides 'crib' over 'letters' (both letter indices, 0 - 25) and, at each of
+// the first 'count' offsets, checks whether the Vigenère key under it
+// ((letter - crib letter) mod 26) repeats with a period of at most
+// 'max_period', which must be below 'crib_len - 2'. 'match' is called, in
+// order, for each offset where it does, with the shortest such period.
+// 'letters' must hold 'count + crib_len - 1' letters, and be readable for
+// CRIB_MAX_LETTERS bytes from the last offset
+void crib_scan(size_t count,
+               const unsigned char letters[],
+               size_t crib_len,
+               const unsigned char crib[],
+               size_t max_period,
+               crib_match_fn match,
+               void* arg);
+
+// Validates 'text' as UTF-8, returning the length of its longest prefix of
+// complete, valid sequences ('len' if it's all valid), i.e. the offset of the
+// first invalid byte. If that's only the start of a valid sequence cut off by
+// the end of 'text', which the next chunk of a stream may finish, 'truncated'
+// is set (when it isn't NULL).
+// The ciphers never change multi-byte sequences, as every byte of one is
+// outside the ASCII letters they rotate
+size_t utf8_validate(size_t len, const char text[len], bool* truncated);
+
+
+// Multithreaded variants, which split the text into chunks across 'nthreads'
+// threads (0 uses every available CPU). The output is identical to the
+// single-threaded functions
+
+// WARNING: mutates 'plaintext'!
+void caesar_parallel(char key, size_t length, char plaintext[length], size_t nthreads);
+// WARNING: mutates 'ciphertext'!
+void decipher_caesar_parallel(char key, size_t length, char ciphertext[length], size_t nthreads);
+// WARNING: mutates 'plaintext'!
+void vigenere_parallel(
+    size_t key_len, const char key[key_len], size_t len, char plaintext[len], size_t nthreads);
+// WARNING: mutates 'ciphertext'!
+void decipher_vigenere_parallel(
+    size_t key_len, const char key[key_len], size_t len, char ciphertext[len], size_t nthreads);
+// WARNING: mutates 'text'!
+void vigenere_ctx_update_parallel(vigenere_ctx* ctx, size_t len, char text[len], size_t nthreads);
+// Autokey's key depends on the text, so it always runs on a single thread
+// WARNING: mutates 'text'!
+void poly_ctx_update_parallel(poly_ctx* ctx, size_t len, char text[len], size_t nthreads);
+
+
+// One of many separate buffers ciphered by a single call
+typedef struct cipher_iov {
+        char* base;
+        size_t len;
+} cipher_iov;
+
+// Ciphers every buffer in 'iov' in place with a key compiled once into 'ctx'.
+// If 'restart_key' is set, each buffer starts from the beginning of the key,
+// and 'ctx' is left reset; otherwise the key runs on from buffer to buffer as
+// if they were one text, and 'ctx' is left after the last of them.
+// The buffers are processed in cache-sized groups of consecutive buffers,
+// spread across 'nthreads' threads (0 uses every available CPU)
+// WARNING: mutates the buffers in 'iov'!
+void vigenere_batch(vigenere_ctx* ctx,
+                    size_t count,
+                    const cipher_iov iov[count],
+                    bool restart_key,
+                    size_t nthreads);
+
+
+// Implementations of the cipher kernels. The fastest one supported by the CPU
+// is selected when the program is loaded; they all produce identical output
+typedef enum cipher_kernel {
+        CIPHER_KERNEL_SCALAR,
+        CIPHER_KERNEL_SSE2,
+        CIPHER_KERNEL_SSSE3,
+        CIPHER_KERNEL_AVX2,
+        CIPHER_KERNEL_AVX512,
+        CIPHER_KERNEL_COUNT
+} cipher_kernel;
+
+bool cipher_kernel_supported(cipher_kernel kernel);
+// Returns false and keeps the current kernel if 'kernel' isn't supported
+bool cipher_select_kernel(cipher_kernel kernel);
+cipher_kernel cipher_active_kernel(void);
+const char* cipher_kernel_name(cipher_kernel kernel);
+
 #endif
@@ -0,0 +1,152 @@
+#ifndef CRYPTANALYSIS_H
+#define CRYPTANALYSIS_H
+
+#include "cipher.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+
+// Relative frequency of each letter ('A' - 'Z') in English text
+extern const double english_letter_frequencies[26];
+
+
+typedef struct caesar_candidate {
+        char key;           // 'A' - 'Z', as given to decipher_caesar
+        double chi_squared; // Distance of the deciphered letters from English, lower is better
+} caesar_candidate;
+
+// Scores all 26 Caesar keys against the letter counts of a ciphertext, and
+// sorts them into 'ranked' best first. Returns true once the best key is clear
+// enough that counting more of the ciphertext won't change it
+bool rank_caesar_keys(const size_t counts[26], caesar_candidate ranked[26]);
+
+// Recovers the key of Caesar ciphertext, ranking every key into 'ranked'.
+// Blocks are sampled from across the whole text, and sampling stops as soon as
+// the best key is clear, so a large text is usually only partly read.
+// Returns the number of bytes sampled
+size_t crack_caesar(size_t len, const char text[len], caesar_candidate ranked[26]);
+
+
+// Vigenère ciphertext beyond this many bytes isn't needed to recover the key,
+// so crack_vigenere() ignores it
+#define VIGENERE_CRACK_SAMPLE_SIZE 0x400000
+
+// Recovers the key of Vigenère ciphertext, trying key lengths up to
+// 'max_key_len'. Non-alphabetic characters are skipped, as vigenere() does.
+// The key length is estimated from the index of coincidence of the letters
+// split into that many columns, then each column is solved as a Caesar cipher.
+// 'coincidence[length - 1]' is set to the mean index of coincidence for each
+// key length (0 where there are too few letters to judge it).
+// Returns the key length, or 0 if there are too few letters
+size_t crack_vigenere(size_t len,
+                      const char text[len],
+                      size_t max_key_len,
+                      char key[max_key_len],
+                      double coincidence[max_key_len],
+                      size_t nthreads);
+
+// Orders the key lengths judged by crack_vigenere() into 'ranked', most likely
+// first. Multiples of the key length score as well as the key length itself, so
+// each is the shortest of the remaining lengths near the best of them, and the
+// first is the length crack_vigenere() picked. Lengths with no index of
+// coincidence are left out. Returns the number ranked
+size_t rank_key_lengths(size_t max_key_len,
+                        const double coincidence[max_key_len],
+                        size_t ranked[max_key_len]);
+
+
+// The key under a crib must repeat for at least this many letters for it to be
+// a match: chance matches then turn up about once in 2 * 10^11 offsets. So a
+// crib finds keys up to this many letters shorter than itself
+#define CRIB_MIN_REPEATS 8
+
+typedef struct crib_candidate {
+        // 'A' - 'Z', starting from the key letter the text's first letter is ciphered with
+        char key[CRIB_MAX_LETTERS];
+        size_t key_len;
+        size_t offset;  // Byte offset of the first place the crib fits under this key
+        size_t matches; // Number of places it does
+} crib_candidate;
+
+// Recovers Vigenère keys from known plaintext: the letters of 'crib' (the first
+// CRIB_MAX_LETTERS of them) are slid over every offset of the letters of
+// 'text', and wherever the key under them repeats for CRIB_MIN_REPEATS letters
+// or more, the repeating part is a candidate key. Non-alphabetic characters are
+// skipped, as vigenere() does. The text is scanned in chunks on up to
+// 'nthreads' threads.
+// Returns the number of distinct keys found, writing up to 'capacity' of them
+// to 'candidates', most matches first
+size_t crack_vigenere_crib(size_t len,
+                           const char text[len],
+                           size_t crib_len,
+                           const char crib[crib_len],
+                           size_t capacity,
+                           crib_candidate candidates[capacity],
+                           size_t nthreads);
+
+// Quadgram tables hold a log10 probability for every sequence of four letters,
+// indexed by the letters (0 - 25) as a base-26 number, first letter highest.
+// As a file, a table is the QUADGRAM_COUNT floats in the machine's byte order
+#define QUADGRAM_COUNT (26 * 26 * 26 * 26)
+// Ciphertext letters beyond this many aren't needed to recover a substitution
+// key, so crack_substitution() ignores them
+#define SUBSTITUTION_CRACK_MAX_LETTERS 0x1000
+
+typedef struct substitution_candidate {
+        char key[26]; // Ciphertext letter ('A' - 'Z') for each plaintext letter
+        double score; // Mean log10 probability of the deciphered quadgrams, higher is better
+} substitution_candidate;
+
+// Builds the quadgram table of the letters in 'text', skipping anything else
+// as the ciphers do. Quadgrams that never occur get a floor below the rarest
+// that did. Returns false if there are fewer than 4 letters
+bool build_quadgrams(size_t len, const char text[len], float quadgrams[QUADGRAM_COUNT]);
+
+// Table built from a sample of English prose, on first use
+const float* english_quadgrams(void);
+
+// Recovers the key of a simple substitution cipher by hill climbing: starting
+// from a random key, pairs of letters are swapped while that improves the
+// quadgram score of the deciphered text. Each swap only rescores the quadgrams
+// containing either letter. The climb is restarted 'restarts' times from keys
+// drawn from 'seed', on up to 'nthreads' threads, and the best result is kept;
+// it doesn't depend on the number of threads.
+// Returns false if there are fewer than 4 letters
+bool crack_substitution(size_t len,
+                        const char text[len],
+                        const float quadgrams[QUADGRAM_COUNT],
+                        size_t restarts,
+                        uint64_t seed,
+                        size_t nthreads,
+                        substitution_candidate* best);
+
+
+// Ciphertext letters each word of a wordlist is tried as a Vigenère key on
+#define WORDLIST_SAMPLE_LETTERS 0x100
+
+typedef struct wordlist_candidate {
+        const char* word; // Line of the wordlist, without the line ending
+        size_t word_len;
+        double score; // Mean log10 probability of the deciphered quadgrams, higher is better
+} wordlist_candidate;
+
+// Recovers a Vigenère key from a list of likely ones, one per line of
+// 'wordlist' (ignoring non-alphabetic characters, as vigenere() does). Each is
+// tried on the first WORDLIST_SAMPLE_LETTERS letters of 'text' only, scoring
+// the decipherment by its quadgrams, and dropped as soon as it can no longer
+// beat the best found so far. The list is handed out to up to 'nthreads'
+// threads a block at a time.
+// Returns the number of keys written to 'best', at most 'capacity', best
+// first; the order doesn't depend on the number of threads. Returns 0 if
+// there are fewer than 4 letters in 'text'
+size_t crack_vigenere_wordlist(size_t len,
+                               const char text[len],
+                               size_t wordlist_len,
+                               const char wordlist[wordlist_len],
+                               const float quadgrams[QUADGRAM_COUNT],
+                               size_t capacity,
+                               wordlist_candidate best[capacity],
+                               size_t nthreads);
+
+#endif
@@ -0,0 +1,244 @@
+// Needed for getline()
+#define _POSIX_C_SOURCE 200809L
+
+#include "batch.h"
+#include "cipher.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+// stdio buffers, so records are read and written in large blocks
+#define BATCH_IO_BUFFER_SIZE 0x100000
+
+
+void* grow_buffer(void* buffer, size_t* capacity, size_t required) {
+        if (required <= *capacity) return buffer;
+
+        size_t new_capacity = *capacity > 0 ? *capacity : 0x100;
+
+        while (new_capacity < required)
+                new_capacity *= 2;
+
+        void* grown = realloc(buffer, new_capacity);
+
+        if (grown == NULL) {
+                fprintf(stderr, "Error: Out of memory\n");
+                exit(EXIT_FAILURE);
+        }
+
+        *capacity = new_capacity;
+
+        return grown;
+}
+
+static bool cache_vigenere_key(KeyCache* cache, const BatchRecord* record, bool decipher) {
+        if (cache->valid && cache->decipher == decipher && cache->key_len == record->key_len &&
+            memcmp(cache->key, record->key, record->key_len) == 0) {
+                vigenere_ctx_reset(&cache->ctx);
+                return true;
+        }
+
+        const size_t schedule_size = vigenere_schedule_size(record->key_len, record->key);
+
+        cache->valid = false;
+
+        if (schedule_size == 0) return false;
+
+        cache->schedule = grow_buffer(cache->schedule, &cache->schedule_capacity, schedule_size);
+        cache->valid = vigenere_ctx_init_in(
+            &cache->ctx, record->key_len, record->key, decipher, cache->schedule);
+
+        cache->key = grow_buffer(cache->key, &cache->capacity, record->key_len);
+        memcpy(cache->key, record->key, record->key_len);
+        cache->key_len = record->key_len;
+        cache->decipher = decipher;
+
+        return true;
+}
+
+bool cipher_record(KeyCache* cache, const BatchRecord* record, char out[record->len]) {
+        if (record->operation != 'e' && record->operation != 'd') return false;
+
+        const bool decipher = record->operation == 'd';
+
+        switch (record->cipher) {
+                case 'c': {
+                        if (record->key_len != 1) return false;
+
+                        // Either case of key works, and anything else is the identity
+                        if (decipher)
+                                decipher_caesar_to(record->key[0], record->len, record->text, out);
+                        else
+                                caesar_to(record->key[0], record->len, record->text, out);
+
+                        return true;
+                }
+                case 'v':
+                        // Keys without letters leave the text unchanged, which
+                        // the plain functions handle
+                        if (cache_vigenere_key(cache, record, decipher))
+                                vigenere_ctx_update_to(&cache->ctx, record->len, record->text, out);
+                        else if (decipher)
+                                decipher_vigenere_to(
+                                    record->key_len, record->key, record->len, record->text, out);
+                        else
+                                vigenere_to(
+                                    record->key_len, record->key, record->len, record->text, out);
+
+                        return true;
+                default:
+                        return false;
+        }
+}
+
+void key_cache_free(KeyCache* cache) {
+        free(cache->schedule);
+        free(cache->key);
+
+        *cache = (KeyCache) { 0 };
+}
+
+static void write_output(const void* data, size_t len) {
+        if (fwrite(data, 1, len, stdout) != len) {
+                fprintf(stderr, "Error: Failed to write output\n");
+                exit(EXIT_FAILURE);
+        }
+}
+
+
+// Splits "op TAB cipher TAB key TAB text" in place
+static bool parse_line(size_t len, char line[len], BatchRecord* record) {
+        if (len < 6 || line[1] != '\t' || line[3] != '\t') return false;
+
+        char* key = line + 4;
+        char* key_end = memchr(key, '\t', len - 4);
+
+        if (key_end == NULL) return false;
+
+        *record = (BatchRecord) {
+                .operation = line[0],
+                .cipher = line[2],
+                .key = key,
+                .key_len = (size_t) (key_end - key),
+                .text = key_end + 1,
+                .len = len - (size_t) (key_end + 1 - line),
+        };
+
+        return true;
+}
+
+static void run_batch_lines(KeyCache* cache) {
+        char* line = NULL;
+        size_t capacity = 0;
+        ssize_t length = 0;
+        size_t line_number = 0;
+
+        while ((length = getline(&line, &capacity, stdin)) > 0) {
+                size_t len = (size_t) length;
+                line_number++;
+
+                if (line[len - 1] == '\n') len--;
+
+                BatchRecord record;
+
+                // The text is ciphered in place
+                if (!parse_line(len, line, &record) ||
+                    !cipher_record(cache, &record, (char*) record.text)) {
+                        fprintf(stderr, "Error: Invalid record on line %zu\n", line_number);
+                        exit(EXIT_FAILURE);
+                }
+
+                write_output(record.text, record.len);
+                write_output("\n", 1);
+        }
+
+        free(line);
+}
+
+
+void parse_binary_header(const unsigned char header[BATCH_BINARY_HEADER_SIZE],
+                         BatchRecord* record) {
+        *record = (BatchRecord) {
+                .operation = (char) header[0],
+                .cipher = (char) header[1],
+                .key_len = read_u32_le(header + 2),
+                .len = read_u32_le(header + 6),
+        };
+}
+
+static void run_batch_binary(KeyCache* cache) {
+        unsigned char header[BATCH_BINARY_HEADER_SIZE];
+        char* payload = NULL;
+        size_t capacity = 0;
+        size_t record_number = 0;
+        size_t header_len = 0;
+
+        while ((header_len = fread(header, 1, BATCH_BINARY_HEADER_SIZE, stdin)) ==
+               BATCH_BINARY_HEADER_SIZE) {
+                record_number++;
+
+                BatchRecord record;
+                parse_binary_header(header, &record);
+
+                const size_t len = record.len;
+                const size_t payload_len = record.key_len + len;
+
+                payload = grow_buffer(payload, &capacity, payload_len);
+
+                if (fread(payload, 1, payload_len, stdin) != payload_len) {
+                        fprintf(stderr, "Error: Record %zu is truncated\n", record_number);
+                        exit(EXIT_FAILURE);
+                }
+
+                record.key = payload;
+                record.text = payload + record.key_len;
+
+                // The text is ciphered in place
+                if (!cipher_record(cache, &record, payload + record.key_len)) {
+                        fprintf(stderr, "Error: Invalid record %zu\n", record_number);
+                        exit(EXIT_FAILURE);
+                }
+
+                unsigned char length_prefix[4];
+
+                write_u32_le((uint32_t) len, length_prefix);
+
+                write_output(length_prefix, sizeof(length_prefix));
+                write_output(record.text, record.len);
+        }
+
+        if (header_len != 0) {
+                fprintf(stderr, "Error: Record %zu is truncated\n", record_number + 1);
+                exit(EXIT_FAILURE);
+        }
+
+        free(payload);
+}
+
+
+void run_batch(BatchFormat format) {
+        setvbuf(stdin, NULL, _IOFBF, BATCH_IO_BUFFER_SIZE);
+        setvbuf(stdout, NULL, _IOFBF, BATCH_IO_BUFFER_SIZE);
+
+        KeyCache cache = { 0 };
+
+        if (format == BATCH_BINARY)
+                run_batch_binary(&cache);
+        else
+                run_batch_lines(&cache);
+
+        if (ferror(stdin)) {
+                fprintf(stderr, "Error: Failed to read input\n");
+                exit(EXIT_FAILURE);
+        }
+
+        if (fflush(stdout) != 0) {
+                fprintf(stderr, "Error: Failed to write output\n");
+                exit(EXIT_FAILURE);
+        }
+
+        key_cache_free(&cache);
+}
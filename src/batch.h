@@ -0,0 +1,82 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "cipher.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+
+/*
+  Batch mode reads many records from stdin, each naming its own operation,
+  cipher and key, and writes one result per record to stdout in the same order.
+
+  Lines format, one record per line with tab-separated fields:
+
+      <e|d> TAB <c|v> TAB key TAB text NEWLINE   ->   result NEWLINE
+
+  The text runs to the end of the line, so it may contain tabs but not newlines.
+
+  Binary format, with lengths as unsigned 32-bit little-endian integers:
+
+      <e|d> <c|v> key_len text_len key text   ->   text_len result
+*/
+typedef enum BatchFormat {
+        BATCH_LINES,
+        BATCH_BINARY,
+} BatchFormat;
+
+// Exits with an error on malformed records
+void run_batch(BatchFormat format);
+
+
+#define BATCH_BINARY_HEADER_SIZE 10
+
+typedef struct BatchRecord {
+        char operation; // 'e' or 'd'
+        char cipher;    // 'c' or 'v'
+        const char* key;
+        size_t key_len;
+        const char* text;
+        size_t len;
+} BatchRecord;
+
+// Consecutive records often share a key, so the last Vigenère key is kept
+// compiled rather than rebuilding its schedule for every record. A new key is
+// compiled into the same schedule buffer, which only grows
+typedef struct KeyCache {
+        char* key;
+        size_t key_len;
+        size_t capacity;
+        unsigned char* schedule;
+        size_t schedule_capacity;
+        bool decipher;
+        bool valid;
+        vigenere_ctx ctx;
+} KeyCache;
+
+// Ciphers the record's text into 'out', which may be the text itself.
+// Returns false if the record asks for an unknown operation or cipher
+bool cipher_record(KeyCache* cache, const BatchRecord* record, char out[record->len]);
+void key_cache_free(KeyCache* cache);
+
+// Returns 'buffer' grown to at least 'required' bytes, doubling its capacity.
+// Exits with an error if there's no memory
+void* grow_buffer(void* buffer, size_t* capacity, size_t required);
+
+// Reads the operation, cipher and lengths of a binary record; the key and text
+// follow the header
+void parse_binary_header(const unsigned char header[BATCH_BINARY_HEADER_SIZE],
+                         BatchRecord* record);
+
+static inline uint32_t read_u32_le(const unsigned char bytes[4]) {
+        return (uint32_t) bytes[0] | (uint32_t) bytes[1] << 8 | (uint32_t) bytes[2] << 16 |
+               (uint32_t) bytes[3] << 24;
+}
+
+static inline void write_u32_le(uint32_t value, unsigned char bytes[4]) {
+        for (int i = 0; i < 4; i++)
+                bytes[i] = (unsigned char) (value >> (8 * i));
+}
+
+#endif
@@ -1,83 +1,946 @@
 #include "cipher.h"
-#include <ctype.h>
+#include "kernels.h"
+#include "stats.h"
 #include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 
 
-static inline char rotate(char base, int rotation, char c) {
-        // Perform the addition as an integer, because an 8-bit char can
-        // overflow!
-        return (char) (((int) (c - base) + rotation) % 26 + base);
+// Keys with up to this many letters have their schedule built on the stack
+#define STACK_SCHEDULE_SIZE 0x100
+// Out-of-place outputs at least this large are written with non-temporal
+// stores, as they would only evict everything else from the cache
+#define NONTEMPORAL_THRESHOLD 0x1000000
+
+// Rotation of a single byte, leaving anything but ASCII letters unchanged
+#define ROTATE_BYTE(rotation, c)                                                       \
+        ((c) >= 'A' && (c) <= 'Z'   ? ((c) - 'A' + (rotation)) % 26 + 'A'              \
+         : (c) >= 'a' && (c) <= 'z' ? ((c) - 'a' + (rotation)) % 26 + 'a'              \
+                                    : (c))
+#define ROTATE_16(rotation, high)                                                      \
+        ROTATE_BYTE(rotation, (high) + 0x0), ROTATE_BYTE(rotation, (high) + 0x1),      \
+            ROTATE_BYTE(rotation, (high) + 0x2), ROTATE_BYTE(rotation, (high) + 0x3),  \
+            ROTATE_BYTE(rotation, (high) + 0x4), ROTATE_BYTE(rotation, (high) + 0x5),  \
+            ROTATE_BYTE(rotation, (high) + 0x6), ROTATE_BYTE(rotation, (high) + 0x7),  \
+            ROTATE_BYTE(rotation, (high) + 0x8), ROTATE_BYTE(rotation, (high) + 0x9),  \
+            ROTATE_BYTE(rotation, (high) + 0xA), ROTATE_BYTE(rotation, (high) + 0xB),  \
+            ROTATE_BYTE(rotation, (high) + 0xC), ROTATE_BYTE(rotation, (high) + 0xD),  \
+            ROTATE_BYTE(rotation, (high) + 0xE), ROTATE_BYTE(rotation, (high) + 0xF)
+#define ROTATION_TABLE(rotation)                                                       \
+        {                                                                              \
+                ROTATE_16(rotation, 0x00), ROTATE_16(rotation, 0x10),                  \
+                    ROTATE_16(rotation, 0x20), ROTATE_16(rotation, 0x30),              \
+                    ROTATE_16(rotation, 0x40), ROTATE_16(rotation, 0x50),              \
+                    ROTATE_16(rotation, 0x60), ROTATE_16(rotation, 0x70),              \
+                    ROTATE_16(rotation, 0x80), ROTATE_16(rotation, 0x90),              \
+                    ROTATE_16(rotation, 0xA0), ROTATE_16(rotation, 0xB0),              \
+                    ROTATE_16(rotation, 0xC0), ROTATE_16(rotation, 0xD0),              \
+                    ROTATE_16(rotation, 0xE0), ROTATE_16(rotation, 0xF0),              \
+        }
+
+// Lookup table for every rotation, mapping each byte to its rotated value.
+// Non-alphabetic bytes, including every byte of a multi-byte UTF-8 sequence,
+// map to themselves. Built by the compiler, so it's ready before any cipher runs
+// and every key shares it
+static const unsigned char rotation_tables[26][256] = {
+        ROTATION_TABLE(0),  ROTATION_TABLE(1),  ROTATION_TABLE(2),  ROTATION_TABLE(3),
+        ROTATION_TABLE(4),  ROTATION_TABLE(5),  ROTATION_TABLE(6),  ROTATION_TABLE(7),
+        ROTATION_TABLE(8),  ROTATION_TABLE(9),  ROTATION_TABLE(10), ROTATION_TABLE(11),
+        ROTATION_TABLE(12), ROTATION_TABLE(13), ROTATION_TABLE(14), ROTATION_TABLE(15),
+        ROTATION_TABLE(16), ROTATION_TABLE(17), ROTATION_TABLE(18), ROTATION_TABLE(19),
+        ROTATION_TABLE(20), ROTATION_TABLE(21), ROTATION_TABLE(22), ROTATION_TABLE(23),
+        ROTATION_TABLE(24), ROTATION_TABLE(25),
+};
+
+static caesar_kernel_fn caesar_kernel = caesar_scalar;
+static vigenere_kernel_fn vigenere_kernel = vigenere_scalar;
+static count_letters_kernel_fn count_letters_kernel = count_letters_scalar;
+static letter_histogram_kernel_fn letter_histogram_kernel = letter_histogram_scalar;
+static substitute_kernel_fn substitute_kernel = substitute_scalar;
+static letter_slots_kernel_fn letter_slots_kernel = letter_slots_scalar;
+static crib_scan_kernel_fn crib_scan_kernel = crib_scan_scalar;
+static ascii_prefix_kernel_fn ascii_prefix_kernel = ascii_prefix_scalar;
+static cipher_kernel active_kernel = CIPHER_KERNEL_SCALAR;
+// Variant behind each kernel that --stats reports, which can be below the
+// active one where a tier falls back
+static cipher_kernel caesar_variant = CIPHER_KERNEL_SCALAR;
+static cipher_kernel vigenere_variant = CIPHER_KERNEL_SCALAR;
+static cipher_kernel substitute_variant = CIPHER_KERNEL_SCALAR;
+static cipher_kernel letter_slots_variant = CIPHER_KERNEL_SCALAR;
+
+
+// Runs when the program is loaded, so the kernel is picked before any cipher is called
+__attribute__((constructor)) static void init_kernels(void) {
+#if CIPHER_X86
+        __builtin_cpu_init();
+#endif
+
+        for (int kernel = CIPHER_KERNEL_COUNT - 1; kernel >= 0; kernel--)
+                if (cipher_select_kernel((cipher_kernel) kernel)) break;
 }
 
-// WARNING: mutates 'plaintext'!
-void caesar(char key, size_t length, char plaintext[length]) {
-        if (!isalpha(key)) return;
+bool cipher_kernel_supported(cipher_kernel kernel) {
+        switch (kernel) {
+                case CIPHER_KERNEL_SCALAR:
+                        return true;
+#if CIPHER_X86
+                case CIPHER_KERNEL_SSE2:
+                        return __builtin_cpu_supports("sse2");
+                case CIPHER_KERNEL_SSSE3:
+                        return __builtin_cpu_supports("ssse3") && __builtin_cpu_supports("popcnt");
+                case CIPHER_KERNEL_AVX2:
+                        return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt");
+                case CIPHER_KERNEL_AVX512:
+                        return __builtin_cpu_supports("avx512f") &&
+                               __builtin_cpu_supports("avx512bw");
+#endif
+                default:
+                        return false;
+        }
+}
+
+bool cipher_select_kernel(cipher_kernel kernel) {
+        if (!cipher_kernel_supported(kernel)) return false;
+
+        switch (kernel) {
+#if CIPHER_X86
+                case CIPHER_KERNEL_SSE2:
+                        // Vigenère needs SSSE3's byte shuffle
+                        caesar_kernel = caesar_sse2;
+                        vigenere_kernel = vigenere_scalar;
+                        count_letters_kernel = count_letters_sse2;
+                        letter_histogram_kernel = letter_histogram_scalar;
+                        substitute_kernel = substitute_scalar;
+                        letter_slots_kernel = letter_slots_scalar;
+                        crib_scan_kernel = crib_scan_scalar;
+                        ascii_prefix_kernel = ascii_prefix_sse2;
+                        caesar_variant = CIPHER_KERNEL_SSE2;
+                        vigenere_variant = CIPHER_KERNEL_SCALAR;
+                        substitute_variant = CIPHER_KERNEL_SCALAR;
+                        letter_slots_variant = CIPHER_KERNEL_SCALAR;
+                        break;
+                case CIPHER_KERNEL_SSSE3:
+                        caesar_kernel = caesar_sse2;
+                        vigenere_kernel = vigenere_ssse3;
+                        count_letters_kernel = count_letters_sse2;
+                        letter_histogram_kernel = letter_histogram_scalar;
+                        substitute_kernel = substitute_ssse3;
+                        letter_slots_kernel = letter_slots_scalar;
+                        crib_scan_kernel = crib_scan_scalar;
+                        ascii_prefix_kernel = ascii_prefix_sse2;
+                        caesar_variant = CIPHER_KERNEL_SSE2;
+                        vigenere_variant = CIPHER_KERNEL_SSSE3;
+                        substitute_variant = CIPHER_KERNEL_SSSE3;
+                        letter_slots_variant = CIPHER_KERNEL_SCALAR;
+                        break;
+                case CIPHER_KERNEL_AVX2:
+                        caesar_kernel = caesar_avx2;
+                        vigenere_kernel = vigenere_avx2;
+                        count_letters_kernel = count_letters_avx2;
+                        letter_histogram_kernel = letter_histogram_avx2;
+                        substitute_kernel = substitute_avx2;
+                        letter_slots_kernel = __builtin_cpu_supports("bmi2") ? letter_slots_avx2
+                                                                             : letter_slots_scalar;
+                        crib_scan_kernel = crib_scan_avx2;
+                        ascii_prefix_kernel = ascii_prefix_avx2;
+                        caesar_variant = CIPHER_KERNEL_AVX2;
+                        vigenere_variant = CIPHER_KERNEL_AVX2;
+                        substitute_variant = CIPHER_KERNEL_AVX2;
+                        letter_slots_variant = __builtin_cpu_supports("bmi2")
+                                                   ? CIPHER_KERNEL_AVX2
+                                                   : CIPHER_KERNEL_SCALAR;
+                        break;
+                case CIPHER_KERNEL_AVX512:
+                        // Vigenère's expand-load and the letter packing need VBMI2,
+                        // which not every AVX-512 CPU has (though they all have BMI2)
+                        caesar_kernel = caesar_avx512;
+                        count_letters_kernel = count_letters_avx512;
+                        letter_histogram_kernel = letter_histogram_avx512;
+                        substitute_kernel = substitute_avx512;
+                        crib_scan_kernel = crib_scan_avx512;
+                        ascii_prefix_kernel = ascii_prefix_avx512;
+                        caesar_variant = CIPHER_KERNEL_AVX512;
+                        substitute_variant = CIPHER_KERNEL_AVX512;
+
+                        if (__builtin_cpu_supports("avx512vbmi2")) {
+                                vigenere_kernel = vigenere_avx512;
+                                letter_slots_kernel = letter_slots_avx512;
+                                vigenere_variant = CIPHER_KERNEL_AVX512;
+                                letter_slots_variant = CIPHER_KERNEL_AVX512;
+                        } else {
+                                vigenere_kernel = vigenere_avx2;
+                                letter_slots_kernel = letter_slots_avx2;
+                                vigenere_variant = CIPHER_KERNEL_AVX2;
+                                letter_slots_variant = CIPHER_KERNEL_AVX2;
+                        }
+
+                        break;
+#endif
+                default:
+                        caesar_kernel = caesar_scalar;
+                        vigenere_kernel = vigenere_scalar;
+                        count_letters_kernel = count_letters_scalar;
+                        letter_histogram_kernel = letter_histogram_scalar;
+                        substitute_kernel = substitute_scalar;
+                        letter_slots_kernel = letter_slots_scalar;
+                        crib_scan_kernel = crib_scan_scalar;
+                        ascii_prefix_kernel = ascii_prefix_scalar;
+                        caesar_variant = CIPHER_KERNEL_SCALAR;
+                        vigenere_variant = CIPHER_KERNEL_SCALAR;
+                        substitute_variant = CIPHER_KERNEL_SCALAR;
+                        letter_slots_variant = CIPHER_KERNEL_SCALAR;
+                        break;
+        }
+
+        active_kernel = kernel;
+
+        return true;
+}
+
+cipher_kernel cipher_active_kernel(void) {
+        return active_kernel;
+}
+
+const char* cipher_kernel_name(cipher_kernel kernel) {
+        switch (kernel) {
+                case CIPHER_KERNEL_SCALAR:
+                        return "scalar";
+                case CIPHER_KERNEL_SSE2:
+                        return "sse2";
+                case CIPHER_KERNEL_SSSE3:
+                        return "ssse3";
+                case CIPHER_KERNEL_AVX2:
+                        return "avx2";
+                case CIPHER_KERNEL_AVX512:
+                        return "avx512";
+                default:
+                        return "unknown";
+        }
+}
+
+
+// Bytes 'out' is short of a 64-byte boundary, where non-temporal stores can start
+static inline size_t nontemporal_head(size_t len, const char out[len]) {
+        const size_t head = (size_t) (-(uintptr_t) out & 63);
+
+        return head < len ? head : len;
+}
+
+static inline void fence_nontemporal_stores(void) {
+#if CIPHER_X86
+        __builtin_ia32_sfence();
+#endif
+}
+
+static inline bool is_letter(char c) {
+        // Folding to lowercase maps both cases onto 'a' - 'z'; everything else
+        // (including negative chars) lands outside that range
+        return (unsigned) ((c | 0x20) - 'a') < 26;
+}
+
+// Index of a letter in the alphabet for either case, or 26 for anything else
+static inline unsigned letter_slot(char c) {
+        const unsigned t = (unsigned char) ((c | 0x20) - 'a');
 
-        const char base_upper = 'A';
-        const int rotation_upper = toupper(key) - base_upper;
+        return t < 26 ? t : 26;
+}
+
+// Ciphers that leave the text unchanged still have to fill 'out'
+static inline void copy_unchanged(size_t len, const char in[len], char out[len]) {
+        if (in != out) memcpy(out, in, len);
+}
 
-        const char base_lower = 'a';
-        const int rotation_lower = tolower(key) - base_lower;
+void caesar_scalar(
+    unsigned rotation, size_t len, const char in[len], char out[len], bool nontemporal) {
+        (void) nontemporal;
 
-        for (size_t c = 0; c < length; c++) {
-                // Ignore non-alphabetical characters
-                if (!isalpha(plaintext[c])) continue;
+        const unsigned char* table = rotation_tables[rotation];
+
+        for (size_t c = 0; c < len; c++)
+                out[c] = (char) table[(unsigned char) in[c]];
+}
 
-                plaintext[c] = isupper(plaintext[c])
-                                   ? rotate(base_upper, rotation_upper, plaintext[c])
-                                   : rotate(base_lower, rotation_lower, plaintext[c]);
+// Runs the Caesar kernel, switching to non-temporal stores for large outputs
+static void apply_rotation(unsigned rotation, size_t len, const char in[len], char out[len]) {
+        if (in == out || len < NONTEMPORAL_THRESHOLD) {
+                caesar_kernel(rotation, len, in, out, false);
+                return;
         }
+
+        const size_t head = nontemporal_head(len, out);
+
+        caesar_kernel(rotation, head, in, out, false);
+        caesar_kernel(rotation, len - head, in + head, out + head, true);
+        fence_nontemporal_stores();
+}
+
+static void rotate_to(unsigned rotation, size_t len, const char in[len], char out[len]) {
+        STATS_START(start);
+
+        // Invalid keys and 'A' are the identity
+        if (rotation == 0) {
+                copy_unchanged(len, in, out);
+        } else {
+                apply_rotation(rotation, len, in, out);
+                STATS_KERNEL_RAN(STATS_CAESAR_KERNEL, caesar_variant);
+        }
+
+        STATS_STOP(STATS_KERNEL, start);
+        STATS_BYTES(len, out);
+}
+
+void caesar_to(char key, size_t len, const char in[len], char out[len]) {
+        const unsigned slot = letter_slot(key);
+
+        rotate_to(slot < 26 ? slot : 0, len, in, out);
+}
+
+void decipher_caesar_to(char key, size_t len, const char in[len], char out[len]) {
+        const unsigned slot = letter_slot(key);
+
+        rotate_to(slot < 26 ? (26 - slot) % 26 : 0, len, in, out);
+}
+
+// WARNING: mutates 'plaintext'!
+void caesar(char key, size_t length, char plaintext[length]) {
+        caesar_to(key, length, plaintext, plaintext);
 }
 
 // WARNING: mutates 'ciphertext'!
 void decipher_caesar(char key, size_t length, char ciphertext[length]) {
-        if (!isalpha(key)) return;
+        decipher_caesar_to(key, length, ciphertext, ciphertext);
+}
+
+size_t count_letters_scalar(size_t len, const char text[len]) {
+        size_t letters = 0;
+
+        for (size_t c = 0; c < len; c++)
+                letters += is_letter(text[c]);
+
+        return letters;
+}
+
+size_t count_letters(size_t len, const char text[len]) {
+        return count_letters_kernel(len, text);
+}
+
+void letter_histogram_scalar(size_t len, const char text[len], size_t counts[26]) {
+        // Small enough that the 32-bit counters below can't overflow
+        const size_t max_block = (size_t) 1 << 30;
+
+        if (len > max_block) {
+                letter_histogram_scalar(max_block, text, counts);
+                letter_histogram_scalar(len - max_block, text + max_block, counts);
+                return;
+        }
+
+        // Alternating between several tables breaks the dependency between
+        // consecutive increments of the same letter. The last slot of each
+        // table collects non-letters
+        uint32_t tables[4][27] = { 0 };
+        size_t i = 0;
 
-        caesar('Z' - (char) toupper(key) + 'A' + 1, length, ciphertext);
+        for (; i + 4 <= len; i += 4)
+                for (size_t j = 0; j < 4; j++)
+                        tables[j][letter_slot(text[i + j])]++;
+
+        for (; i < len; i++)
+                tables[0][letter_slot(text[i])]++;
+
+        for (size_t letter = 0; letter < 26; letter++)
+                counts[letter] += (size_t) tables[0][letter] + tables[1][letter] +
+                                  tables[2][letter] + tables[3][letter];
+}
+
+void letter_histogram(size_t len, const char text[len], size_t counts[26]) {
+        letter_histogram_kernel(len, text, counts);
+}
+
+size_t ascii_prefix_scalar(size_t len, const char text[len]) {
+        size_t i = 0;
+
+        // A word at a time, until one has a byte with its top bit set
+        for (uint64_t word; i + 8 <= len; i += 8) {
+                memcpy(&word, text + i, 8);
+
+                if (word & UINT64_C(0x8080808080808080)) break;
+        }
+
+        while (i < len && (unsigned char) text[i] < 0x80)
+                i++;
+
+        return i;
+}
+
+// Length of the multi-byte UTF-8 sequence starting at 'text', 0 if it isn't
+// valid, or more than 'len' if it's valid as far as it goes but cut off.
+// Overlong encodings, surrogates and code points above U+10FFFF are invalid
+static size_t utf8_sequence_length(size_t len, const unsigned char text[len]) {
+        const unsigned char lead = text[0];
+        // Range of the second byte, which is narrower for some lead bytes
+        unsigned char low = 0x80;
+        unsigned char high = 0xBF;
+        size_t length = 0;
+
+        if (lead >= 0xC2 && lead <= 0xDF) {
+                length = 2;
+        } else if (lead >= 0xE0 && lead <= 0xEF) {
+                length = 3;
+                if (lead == 0xE0) low = 0xA0;
+                if (lead == 0xED) high = 0x9F;
+        } else if (lead >= 0xF0 && lead <= 0xF4) {
+                length = 4;
+                if (lead == 0xF0) low = 0x90;
+                if (lead == 0xF4) high = 0x8F;
+        } else {
+                return 0;
+        }
+
+        for (size_t i = 1; i < length; i++) {
+                if (i == len) return length;
+                if (text[i] < low || text[i] > high) return 0;
+
+                low = 0x80;
+                high = 0xBF;
+        }
+
+        return length;
+}
+
+size_t utf8_validate(size_t len, const char text[len], bool* truncated) {
+        size_t i = 0;
+
+        if (truncated != NULL) *truncated = false;
+
+        while (i < len) {
+                // Mostly ASCII text spends nearly all its time here
+                i += ascii_prefix_kernel(len - i, text + i);
+
+                // Then step over the run of multi-byte sequences that stopped it
+                while (i < len && (unsigned char) text[i] >= 0x80) {
+                        const size_t length =
+                            utf8_sequence_length(len - i, (const unsigned char*) text + i);
+
+                        if (length == 0) return i;
+
+                        if (length > len - i) {
+                                if (truncated != NULL) *truncated = true;
+
+                                return i;
+                        }
+
+                        i += length;
+                }
+        }
+
+        return len;
+}
+
+// Rotation a single key character contributes, in the range 0 - 25
+static inline unsigned char key_shift(char key, bool decipher) {
+        const unsigned rotation = letter_slot(key);
+
+        return (unsigned char) (decipher ? (26 - rotation) % 26 : rotation);
 }
 
-// Check if the key contains any alphabetic characters
-static inline bool is_valid_key(size_t key_len, const char key[key_len]) {
+// Number of alphabetic characters in the key, which is the period of the cipher
+static size_t count_key_letters(size_t key_len, const char key[key_len]) {
+        size_t letters = 0;
+
         for (size_t i = 0; i < key_len; i++)
-                if (isalpha(key[i])) return true;
+                letters += is_letter(key[i]);
 
-        return false;
+        return letters;
 }
 
-// WARNING: mutates 'plaintext'!
-void vigenere(size_t key_len, const char key[key_len], size_t len, char plaintext[len]) {
-        if (!is_valid_key(key_len, key)) return;
+// Smallest multiple of the period covering a block of letters, see 'kernels.h'
+static inline size_t schedule_span(size_t period) {
+        return (VIGENERE_SCHEDULE_PAD + period - 1) / period * period;
+}
+
+static inline size_t schedule_size(size_t period) {
+        return schedule_span(period) + VIGENERE_SCHEDULE_PAD;
+}
+
+static void build_schedule(size_t key_len,
+                           const char key[key_len],
+                           bool decipher,
+                           size_t period,
+                           unsigned char shifts[]) {
+        STATS_START(start);
+
+        size_t letters = 0;
+
+        for (size_t i = 0; i < key_len; i++)
+                if (is_letter(key[i])) shifts[letters++] = key_shift(key[i], decipher);
+
+        // Repeat the key for the rest of the schedule
+        for (size_t i = period; i < schedule_size(period); i++)
+                shifts[i] = shifts[i - period];
+
+        STATS_STOP(STATS_SCHEDULE, start);
+}
+
+size_t vigenere_scalar(size_t span,
+                       const unsigned char shifts[],
+                       size_t position,
+                       size_t len,
+                       const char in[len],
+                       char out[len],
+                       bool nontemporal) {
+        (void) nontemporal;
+
+        for (size_t c = 0; c < len; c++) {
+                const char byte = in[c];
+
+                // Non-alphabetic characters map to themselves in every table,
+                // they just don't advance the key
+                out[c] = (char) rotation_tables[shifts[position]][(unsigned char) byte];
 
+                position += is_letter(byte);
+                if (position == span) position = 0;
+        }
+
+        return position;
+}
+
+// Runs the Vigenère kernel, switching to non-temporal stores for large outputs
+static size_t apply_schedule(size_t span,
+                             const unsigned char shifts[],
+                             size_t position,
+                             size_t len,
+                             const char in[len],
+                             char out[len]) {
+        STATS_START(start);
+
+        if (in == out || len < NONTEMPORAL_THRESHOLD) {
+                position = vigenere_kernel(span, shifts, position, len, in, out, false);
+        } else {
+                const size_t head = nontemporal_head(len, out);
+
+                position = vigenere_kernel(span, shifts, position, head, in, out, false);
+                position = vigenere_kernel(
+                    span, shifts, position, len - head, in + head, out + head, true);
+                fence_nontemporal_stores();
+        }
+
+        STATS_STOP(STATS_KERNEL, start);
+        STATS_KERNEL_RAN(STATS_VIGENERE_KERNEL, vigenere_variant);
+        STATS_BYTES(len, out);
+
+        return position;
+}
+
+// Fallback for when a key schedule can't be allocated; walks the key for every letter
+static void vigenere_unscheduled(size_t key_len,
+                                 const char key[key_len],
+                                 bool decipher,
+                                 size_t len,
+                                 const char in[len],
+                                 char out[len]) {
         size_t key_index = 0;
 
         for (size_t c = 0; c < len; c++) {
-                if (!isalpha(plaintext[c])) continue;
+                out[c] = in[c];
+
+                if (!is_letter(in[c])) continue;
 
-                while (!isalpha(key[key_index]))
+                while (!is_letter(key[key_index]))
                         key_index = (key_index + 1) % key_len;
 
-                // mutates 'plaintext'!
-                caesar(key[key_index], 1, plaintext + c);
+                const unsigned char shift = key_shift(key[key_index], decipher);
+                out[c] = (char) rotation_tables[shift][(unsigned char) in[c]];
 
                 key_index = (key_index + 1) % key_len;
         }
 }
 
+static void run_vigenere(size_t key_len,
+                         const char key[key_len],
+                         bool decipher,
+                         size_t len,
+                         const char in[len],
+                         char out[len]) {
+        const size_t period = count_key_letters(key_len, key);
+
+        if (period == 0) {
+                copy_unchanged(len, in, out);
+                return;
+        }
+
+        const size_t size = schedule_size(period);
+
+        unsigned char stack_shifts[STACK_SCHEDULE_SIZE + VIGENERE_SCHEDULE_PAD];
+        unsigned char* shifts = size <= sizeof(stack_shifts) ? stack_shifts : malloc(size);
+
+        if (shifts == NULL) {
+                vigenere_unscheduled(key_len, key, decipher, len, in, out);
+                return;
+        }
+
+        build_schedule(key_len, key, decipher, period, shifts);
+        apply_schedule(schedule_span(period), shifts, 0, len, in, out);
+
+        if (shifts != stack_shifts) free(shifts);
+}
+
+// WARNING: mutates 'plaintext'!
+void vigenere(size_t key_len, const char key[key_len], size_t len, char plaintext[len]) {
+        run_vigenere(key_len, key, false, len, plaintext, plaintext);
+}
+
 // WARNING: mutates 'ciphertext'!
 void decipher_vigenere(size_t key_len, const char key[key_len], size_t len, char ciphertext[len]) {
-        if (!is_valid_key(key_len, key)) return;
+        run_vigenere(key_len, key, true, len, ciphertext, ciphertext);
+}
 
-        size_t key_index = 0;
+void vigenere_to(
+    size_t key_len, const char key[key_len], size_t len, const char in[len], char out[len]) {
+        run_vigenere(key_len, key, false, len, in, out);
+}
+
+void decipher_vigenere_to(
+    size_t key_len, const char key[key_len], size_t len, const char in[len], char out[len]) {
+        run_vigenere(key_len, key, true, len, in, out);
+}
+
+
+bool vigenere_ctx_init(vigenere_ctx* ctx, size_t key_len, const char key[key_len], bool decipher) {
+        *ctx = (vigenere_ctx) { 0 };
+
+        const size_t size = vigenere_schedule_size(key_len, key);
+
+        if (size == 0) return false;
+
+        unsigned char* shifts = malloc(size);
+
+        if (shifts == NULL) return false;
+
+        return vigenere_ctx_init_in(ctx, key_len, key, decipher, shifts);
+}
+
+size_t vigenere_schedule_size(size_t key_len, const char key[key_len]) {
+        const size_t period = count_key_letters(key_len, key);
+
+        return period > 0 ? schedule_size(period) : 0;
+}
+
+bool vigenere_ctx_init_in(vigenere_ctx* ctx,
+                          size_t key_len,
+                          const char key[key_len],
+                          bool decipher,
+                          unsigned char shifts[]) {
+        *ctx = (vigenere_ctx) { 0 };
+
+        const size_t period = count_key_letters(key_len, key);
+
+        if (period == 0) return false;
+
+        build_schedule(key_len, key, decipher, period, shifts);
+
+        *ctx = (vigenere_ctx) {
+                .shifts = shifts,
+                .period = period,
+                .span = schedule_span(period),
+                .position = 0,
+        };
+
+        return true;
+}
 
+// WARNING: mutates 'text'!
+void vigenere_ctx_update(vigenere_ctx* ctx, size_t len, char text[len]) {
+        vigenere_ctx_update_to(ctx, len, text, text);
+}
+
+void vigenere_ctx_update_to(vigenere_ctx* ctx, size_t len, const char in[len], char out[len]) {
+        // An invalid key leaves the text unchanged, like 'vigenere()'
+        if (ctx->period == 0) {
+                copy_unchanged(len, in, out);
+                return;
+        }
+
+        ctx->position = apply_schedule(ctx->span, ctx->shifts, ctx->position, len, in, out);
+}
+
+void vigenere_ctx_reset(vigenere_ctx* ctx) {
+        ctx->position = 0;
+}
+
+void vigenere_ctx_skip(vigenere_ctx* ctx, size_t letters) {
+        if (ctx->period == 0) return;
+
+        // Any position equivalent modulo the period is valid, as 'span' is a multiple of it
+        ctx->position = (ctx->position + letters % ctx->period) % ctx->period;
+}
+
+void vigenere_ctx_free(vigenere_ctx* ctx) {
+        free(ctx->shifts);
+        *ctx = (vigenere_ctx) { 0 };
+}
+
+
+void substitute_scalar(const unsigned char substitution[26],
+                       size_t len,
+                       const char in[len],
+                       char out[len]) {
+        unsigned char table[256];
+
+        for (unsigned c = 0; c < 256; c++)
+                table[c] = (unsigned char) c;
+
+        for (unsigned letter = 0; letter < 26; letter++) {
+                table['A' + letter] = (unsigned char) ('A' + substitution[letter]);
+                table['a' + letter] = (unsigned char) ('a' + substitution[letter]);
+        }
+
+        for (size_t c = 0; c < len; c++)
+                out[c] = (char) table[(unsigned char) in[c]];
+}
+
+size_t letter_slots_scalar(size_t len, const char text[len], unsigned char slots[]) {
+        size_t letters = 0;
+
+        // Every byte writes its slot, but only letters keep theirs
         for (size_t c = 0; c < len; c++) {
-                if (!isalpha(ciphertext[c])) continue;
+                const unsigned char slot = (unsigned char) ((text[c] | 0x20) - 'a');
 
-                while (!isalpha(key[key_index]))
-                        key_index = (key_index + 1) % key_len;
+                slots[letters] = slot;
+                letters += slot < 26;
+        }
 
-                // mutates 'ciphertext'!
-                decipher_caesar(key[key_index], 1, ciphertext + c);
+        return letters;
+}
 
-                key_index = (key_index + 1) % key_len;
+size_t letter_slots(size_t len, const char text[len], unsigned char slots[]) {
+        return letter_slots_kernel(len, text, slots);
+}
+
+void crib_scan_scalar(size_t count,
+                      const unsigned char letters[],
+                      size_t crib_len,
+                      const unsigned char crib[],
+                      size_t max_period,
+                      crib_match_fn match,
+                      void* arg) {
+        for (size_t offset = 0; offset < count; offset++) {
+                unsigned char key[CRIB_MAX_LETTERS];
+
+                for (size_t i = 0; i < crib_len; i++) {
+                        const unsigned shift = letters[offset + i] + 26u - crib[i];
+
+                        key[i] = (unsigned char) (shift >= 26 ? shift - 26 : shift);
+                }
+
+                // Only periods under which the first letter repeats
+                uint64_t periods = 0;
+
+                for (size_t period = 1; period <= max_period; period++)
+                        periods |= (uint64_t) (key[period] == key[0]) << period;
+
+                const size_t period = key_period(crib_len, key, periods);
+
+                if (period > 0) match(offset, period, arg);
         }
 }
+
+void crib_scan(size_t count,
+               const unsigned char letters[],
+               size_t crib_len,
+               const unsigned char crib[],
+               size_t max_period,
+               crib_match_fn match,
+               void* arg) {
+        crib_scan_kernel(count, letters, crib_len, crib, max_period, match, arg);
+}
+
+// Runs the substitution kernel. The bytes are counted by whichever step comes
+// last, so they aren't counted twice
+static void substitute_to(const unsigned char substitution[26],
+                          size_t len,
+                          const char in[len],
+                          char out[len]) {
+        STATS_START(start);
+        substitute_kernel(substitution, len, in, out);
+        STATS_STOP(STATS_KERNEL, start);
+        STATS_KERNEL_RAN(STATS_SUBSTITUTE_KERNEL, substitute_variant);
+}
+
+// Returns 0 if 'multiplier' has no inverse modulo 26
+static unsigned inverse_mod_26(unsigned multiplier) {
+        for (unsigned inverse = 1; inverse < 26; inverse++)
+                if (multiplier * inverse % 26 == 1) return inverse;
+
+        return 0;
+}
+
+bool poly_ctx_init(poly_ctx* ctx, const poly_params* params) {
+        *ctx = (poly_ctx) {
+                .cipher = params->cipher,
+                .decipher = params->decipher,
+        };
+
+        unsigned multiplier = 1;
+        unsigned increment = 0;
+
+        if (params->cipher == POLY_AFFINE) {
+                multiplier = params->multiplier % 26;
+                increment = params->increment % 26;
+        } else if (params->cipher == POLY_BEAUFORT) {
+                // Negating the letter turns 'key - letter' into a shift by the key
+                multiplier = 25;
+        }
+
+        if (inverse_mod_26(multiplier) == 0) return false;
+
+        ctx->substitute = multiplier != 1 || increment != 0;
+
+        // Deciphering uses the inverse substitution, indexed by the enciphered letter
+        for (unsigned letter = 0; letter < 26; letter++) {
+                const unsigned substituted = (multiplier * letter + increment) % 26;
+
+                if (params->decipher)
+                        ctx->substitution[substituted] = (unsigned char) letter;
+                else
+                        ctx->substitution[letter] = (unsigned char) substituted;
+        }
+
+        if (params->cipher == POLY_AFFINE) return true;
+
+        // Caesar only has the one key letter. Autokey needs the key's own
+        // rotations, as its schedule is built a chunk at a time
+        const size_t key_len =
+            params->cipher == POLY_CAESAR && params->key_len > 1 ? 1 : params->key_len;
+        const bool negate = params->cipher != POLY_AUTOKEY &&
+                            params->decipher != (params->cipher == POLY_VARIANT_BEAUFORT);
+
+        if (!vigenere_ctx_init(&ctx->schedule, key_len, params->key, negate)) {
+                *ctx = (poly_ctx) { .cipher = params->cipher };
+                return false;
+        }
+
+        if (params->cipher == POLY_AUTOKEY) {
+                ctx->pending = malloc(ctx->schedule.period);
+
+                if (ctx->pending == NULL) {
+                        poly_ctx_free(ctx);
+                        return false;
+                }
+
+                memcpy(ctx->pending, ctx->schedule.shifts, ctx->schedule.period);
+        }
+
+        return true;
+}
+
+// Works through the text a letter at a time, as deciphering has to: each
+// plaintext letter is part of the key a period later
+static void autokey_scalar(poly_ctx* ctx, size_t len, const char in[len], char out[len]) {
+        const size_t period = ctx->schedule.period;
+        size_t next = ctx->next;
+
+        for (size_t c = 0; c < len; c++) {
+                const char byte = in[c];
+
+                if (!is_letter(byte)) {
+                        out[c] = byte;
+                        continue;
+                }
+
+                const unsigned shift = ctx->pending[next];
+                const unsigned rotation = ctx->decipher ? (26 - shift) % 26 : shift;
+
+                out[c] = (char) rotation_tables[rotation][(unsigned char) byte];
+                ctx->pending[next] = (unsigned char) letter_slot(ctx->decipher ? out[c] : byte);
+                next = next + 1 == period ? 0 : next + 1;
+        }
+
+        ctx->next = next;
+}
+
+// Enciphering, the plaintext is all known up front, so the chunk's whole
+// schedule is laid out (the pending rotations, then its own letters) and run
+// through the Vigenère kernel
+static void autokey_update_to(poly_ctx* ctx, size_t len, const char in[len], char out[len]) {
+        const size_t period = ctx->schedule.period;
+
+        if (period == 0) {
+                copy_unchanged(len, in, out);
+                return;
+        }
+
+        // Room for every byte to be a letter, as they're only counted as they're laid out
+        const size_t size = period + len + VIGENERE_SCHEDULE_PAD;
+
+        if (!ctx->decipher && size > ctx->scratch_size) {
+                unsigned char* grown = realloc(ctx->scratch, size);
+
+                if (grown != NULL) {
+                        ctx->scratch = grown;
+                        ctx->scratch_size = size;
+                }
+        }
+
+        if (ctx->decipher || size > ctx->scratch_size) {
+                autokey_scalar(ctx, len, in, out);
+                return;
+        }
+
+        unsigned char* shifts = ctx->scratch;
+        const size_t wrapped = period - ctx->next;
+
+        memcpy(shifts, ctx->pending + ctx->next, wrapped);
+        memcpy(shifts + wrapped, ctx->pending, ctx->next);
+
+        const size_t letters = letter_slots_kernel(len, in, shifts + period);
+
+        STATS_KERNEL_RAN(STATS_LETTER_SLOTS_KERNEL, letter_slots_variant);
+
+        // Only read for the non-letters of the last block, but never left undefined
+        memset(shifts + period + letters, 0, VIGENERE_SCHEDULE_PAD);
+
+        apply_schedule(period + letters, shifts, 0, len, in, out);
+
+        // The last 'period' letters start the next chunk's schedule
+        memcpy(ctx->pending, shifts + letters, period);
+        ctx->next = 0;
+}
+
+// WARNING: mutates 'text'!
+void poly_ctx_update(poly_ctx* ctx, size_t len, char text[len]) {
+        poly_ctx_update_to(ctx, len, text, text);
+}
+
+void poly_ctx_update_to(poly_ctx* ctx, size_t len, const char in[len], char out[len]) {
+        if (ctx->cipher == POLY_AUTOKEY) {
+                autokey_update_to(ctx, len, in, out);
+                return;
+        }
+
+        const char* from = in;
+
+        if (ctx->substitute && !ctx->decipher) {
+                substitute_to(ctx->substitution, len, from, out);
+                from = out;
+        }
+
+        // A single rotation is a Caesar cipher, which has the faster kernel
+        if (ctx->schedule.period == 1) {
+                rotate_to(ctx->schedule.shifts[0], len, from, out);
+        } else if (ctx->schedule.period > 1) {
+                vigenere_ctx_update_to(&ctx->schedule, len, from, out);
+        } else {
+                copy_unchanged(len, from, out);
+                STATS_BYTES(len, out);
+        }
+
+        if (ctx->substitute && ctx->decipher) substitute_to(ctx->substitution, len, out, out);
+}
+
+void poly_ctx_free(poly_ctx* ctx) {
+        vigenere_ctx_free(&ctx->schedule);
+        free(ctx->pending);
+        free(ctx->scratch);
+        *ctx = (poly_ctx) { 0 };
+}
@@ -0,0 +1,1213 @@
+#include "cryptanalysis.h"
+#include "cipher.h"
+#include "english_sample.h"
+#include "parallel.h"
+#include "thread_pool.h"
+#include <math.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+// Ciphertext is sampled in blocks of this many bytes
+#define SAMPLE_BLOCK_SIZE 0x4000
+// Fewer letters than this can't tell the keys apart, however they score
+#define MIN_DECISIVE_LETTERS 64
+// Odds (as a natural log) by which the best key must beat every other one
+// before sampling stops; ln(10^9)
+#define DECISIVE_LOG_ODDS 20.7
+
+// Chunks of Vigenère ciphertext smaller than this aren't worth handing to another thread
+#define MIN_CRACK_CHUNK_SIZE 0x10000
+// Key lengths that leave fewer letters than this in each column are too noisy to judge
+#define MIN_COLUMN_LETTERS 16
+// Index of coincidence of uniformly random letters, 1/26
+#define RANDOM_COINCIDENCE (1.0 / 26)
+// The shortest key length within this fraction of the best index of coincidence
+// (measured from random) is picked, as multiples of the key length score as
+// well as the key length itself
+#define KEY_LENGTH_TOLERANCE 0.1
+
+const double english_letter_frequencies[26] = {
+        0.08167, 0.01492, 0.02782, 0.04253, 0.12702, 0.02228, 0.02015, 0.06094, 0.06966,
+        0.00153, 0.00772, 0.04025, 0.02406, 0.06749, 0.07507, 0.01929, 0.00095, 0.05987,
+        0.06327, 0.09056, 0.02758, 0.00978, 0.02360, 0.00150, 0.01974, 0.00074,
+};
+
+
+static double chi_squared(const size_t counts[26], size_t letters, unsigned rotation) {
+        double total = 0;
+
+        for (unsigned plain = 0; plain < 26; plain++) {
+                const double expected = (double) letters * english_letter_frequencies[plain];
+                const double difference = (double) counts[(plain + rotation) % 26] - expected;
+
+                total += difference * difference / expected;
+        }
+
+        return total;
+}
+
+// Log-likelihood of the ciphertext's letters having come from English text
+// enciphered with 'rotation'
+static double log_likelihood(const size_t counts[26],
+                             const double log_frequencies[26],
+                             unsigned rotation) {
+        double total = 0;
+
+        for (unsigned plain = 0; plain < 26; plain++)
+                total += (double) counts[(plain + rotation) % 26] * log_frequencies[plain];
+
+        return total;
+}
+
+static int compare_candidates(const void* a, const void* b) {
+        const caesar_candidate* x = a;
+        const caesar_candidate* y = b;
+
+        if (x->chi_squared != y->chi_squared) return x->chi_squared < y->chi_squared ? -1 : 1;
+
+        return x->key - y->key;
+}
+
+bool rank_caesar_keys(const size_t counts[26], caesar_candidate ranked[26]) {
+        size_t letters = 0;
+
+        for (size_t letter = 0; letter < 26; letter++)
+                letters += counts[letter];
+
+        for (unsigned rotation = 0; rotation < 26; rotation++)
+                ranked[rotation] = (caesar_candidate) {
+                        .key = (char) ('A' + rotation),
+                        .chi_squared = letters > 0 ? chi_squared(counts, letters, rotation) : 0,
+                };
+
+        qsort(ranked, 26, sizeof(ranked[0]), compare_candidates);
+
+        if (letters < MIN_DECISIVE_LETTERS) return false;
+
+        double log_frequencies[26];
+
+        for (size_t letter = 0; letter < 26; letter++)
+                log_frequencies[letter] = log(english_letter_frequencies[letter]);
+
+        // A sequential probability ratio test: the best key is clear once the
+        // counts are overwhelmingly more likely under it than under any other
+        const double best =
+            log_likelihood(counts, log_frequencies, (unsigned) (ranked[0].key - 'A'));
+
+        for (size_t i = 1; i < 26; i++) {
+                const unsigned rotation = (unsigned) (ranked[i].key - 'A');
+
+                if (best - log_likelihood(counts, log_frequencies, rotation) < DECISIVE_LOG_ODDS)
+                        return false;
+        }
+
+        return true;
+}
+
+// Reverses the lowest 'bits' bits of 'index'
+static inline size_t reverse_bits(size_t index, unsigned bits) {
+        size_t reversed = 0;
+
+        for (unsigned bit = 0; bit < bits; bit++, index >>= 1)
+                reversed = reversed << 1 | (index & 1);
+
+        return reversed;
+}
+
+size_t crack_caesar(size_t len, const char text[len], caesar_candidate ranked[26]) {
+        const size_t blocks = (len + SAMPLE_BLOCK_SIZE - 1) / SAMPLE_BLOCK_SIZE;
+        unsigned bits = 0;
+
+        while (((size_t) 1 << bits) < blocks)
+                bits++;
+
+        size_t counts[26] = { 0 };
+        size_t sampled = 0;
+
+        // Visiting the blocks in bit-reversed order spreads the sample evenly
+        // over the text (start, middle, quarters, ...) at every point, so a
+        // header or an unusual section can't dominate it
+        for (size_t index = 0; index < (size_t) 1 << bits; index++) {
+                const size_t block = reverse_bits(index, bits);
+
+                if (block >= blocks) continue;
+
+                const size_t start = block * SAMPLE_BLOCK_SIZE;
+                const size_t block_len =
+                    len - start < SAMPLE_BLOCK_SIZE ? len - start : SAMPLE_BLOCK_SIZE;
+
+                letter_histogram(block_len, text + start, counts);
+                sampled += block_len;
+
+                if (rank_caesar_keys(counts, ranked)) return sampled;
+        }
+
+        // The whole text was needed (or it was empty)
+        rank_caesar_keys(counts, ranked);
+
+        return sampled;
+}
+
+
+/*
+  Every key length up to the maximum divides some length in the upper half of
+  the range, (max / 2, max]. A column histogram for a length can be folded down
+  into the columns of any of its divisors, so only the upper half ("strides")
+  are counted, in a single pass over the text that updates all of them at
+  once. Their counters take a few hundred KiB, so they stay in L2.
+*/
+
+typedef struct StrideJob {
+        const char* text;
+        size_t len;
+        size_t chunk_size;
+        size_t chunk_count;
+        size_t min_stride;
+        size_t max_stride;
+        size_t table_size; // Counters for all strides, for one chunk
+        // See letters_before_chunks
+        size_t* letters;
+        // One table per chunk: for each stride, 'stride' columns of 26 counters
+        uint32_t* tables;
+} StrideJob;
+
+
+static inline size_t stride_offset(const StrideJob* job, size_t stride) {
+        // Sum of 26 * s for s in [min_stride, stride)
+        return 13 * (stride - job->min_stride) * (stride + job->min_stride - 1);
+}
+
+static inline size_t crack_chunk_len(const StrideJob* job, size_t index) {
+        const size_t remaining = job->len - index * job->chunk_size;
+
+        return remaining < job->chunk_size ? remaining : job->chunk_size;
+}
+
+static void count_chunk_letters_task(size_t index, void* arg) {
+        StrideJob* job = arg;
+
+        job->letters[index] =
+            count_letters(crack_chunk_len(job, index), job->text + index * job->chunk_size);
+}
+
+static void stride_histogram_task(size_t index, void* arg) {
+        const StrideJob* job = arg;
+        const size_t strides = job->max_stride - job->min_stride + 1;
+        const size_t len = crack_chunk_len(job, index);
+        const char* text = job->text + index * job->chunk_size;
+        uint32_t* table = job->tables + index * job->table_size;
+
+        // Each stride's counters for the column the next letter falls in, and
+        // the counters to wrap back to after its last column
+        uint32_t* column[strides];
+        uint32_t* first[strides];
+        uint32_t* end[strides];
+
+        for (size_t s = 0; s < strides; s++) {
+                const size_t stride = job->min_stride + s;
+
+                first[s] = table + stride_offset(job, stride);
+                end[s] = first[s] + 26 * stride;
+                column[s] = first[s] + 26 * (job->letters[index] % stride);
+        }
+
+        for (size_t i = 0; i < len; i++) {
+                const unsigned letter = (unsigned char) ((text[i] | 0x20) - 'a');
+
+                if (letter >= 26) continue;
+
+                for (size_t s = 0; s < strides; s++) {
+                        column[s][letter]++;
+                        column[s] += 26;
+
+                        if (column[s] == end[s]) column[s] = first[s];
+                }
+        }
+}
+
+static void sum_stride_tables(const StrideJob* job, size_t totals[]) {
+        memset(totals, 0, job->table_size * sizeof(totals[0]));
+
+        for (size_t chunk = 0; chunk < job->chunk_count; chunk++)
+                for (size_t i = 0; i < job->table_size; i++)
+                        totals[i] += job->tables[chunk * job->table_size + i];
+}
+
+// Folds the histogram of a multiple of 'key_len' down into column 'column' of 'key_len'
+static void column_histogram(const StrideJob* job,
+                             const size_t totals[],
+                             size_t key_len,
+                             size_t column,
+                             size_t counts[26]) {
+        const size_t stride = key_len * (job->max_stride / key_len);
+        const size_t* table = totals + stride_offset(job, stride);
+
+        memset(counts, 0, 26 * sizeof(counts[0]));
+
+        for (size_t c = column; c < stride; c += key_len)
+                for (size_t letter = 0; letter < 26; letter++)
+                        counts[letter] += table[26 * c + letter];
+}
+
+static double mean_coincidence(const StrideJob* job, const size_t totals[], size_t key_len) {
+        double total = 0;
+
+        for (size_t column = 0; column < key_len; column++) {
+                size_t counts[26];
+                size_t letters = 0;
+                double pairs = 0;
+
+                column_histogram(job, totals, key_len, column, counts);
+
+                for (size_t letter = 0; letter < 26; letter++) {
+                        const double count = (double) counts[letter];
+
+                        letters += counts[letter];
+                        pairs += count * (count - 1);
+                }
+
+                if (letters > 1) total += pairs / ((double) letters * (double) (letters - 1));
+        }
+
+        return total / (double) key_len;
+}
+
+// The shortest key length not yet 'ranked' (NULL when none are) whose index of
+// coincidence is within KEY_LENGTH_TOLERANCE of the best of them, or 0 if all are
+static size_t shortest_near_best(size_t max_key_len,
+                                 const double coincidence[max_key_len],
+                                 const bool* ranked) {
+        double best = 0;
+        size_t remaining = 0;
+
+        for (size_t i = 0; i < max_key_len; i++) {
+                if (ranked != NULL && ranked[i]) continue;
+                if (coincidence[i] > best) best = coincidence[i];
+
+                remaining++;
+        }
+
+        if (remaining == 0) return 0;
+
+        const double threshold = best - KEY_LENGTH_TOLERANCE * fmax(best - RANDOM_COINCIDENCE, 0);
+
+        for (size_t i = 0; i < max_key_len; i++)
+                if ((ranked == NULL || !ranked[i]) && coincidence[i] >= threshold) return i + 1;
+
+        return 0;
+}
+
+size_t rank_key_lengths(size_t max_key_len,
+                        const double coincidence[max_key_len],
+                        size_t ranked[max_key_len]) {
+        bool taken[max_key_len];
+        size_t count = 0;
+        size_t key_len;
+
+        memset(taken, 0, sizeof(taken));
+
+        while ((key_len = shortest_near_best(max_key_len, coincidence, taken)) != 0) {
+                taken[key_len - 1] = true;
+
+                if (coincidence[key_len - 1] > 0) ranked[count++] = key_len;
+        }
+
+        return count;
+}
+
+size_t crack_vigenere(size_t len,
+                      const char text[len],
+                      size_t max_key_len,
+                      char key[max_key_len],
+                      double coincidence[max_key_len],
+                      size_t nthreads) {
+        for (size_t length = 1; length <= max_key_len; length++)
+                coincidence[length - 1] = 0;
+
+        if (len > VIGENERE_CRACK_SAMPLE_SIZE) len = VIGENERE_CRACK_SAMPLE_SIZE;
+        if (nthreads == 0) nthreads = available_cpus();
+
+        const size_t letters = count_letters(len, text);
+
+        // Longer keys leave too few letters in each column
+        if (max_key_len > letters / MIN_COLUMN_LETTERS) max_key_len = letters / MIN_COLUMN_LETTERS;
+        if (max_key_len == 0) return 0;
+
+        size_t chunk_count = len / MIN_CRACK_CHUNK_SIZE;
+
+        if (chunk_count > nthreads) chunk_count = nthreads;
+        if (chunk_count == 0) chunk_count = 1;
+
+        StrideJob job = {
+                .text = text,
+                .len = len,
+                .chunk_size = (len + chunk_count - 1) / chunk_count,
+                .chunk_count = chunk_count,
+                .min_stride = max_key_len / 2 + 1,
+                .max_stride = max_key_len,
+        };
+
+        job.table_size = stride_offset(&job, job.max_stride + 1);
+        job.letters = malloc(chunk_count * sizeof(size_t));
+        job.tables = calloc(chunk_count * job.table_size, sizeof(uint32_t));
+
+        size_t* totals = malloc(job.table_size * sizeof(size_t));
+
+        if (job.letters == NULL || job.tables == NULL || totals == NULL) {
+                free(job.letters);
+                free(job.tables);
+                free(totals);
+
+                return 0;
+        }
+
+        // Non-letters don't advance the key, so each chunk's first column is
+        // set by the number of letters in the chunks before it
+        parallel_for(nthreads, chunk_count, count_chunk_letters_task, &job);
+        letters_before_chunks(chunk_count, job.letters);
+
+        parallel_for(nthreads, chunk_count, stride_histogram_task, &job);
+        sum_stride_tables(&job, totals);
+
+        for (size_t length = 1; length <= max_key_len; length++)
+                coincidence[length - 1] = mean_coincidence(&job, totals, length);
+
+        const size_t key_len = shortest_near_best(max_key_len, coincidence, NULL);
+
+        for (size_t column = 0; column < key_len; column++) {
+                size_t counts[26];
+                caesar_candidate ranked[26];
+
+                column_histogram(&job, totals, key_len, column, counts);
+                rank_caesar_keys(counts, ranked);
+                key[column] = ranked[0].key;
+        }
+
+        free(job.letters);
+        free(job.tables);
+        free(totals);
+
+        return key_len;
+}
+
+
+/*
+  Cribs are slid over the ciphertext a chunk at a time, each reduced to its
+  letters (0 - 25) along with the letters the crib overhangs into the chunks
+  after it, so memory use doesn't grow with the text. A first pass counts the
+  letters in each chunk, so every match can be turned into the key as it's
+  used from the start of the text, and matches of the same key merged.
+*/
+
+// Chunks of ciphertext handed to each thread in turn
+#define CRIB_CHUNK_SIZE 0x100000
+// Bytes reduced to letters, or counted past, at a time when only some are needed
+#define CRIB_BLOCK_SIZE 0x100
+
+typedef struct CribList {
+        crib_candidate* candidates;
+        size_t count;
+        size_t capacity;
+        bool failed; // Out of memory
+} CribList;
+
+typedef struct CribJob {
+        const char* text;
+        size_t len;
+        const unsigned char* crib;
+        size_t crib_len;
+        size_t max_period;
+        // See letters_before_chunks
+        size_t* letters;
+        // Keys found in each chunk
+        CribList* found;
+} CribJob;
+
+// The matches in one chunk
+typedef struct CribScan {
+        const CribJob* job;
+        const char* text;
+        size_t start;
+        size_t len;
+        const unsigned char* letters;
+        size_t letters_before;
+        // Letters before 'cursor', which only moves forward as matches come in order
+        size_t cursor;
+        size_t cursor_letters;
+        CribList* found;
+} CribScan;
+
+
+static inline size_t crib_chunk_len(const CribJob* job, size_t index) {
+        const size_t remaining = job->len - index * CRIB_CHUNK_SIZE;
+
+        return remaining < CRIB_CHUNK_SIZE ? remaining : CRIB_CHUNK_SIZE;
+}
+
+static void count_crib_chunk_task(size_t index, void* arg) {
+        const CribJob* job = arg;
+
+        job->letters[index] =
+            count_letters(crib_chunk_len(job, index), job->text + index * CRIB_CHUNK_SIZE);
+}
+
+static void add_crib_match(size_t offset, size_t period, void* arg) {
+        CribScan* scan = arg;
+        const unsigned char* crib = scan->job->crib;
+        const size_t position = scan->letters_before + offset;
+        crib_candidate candidate = {
+                .key_len = period,
+                .matches = 1,
+        };
+
+        for (size_t i = 0; i < period; i++) {
+                const unsigned shift = scan->letters[offset + i] + 26u - crib[i];
+
+                candidate.key[(position + i) % period] = (char) ('A' + shift % 26);
+        }
+
+        // Matches can be far apart, so whole blocks are skipped using the counting kernel
+        while (scan->cursor + CRIB_BLOCK_SIZE <= scan->len) {
+                const size_t letters = count_letters(CRIB_BLOCK_SIZE, scan->text + scan->cursor);
+
+                if (scan->cursor_letters + letters > offset) break;
+
+                scan->cursor += CRIB_BLOCK_SIZE;
+                scan->cursor_letters += letters;
+        }
+
+        while (scan->cursor_letters < offset ||
+               (unsigned char) ((scan->text[scan->cursor] | 0x20) - 'a') >= 26) {
+                scan->cursor_letters +=
+                    (unsigned char) ((scan->text[scan->cursor] | 0x20) - 'a') < 26;
+                scan->cursor++;
+        }
+
+        candidate.offset = scan->start + scan->cursor;
+
+        CribList* found = scan->found;
+
+        for (size_t i = 0; i < found->count; i++) {
+                crib_candidate* known = &found->candidates[i];
+
+                if (known->key_len == period && memcmp(known->key, candidate.key, period) == 0) {
+                        known->matches++;
+                        return;
+                }
+        }
+
+        if (found->count == found->capacity) {
+                const size_t capacity = found->capacity > 0 ? 2 * found->capacity : 16;
+                crib_candidate* grown =
+                    realloc(found->candidates, capacity * sizeof(crib_candidate));
+
+                if (grown == NULL) {
+                        found->failed = true;
+                        return;
+                }
+
+                found->candidates = grown;
+                found->capacity = capacity;
+        }
+
+        found->candidates[found->count++] = candidate;
+}
+
+static void crib_scan_task(size_t index, void* arg) {
+        const CribJob* job = arg;
+        const size_t start = index * CRIB_CHUNK_SIZE;
+        const size_t len = crib_chunk_len(job, index);
+        const size_t overhang = job->crib_len - 1;
+        unsigned char* letters =
+            malloc(len + overhang + CRIB_BLOCK_SIZE + LETTER_SLOTS_PAD + CRIB_MAX_LETTERS);
+
+        if (letters == NULL) {
+                job->found[index].failed = true;
+                return;
+        }
+
+        const size_t chunk_letters = letter_slots(len, job->text + start, letters);
+        size_t available = chunk_letters;
+
+        for (size_t next = start + len; available < chunk_letters + overhang && next < job->len;
+             next += CRIB_BLOCK_SIZE) {
+                const size_t step =
+                    job->len - next < CRIB_BLOCK_SIZE ? job->len - next : CRIB_BLOCK_SIZE;
+
+                available += letter_slots(step, job->text + next, letters + available);
+        }
+
+        // Read past the last letter by the vector kernels, but never used
+        memset(letters + available, 0, CRIB_MAX_LETTERS);
+
+        // Offsets starting in this chunk, with the whole crib over letters
+        size_t count = available >= job->crib_len ? available - job->crib_len + 1 : 0;
+
+        if (count > chunk_letters) count = chunk_letters;
+
+        CribScan scan = {
+                .job = job,
+                .text = job->text + start,
+                .start = start,
+                .len = len,
+                .letters = letters,
+                .letters_before = job->letters[index],
+                .found = &job->found[index],
+        };
+
+        crib_scan(count, letters, job->crib_len, job->crib, job->max_period, add_crib_match, &scan);
+        free(letters);
+}
+
+static int compare_crib_keys(const void* a, const void* b) {
+        const crib_candidate* x = a;
+        const crib_candidate* y = b;
+
+        if (x->key_len != y->key_len) return x->key_len < y->key_len ? -1 : 1;
+
+        return memcmp(x->key, y->key, x->key_len);
+}
+
+// Most matches first, then the earliest
+static int compare_crib_matches(const void* a, const void* b) {
+        const crib_candidate* x = a;
+        const crib_candidate* y = b;
+
+        if (x->matches != y->matches) return x->matches > y->matches ? -1 : 1;
+
+        return (x->offset > y->offset) - (x->offset < y->offset);
+}
+
+// Merges the keys found in every chunk into 'all', returning how many there are
+static size_t merge_crib_lists(size_t chunk_count, const CribList found[], crib_candidate all[]) {
+        size_t total = 0;
+
+        for (size_t chunk = 0; chunk < chunk_count; chunk++) {
+                if (found[chunk].count == 0) continue;
+
+                memcpy(all + total, found[chunk].candidates,
+                       found[chunk].count * sizeof(crib_candidate));
+                total += found[chunk].count;
+        }
+
+        qsort(all, total, sizeof(crib_candidate), compare_crib_keys);
+
+        size_t distinct = 0;
+
+        for (size_t i = 0; i < total; i++) {
+                if (distinct > 0 && compare_crib_keys(&all[distinct - 1], &all[i]) == 0) {
+                        crib_candidate* merged = &all[distinct - 1];
+
+                        merged->matches += all[i].matches;
+
+                        if (all[i].offset < merged->offset) merged->offset = all[i].offset;
+                } else {
+                        all[distinct++] = all[i];
+                }
+        }
+
+        qsort(all, distinct, sizeof(crib_candidate), compare_crib_matches);
+
+        return distinct;
+}
+
+size_t crack_vigenere_crib(size_t len,
+                           const char text[len],
+                           size_t crib_len,
+                           const char crib[crib_len],
+                           size_t capacity,
+                           crib_candidate candidates[capacity],
+                           size_t nthreads) {
+        unsigned char crib_letters[CRIB_MAX_LETTERS];
+        size_t crib_letter_count = 0;
+
+        for (size_t i = 0; i < crib_len && crib_letter_count < CRIB_MAX_LETTERS; i++) {
+                const unsigned letter = (unsigned char) ((crib[i] | 0x20) - 'a');
+
+                if (letter < 26) crib_letters[crib_letter_count++] = (unsigned char) letter;
+        }
+
+        const size_t chunk_count = (len + CRIB_CHUNK_SIZE - 1) / CRIB_CHUNK_SIZE;
+
+        if (crib_letter_count <= CRIB_MIN_REPEATS || chunk_count == 0) return 0;
+        if (nthreads == 0) nthreads = available_cpus();
+
+        CribJob job = {
+                .text = text,
+                .len = len,
+                .crib = crib_letters,
+                .crib_len = crib_letter_count,
+                .max_period = crib_letter_count - CRIB_MIN_REPEATS,
+                .letters = malloc(chunk_count * sizeof(size_t)),
+                .found = calloc(chunk_count, sizeof(CribList)),
+        };
+
+        if (job.letters == NULL || job.found == NULL) {
+                free(job.letters);
+                free(job.found);
+
+                return 0;
+        }
+
+        // Each chunk's key position is set by the letters in the chunks before it
+        parallel_for(nthreads, chunk_count, count_crib_chunk_task, &job);
+        letters_before_chunks(chunk_count, job.letters);
+
+        parallel_for(nthreads, chunk_count, crib_scan_task, &job);
+
+        size_t total = 0;
+        bool failed = false;
+
+        for (size_t chunk = 0; chunk < chunk_count; chunk++) {
+                total += job.found[chunk].count;
+                failed |= job.found[chunk].failed;
+        }
+
+        crib_candidate* all = failed ? NULL : malloc(total * sizeof(crib_candidate) + 1);
+        size_t distinct = 0;
+
+        if (all != NULL) {
+                distinct = merge_crib_lists(chunk_count, job.found, all);
+                memcpy(candidates, all,
+                       (distinct < capacity ? distinct : capacity) * sizeof(crib_candidate));
+        }
+
+        for (size_t chunk = 0; chunk < chunk_count; chunk++)
+                free(job.found[chunk].candidates);
+
+        free(all);
+        free(job.letters);
+        free(job.found);
+
+        return distinct;
+}
+
+/*
+  Substitution keys are found by hill climbing on quadgram scores. The letters
+  of the ciphertext are reduced to 0 - 25 once, and every quadgram is listed
+  under each distinct letter in it, so swapping two letters of the key only
+  rescores the quadgrams listed under either one: about 8/26 of them for
+  English letter frequencies, rather than the whole text. The table is 1.8 MiB
+  of floats read at random, which stays in L2 or L3 on current cores.
+*/
+
+typedef struct SubstitutionJob {
+        const float* quadgrams;
+        const unsigned char* letters;
+        // Letters in each quadgram of the text, as bit masks
+        const uint32_t* contains;
+        // Quadgrams (by their first letter's position) containing each letter,
+        // 'starts[letter]' up to 'starts[letter + 1]'
+        const uint32_t* positions;
+        size_t starts[27];
+        size_t quadgram_total;
+        uint64_t seed;
+        substitution_candidate* results;
+} SubstitutionJob;
+
+
+// Adds the quadgrams of the letters in 'text' to 'counts', returning how many
+// there were. Float counts are exact up to 2^24 of the same quadgram
+static size_t count_quadgrams(size_t len, const char text[len], float counts[QUADGRAM_COUNT]) {
+        size_t index = 0;
+        size_t letters = 0;
+
+        for (size_t i = 0; i < len; i++) {
+                const unsigned letter = (unsigned char) ((text[i] | 0x20) - 'a');
+
+                if (letter >= 26) continue;
+
+                index = (index * 26 + letter) % QUADGRAM_COUNT;
+
+                if (++letters >= 4) counts[index]++;
+        }
+
+        return letters >= 4 ? letters - 3 : 0;
+}
+
+// Turns the counts of 'total' quadgrams into log10 probabilities, in place
+static void quadgram_logs(size_t total, float quadgrams[QUADGRAM_COUNT]) {
+        const double log_total = log10((double) total);
+        // A hundredth of a single occurrence
+        const float unseen = (float) (-2 - log_total);
+
+        for (size_t i = 0; i < QUADGRAM_COUNT; i++)
+                quadgrams[i] =
+                    quadgrams[i] > 0 ? (float) (log10(quadgrams[i]) - log_total) : unseen;
+}
+
+bool build_quadgrams(size_t len, const char text[len], float quadgrams[QUADGRAM_COUNT]) {
+        memset(quadgrams, 0, QUADGRAM_COUNT * sizeof(quadgrams[0]));
+
+        const size_t total = count_quadgrams(len, text, quadgrams);
+
+        if (total == 0) return false;
+
+        quadgram_logs(total, quadgrams);
+
+        return true;
+}
+
+static float english_table[QUADGRAM_COUNT];
+static pthread_once_t english_table_once = PTHREAD_ONCE_INIT;
+
+static void build_english_table(void) {
+        size_t total = 0;
+
+        // Quadgrams aren't counted across the end of one passage into the next
+        for (size_t passage = 0; english_sample[passage] != NULL; passage++)
+                total += count_quadgrams(
+                    strlen(english_sample[passage]), english_sample[passage], english_table);
+
+        quadgram_logs(total, english_table);
+}
+
+const float* english_quadgrams(void) {
+        pthread_once(&english_table_once, build_english_table);
+
+        return english_table;
+}
+
+
+static inline float quadgram_score(const SubstitutionJob* job,
+                                   const unsigned plain[26],
+                                   uint32_t position) {
+        const unsigned char* q = job->letters + position;
+
+        return job->quadgrams[((plain[q[0]] * 26 + plain[q[1]]) * 26 + plain[q[2]]) * 26 +
+                              plain[q[3]]];
+}
+
+// Swaps the plaintext letters of ciphertext letters 'a' and 'b' if that raises
+// the score, keeping 'scores' (of each quadgram under 'plain') up to date.
+// Returns whether it did
+static bool try_swap(const SubstitutionJob* job,
+                     unsigned plain[26],
+                     float scores[],
+                     unsigned a,
+                     unsigned b) {
+        unsigned swapped[26];
+
+        memcpy(swapped, plain, sizeof(swapped));
+        swapped[a] = plain[b];
+        swapped[b] = plain[a];
+
+        float gain = 0;
+
+        for (size_t i = job->starts[a]; i < job->starts[a + 1]; i++)
+                gain += quadgram_score(job, swapped, job->positions[i]) - scores[job->positions[i]];
+
+        for (size_t i = job->starts[b]; i < job->starts[b + 1]; i++) {
+                const uint32_t position = job->positions[i];
+
+                // Already rescored under 'a'
+                if (job->contains[position] >> a & 1) continue;
+
+                gain += quadgram_score(job, swapped, position) - scores[position];
+        }
+
+        // Most swaps are rejected, so the new scores are only kept once one is accepted
+        if (gain <= 0) return false;
+
+        memcpy(plain, swapped, sizeof(swapped));
+
+        for (size_t i = job->starts[a]; i < job->starts[a + 1]; i++)
+                scores[job->positions[i]] = quadgram_score(job, plain, job->positions[i]);
+
+        for (size_t i = job->starts[b]; i < job->starts[b + 1]; i++)
+                scores[job->positions[i]] = quadgram_score(job, plain, job->positions[i]);
+
+        return true;
+}
+
+// splitmix64, to turn consecutive restart numbers into unrelated seeds
+static inline uint64_t mix_seed(uint64_t seed) {
+        seed += 0x9E3779B97F4A7C15;
+        seed = (seed ^ (seed >> 30)) * 0xBF58476D1CE4E5B9;
+        seed = (seed ^ (seed >> 27)) * 0x94D049BB133111EB;
+
+        return seed ^ (seed >> 31);
+}
+
+// xorshift64
+static inline uint64_t next_random(uint64_t* state) {
+        *state ^= *state << 13;
+        *state ^= *state >> 7;
+        *state ^= *state << 17;
+
+        return *state;
+}
+
+static void substitution_restart_task(size_t index, void* arg) {
+        const SubstitutionJob* job = arg;
+        // xorshift never leaves a zero state
+        uint64_t state = mix_seed(job->seed + index) | 1;
+        // Plaintext letter of each ciphertext letter, starting from a random key
+        unsigned plain[26];
+
+        for (unsigned letter = 0; letter < 26; letter++)
+                plain[letter] = letter;
+
+        for (unsigned letter = 25; letter > 0; letter--) {
+                const unsigned other = (unsigned) (next_random(&state) % (letter + 1));
+                const unsigned swap = plain[letter];
+
+                plain[letter] = plain[other];
+                plain[other] = swap;
+        }
+
+        // At most SUBSTITUTION_CRACK_MAX_LETTERS floats, so 16 KiB
+        float scores[job->quadgram_total];
+
+        for (uint32_t position = 0; position < job->quadgram_total; position++)
+                scores[position] = quadgram_score(job, plain, position);
+
+        for (bool improved = true; improved;) {
+                improved = false;
+
+                for (unsigned a = 0; a < 26; a++)
+                        for (unsigned b = a + 1; b < 26; b++) {
+                                // Swapping two letters the text doesn't use changes nothing
+                                if (job->starts[a] == job->starts[a + 1] &&
+                                    job->starts[b] == job->starts[b + 1])
+                                        continue;
+
+                                improved |= try_swap(job, plain, scores, a, b);
+                        }
+        }
+
+        substitution_candidate* result = &job->results[index];
+        double total = 0;
+
+        for (uint32_t position = 0; position < job->quadgram_total; position++)
+                total += scores[position];
+
+        for (unsigned letter = 0; letter < 26; letter++)
+                result->key[plain[letter]] = (char) ('A' + letter);
+
+        result->score = total / (double) job->quadgram_total;
+}
+
+bool crack_substitution(size_t len,
+                        const char text[len],
+                        const float quadgrams[QUADGRAM_COUNT],
+                        size_t restarts,
+                        uint64_t seed,
+                        size_t nthreads,
+                        substitution_candidate* best) {
+        unsigned char* letters = malloc(SUBSTITUTION_CRACK_MAX_LETTERS);
+        size_t letter_count = 0;
+
+        if (letters == NULL) return false;
+
+        for (size_t i = 0; i < len && letter_count < SUBSTITUTION_CRACK_MAX_LETTERS; i++) {
+                const unsigned letter = (unsigned char) ((text[i] | 0x20) - 'a');
+
+                if (letter < 26) letters[letter_count++] = (unsigned char) letter;
+        }
+
+        if (letter_count < 4) {
+                free(letters);
+
+                return false;
+        }
+
+        if (restarts == 0) restarts = 1;
+        if (nthreads == 0) nthreads = available_cpus();
+
+        const size_t quadgram_total = letter_count - 3;
+        uint32_t* contains = malloc(quadgram_total * sizeof(uint32_t));
+        // Each quadgram is listed under at most 4 letters
+        uint32_t* positions = malloc(4 * quadgram_total * sizeof(uint32_t));
+        substitution_candidate* results = malloc(restarts * sizeof(substitution_candidate));
+
+        if (contains == NULL || positions == NULL || results == NULL) {
+                free(letters);
+                free(contains);
+                free(positions);
+                free(results);
+
+                return false;
+        }
+
+        SubstitutionJob job = {
+                .quadgrams = quadgrams,
+                .letters = letters,
+                .contains = contains,
+                .positions = positions,
+                .quadgram_total = quadgram_total,
+                .seed = seed,
+                .results = results,
+        };
+
+        for (size_t position = 0; position < quadgram_total; position++) {
+                const unsigned char* q = letters + position;
+
+                contains[position] = 1u << q[0] | 1u << q[1] | 1u << q[2] | 1u << q[3];
+
+                for (unsigned letter = 0; letter < 26; letter++)
+                        job.starts[letter + 1] += contains[position] >> letter & 1;
+        }
+
+        size_t next[26];
+
+        for (unsigned letter = 0; letter < 26; letter++) {
+                job.starts[letter + 1] += job.starts[letter];
+                next[letter] = job.starts[letter];
+        }
+
+        for (uint32_t position = 0; position < quadgram_total; position++)
+                for (uint32_t mask = contains[position]; mask != 0; mask &= mask - 1)
+                        positions[next[__builtin_ctz(mask)]++] = position;
+
+        parallel_for(nthreads, restarts, substitution_restart_task, &job);
+
+        // The first of any equal results, so the thread count can't change the answer
+        *best = results[0];
+
+        for (size_t restart = 1; restart < restarts; restart++)
+                if (results[restart].score > best->score) *best = results[restart];
+
+        free(letters);
+        free(contains);
+        free(positions);
+        free(results);
+
+        return true;
+}
+
+
+/*
+  Each word of a wordlist is tried on the same few hundred letters (0 - 25) of
+  ciphertext, scoring the quadgrams of its decipherment as they come. A word is
+  dropped at the first check where its running score isn't clearly above what
+  random letters would score (the table's mean per quadgram), which for almost
+  every wrong key is the first. Surviving words are also dropped once they
+  fall behind the worst of the best kept so far, as no quadgram's log
+  probability is above 0.
+*/
+
+// Bytes of the wordlist each task takes, from the first line starting in them
+#define WORDLIST_BLOCK_SIZE 0x10000
+// Letters deciphered before the running score is first checked, and between
+// later checks. Fewer can leave real English looking random, as a handful of
+// unusual quadgrams outweigh the rest
+#define WORDLIST_FIRST_CHECK 32
+#define WORDLIST_CHECK_LETTERS 16
+// Standard deviations above random letters' score a running score must be, so
+// about 1 in 40 wrong keys gets past each check
+#define WORDLIST_REJECT_SIGMAS 2.0
+
+typedef struct WordlistJob {
+        const unsigned char* letters;
+        size_t letter_count;
+        const char* wordlist;
+        size_t wordlist_len;
+        const float* quadgrams;
+        // Lowest score the first 'n' deciphered letters can have without looking random
+        float random_bounds[WORDLIST_SAMPLE_LETTERS + 1];
+        size_t capacity;
+        // The best 'capacity' keys of each block, best first, scored by their
+        // total rather than their mean until they're merged
+        wordlist_candidate* best;
+        size_t* best_counts;
+} WordlistJob;
+
+
+// Total log probability of the sample's quadgrams deciphered with 'shifts'
+// (repeating every 'period'), or -INFINITY once it's no more than 'threshold'
+// or looks like random letters
+static float score_word(const WordlistJob* job,
+                        size_t period,
+                        const unsigned char shifts[period],
+                        float threshold) {
+        float score = 0;
+        size_t quadgram = 0;
+        size_t shift = 0;
+
+        for (size_t i = 0; i < job->letter_count; i++) {
+                const unsigned plain = job->letters[i] + 26u - shifts[shift];
+
+                quadgram = quadgram % (26 * 26 * 26) * 26 + (plain >= 26 ? plain - 26 : plain);
+
+                if (++shift == period) shift = 0;
+                if (i >= 3) score += job->quadgrams[quadgram];
+
+                const size_t deciphered = i + 1;
+
+                if (deciphered >= WORDLIST_FIRST_CHECK &&
+                    deciphered % WORDLIST_CHECK_LETTERS == 0 &&
+                    (score <= threshold || score < job->random_bounds[deciphered]))
+                        return -INFINITY;
+        }
+
+        return score > threshold && score >= job->random_bounds[job->letter_count] ? score
+                                                                                    : -INFINITY;
+}
+
+// Keeps the word if it's among the best of its block. Earlier words win ties,
+// so later ones only need to beat the worst kept
+static void try_word(const WordlistJob* job,
+                     const char* word,
+                     size_t word_len,
+                     wordlist_candidate best[],
+                     size_t* count) {
+        // Keys longer than the sample only ever use their first letters
+        unsigned char shifts[WORDLIST_SAMPLE_LETTERS];
+        size_t period = 0;
+
+        for (size_t i = 0; i < word_len && period < job->letter_count; i++) {
+                const unsigned letter = (unsigned char) ((word[i] | 0x20) - 'a');
+
+                if (letter < 26) shifts[period++] = (unsigned char) letter;
+        }
+
+        if (period == 0) return;
+
+        const float threshold =
+            *count == job->capacity ? (float) best[job->capacity - 1].score : -INFINITY;
+        const float score = score_word(job, period, shifts, threshold);
+
+        if (score == -INFINITY) return;
+
+        size_t rank = *count < job->capacity ? (*count)++ : job->capacity - 1;
+
+        for (; rank > 0 && best[rank - 1].score < score; rank--)
+                best[rank] = best[rank - 1];
+
+        best[rank] = (wordlist_candidate) {
+                .word = word,
+                .word_len = word_len,
+                .score = score,
+        };
+}
+
+static void wordlist_block_task(size_t index, void* arg) {
+        const WordlistJob* job = arg;
+        const char* wordlist = job->wordlist;
+        const size_t block_end = (index + 1) * WORDLIST_BLOCK_SIZE < job->wordlist_len
+                                     ? (index + 1) * WORDLIST_BLOCK_SIZE
+                                     : job->wordlist_len;
+        wordlist_candidate* best = job->best + index * job->capacity;
+        size_t count = 0;
+        size_t start = index * WORDLIST_BLOCK_SIZE;
+
+        // A line running into this block belongs to the one before
+        if (index > 0 && wordlist[start - 1] != '\n') {
+                const char* newline = memchr(wordlist + start, '\n', block_end - start);
+
+                start = newline != NULL ? (size_t) (newline - wordlist) + 1 : block_end;
+        }
+
+        while (start < block_end) {
+                const char* newline = memchr(wordlist + start, '\n', job->wordlist_len - start);
+                const size_t end =
+                    newline != NULL ? (size_t) (newline - wordlist) : job->wordlist_len;
+                const size_t word_len = end > start && wordlist[end - 1] == '\r'
+                                            ? end - start - 1
+                                            : end - start;
+
+                try_word(job, wordlist + start, word_len, best, &count);
+                start = end + 1;
+        }
+
+        job->best_counts[index] = count;
+}
+
+// Best first, then the earliest in the wordlist
+static int compare_wordlist_candidates(const void* a, const void* b) {
+        const wordlist_candidate* x = a;
+        const wordlist_candidate* y = b;
+
+        if (x->score != y->score) return x->score > y->score ? -1 : 1;
+
+        return (x->word > y->word) - (x->word < y->word);
+}
+
+size_t crack_vigenere_wordlist(size_t len,
+                               const char text[len],
+                               size_t wordlist_len,
+                               const char wordlist[wordlist_len],
+                               const float quadgrams[QUADGRAM_COUNT],
+                               size_t capacity,
+                               wordlist_candidate best[capacity],
+                               size_t nthreads) {
+        unsigned char letters[WORDLIST_SAMPLE_LETTERS];
+        size_t letter_count = 0;
+
+        for (size_t i = 0; i < len && letter_count < WORDLIST_SAMPLE_LETTERS; i++) {
+                const unsigned letter = (unsigned char) ((text[i] | 0x20) - 'a');
+
+                if (letter < 26) letters[letter_count++] = (unsigned char) letter;
+        }
+
+        const size_t block_count = (wordlist_len + WORDLIST_BLOCK_SIZE - 1) / WORDLIST_BLOCK_SIZE;
+
+        if (letter_count < 4 || capacity == 0 || block_count == 0) return 0;
+        if (nthreads == 0) nthreads = available_cpus();
+
+        WordlistJob job = {
+                .letters = letters,
+                .letter_count = letter_count,
+                .wordlist = wordlist,
+                .wordlist_len = wordlist_len,
+                .quadgrams = quadgrams,
+                .capacity = capacity,
+                .best = malloc(block_count * capacity * sizeof(wordlist_candidate)),
+                .best_counts = malloc(block_count * sizeof(size_t)),
+        };
+
+        if (job.best == NULL || job.best_counts == NULL) {
+                free(job.best);
+                free(job.best_counts);
+
+                return 0;
+        }
+
+        // Random letters make each quadgram a random entry of the table
+        double sum = 0;
+        double sum_squares = 0;
+
+        for (size_t quadgram = 0; quadgram < QUADGRAM_COUNT; quadgram++) {
+                sum += quadgrams[quadgram];
+                sum_squares += (double) quadgrams[quadgram] * quadgrams[quadgram];
+        }
+
+        const double mean = sum / QUADGRAM_COUNT;
+        const double deviation = sqrt(fmax(sum_squares / QUADGRAM_COUNT - mean * mean, 0));
+
+        for (size_t deciphered = 4; deciphered <= letter_count; deciphered++) {
+                const double count = (double) (deciphered - 3);
+
+                job.random_bounds[deciphered] =
+                    (float) (count * mean + WORDLIST_REJECT_SIGMAS * deviation * sqrt(count));
+        }
+
+        parallel_for(nthreads, block_count, wordlist_block_task, &job);
+
+        // Gathered in place, as no block keeps more than 'capacity'
+        size_t total = 0;
+
+        for (size_t block = 0; block < block_count; block++) {
+                memmove(job.best + total, job.best + block * capacity,
+                        job.best_counts[block] * sizeof(wordlist_candidate));
+                total += job.best_counts[block];
+        }
+
+        qsort(job.best, total, sizeof(wordlist_candidate), compare_wordlist_candidates);
+
+        const size_t count = total < capacity ? total : capacity;
+
+        for (size_t i = 0; i < count; i++) {
+                best[i] = job.best[i];
+                best[i].score /= (double) (letter_count - 3);
+        }
+
+        free(job.best);
+        free(job.best_counts);
+
+        return count;
+}
@@ -0,0 +1,262 @@
+#include "english_sample.h"
+
+
+// Public domain English prose, from which the default quadgram table is built.
+// Each string is kept under the 4095 characters C guarantees a string literal
+const char* const english_sample[] = {
+        // Declaration of Independence
+        "When in the Course of human events, it becomes necessary for one people to dissolve "
+        "the political bands which have connected them with another, and to assume among the "
+        "powers of the earth, the separate and equal station to which the Laws of Nature and of "
+        "Nature's God entitle them, a decent respect to the opinions of mankind requires that "
+        "they should declare the causes which impel them to the separation.\n"
+        "We hold these truths to be self-evident, that all men are created equal, that they are "
+        "endowed by their Creator with certain unalienable Rights, that among these are Life, "
+        "Liberty and the pursuit of Happiness. That to secure these rights, Governments are "
+        "instituted among Men, deriving their just powers from the consent of the governed, "
+        "That whenever any Form of Government becomes destructive of these ends, it is the "
+        "Right of the People to alter or to abolish it, and to institute new Government, laying "
+        "its foundation on such principles and organizing its powers in such form, as to them "
+        "shall seem most likely to effect their Safety and Happiness. Prudence, indeed, will "
+        "dictate that Governments long established should not be changed for light and "
+        "transient causes; and accordingly all experience hath shewn, that mankind are more "
+        "disposed to suffer, while evils are sufferable, than to right themselves by abolishing "
+        "the forms to which they are accustomed. But when a long train of abuses and "
+        "usurpations, pursuing invariably the same Object evinces a design to reduce them under "
+        "absolute Despotism, it is their right, it is their duty, to throw off such Government, "
+        "and to provide new Guards for their future security. Such has been the patient "
+        "sufferance of these Colonies; and such is now the necessity which constrains them to "
+        "alter their former Systems of Government. The history of the present King of Great "
+        "Britain is a history of repeated injuries and usurpations, all having in direct object "
+        "the establishment of an absolute Tyranny over these States. To prove this, let Facts "
+        "be submitted to a candid world.\n"
+        "He has refused his Assent to Laws, the most wholesome and necessary for the public "
+        "good. He has forbidden his Governors to pass Laws of immediate and pressing "
+        "importance, unless suspended in their operation till his Assent should be obtained; "
+        "and when so suspended, he has utterly neglected to attend to them. He has refused to "
+        "pass other Laws for the accommodation of large districts of people, unless those "
+        "people would relinquish the right of Representation in the Legislature, a right "
+        "inestimable to them and formidable to tyrants only. He has called together legislative "
+        "bodies at places unusual, uncomfortable, and distant from the depository of their "
+        "public Records, for the sole purpose of fatiguing them into compliance with his "
+        "measures. He has dissolved Representative Houses repeatedly, for opposing with manly "
+        "firmness his invasions on the rights of the people.",
+        // Jane Austen, Pride and Prejudice
+        "It is a truth universally acknowledged, that a single man in possession of a good "
+        "fortune, must be in want of a wife.\n"
+        "However little known the feelings or views of such a man may be on his first entering "
+        "a neighbourhood, this truth is so well fixed in the minds of the surrounding families, "
+        "that he is considered the rightful property of some one or other of their daughters.\n"
+        "\"My dear Mr. Bennet,\" said his lady to him one day, \"have you heard that "
+        "Netherfield Park is let at last?\"\n"
+        "Mr. Bennet replied that he had not.\n"
+        "\"But it is,\" returned she; \"for Mrs. Long has just been here, and she told me all "
+        "about it.\"\n"
+        "Mr. Bennet made no answer.\n"
+        "\"Do you not want to know who has taken it?\" cried his wife impatiently.\n"
+        "\"You want to tell me, and I have no objection to hearing it.\"\n"
+        "This was invitation enough.\n"
+        "\"Why, my dear, you must know, Mrs. Long says that Netherfield is taken by a young man "
+        "of large fortune from the north of England; that he came down on Monday in a chaise "
+        "and four to see the place, and was so much delighted with it, that he agreed with Mr. "
+        "Morris immediately; that he is to take possession before Michaelmas, and some of his "
+        "servants are to be in the house by the end of next week.\"\n"
+        "\"What is his name?\"\n"
+        "\"Bingley.\"\n"
+        "\"Is he married or single?\"\n"
+        "\"Oh! Single, my dear, to be sure! A single man of large fortune; four or five "
+        "thousand a year. What a fine thing for our girls!\"\n"
+        "\"How so? How can it affect them?\"\n"
+        "\"My dear Mr. Bennet,\" replied his wife, \"how can you be so tiresome! You must know "
+        "that I am thinking of his marrying one of them.\"\n"
+        "\"Is that his design in settling here?\"\n"
+        "\"Design! Nonsense, how can you talk so! But it is very likely that he may fall in "
+        "love with one of them, and therefore you must visit him as soon as he comes.\"\n"
+        "\"I see no occasion for that. You and the girls may go, or you may send them by "
+        "themselves, which perhaps will be still better, for as you are as handsome as any of "
+        "them, Mr. Bingley may like you the best of the party.\"\n"
+        "\"My dear, you flatter me. I certainly have had my share of beauty, but I do not "
+        "pretend to be anything extraordinary now. When a woman has five grown-up daughters, "
+        "she ought to give over thinking of her own beauty.\"\n"
+        "\"In such cases, a woman has not often much beauty to think of.\"\n"
+        "\"But, my dear, you must indeed go and see Mr. Bingley when he comes into the "
+        "neighbourhood.\"\n"
+        "\"It is more than I engage for, I assure you.\"\n"
+        "\"But consider your daughters. Only think what an establishment it would be for one of "
+        "them. Sir William and Lady Lucas are determined to go, merely on that account, for in "
+        "general, you know, they visit no newcomers. Indeed you must go, for it will be "
+        "impossible for us to visit him if you do not.\"",
+        // Charles Dickens, A Tale of Two Cities; Herman Melville, Moby-Dick
+        "It was the best of times, it was the worst of times, it was the age of wisdom, it was "
+        "the age of foolishness, it was the epoch of belief, it was the epoch of incredulity, "
+        "it was the season of Light, it was the season of Darkness, it was the spring of hope, "
+        "it was the winter of despair, we had everything before us, we had nothing before us, "
+        "we were all going direct to Heaven, we were all going direct the other way; in short, "
+        "the period was so far like the present period, that some of its noisiest authorities "
+        "insisted on its being received, for good or for evil, in the superlative degree of "
+        "comparison only.\n"
+        "There were a king with a large jaw and a queen with a plain face, on the throne of "
+        "England; there were a king with a large jaw and a queen with a fair face, on the "
+        "throne of France. In both countries it was clearer than crystal to the lords of the "
+        "State preserves of loaves and fishes, that things in general were settled for ever.\n"
+        "Call me Ishmael. Some years ago, never mind how long precisely, having little or no "
+        "money in my purse, and nothing particular to interest me on shore, I thought I would "
+        "sail about a little and see the watery part of the world. It is a way I have of "
+        "driving off the spleen and regulating the circulation. Whenever I find myself growing "
+        "grim about the mouth; whenever it is a damp, drizzly November in my soul; whenever I "
+        "find myself involuntarily pausing before coffin warehouses, and bringing up the rear "
+        "of every funeral I meet; and especially whenever my hypos get such an upper hand of "
+        "me, that it requires a strong moral principle to prevent me from deliberately stepping "
+        "into the street, and methodically knocking people's hats off, then, I account it high "
+        "time to get to sea as soon as I can. This is my substitute for pistol and ball. With a "
+        "philosophical flourish Cato throws himself upon his sword; I quietly take to the ship. "
+        "There is nothing surprising in this. If they but knew it, almost all men in their "
+        "degree, some time or other, cherish very nearly the same feelings towards the ocean "
+        "with me.\n"
+        "There now is your insular city of the Manhattoes, belted round by wharves as Indian "
+        "isles by coral reefs; commerce surrounds it with her surf. Right and left, the streets "
+        "take you waterward. Its extreme downtown is the battery, where that noble mole is "
+        "washed by waves, and cooled by breezes, which a few hours previous were out of sight "
+        "of land. Look at the crowds of water-gazers there.",
+        // Genesis 1, King James Version
+        "In the beginning God created the heaven and the earth. And the earth was without form, "
+        "and void; and darkness was upon the face of the deep. And the Spirit of God moved upon "
+        "the face of the waters. And God said, Let there be light: and there was light. And God "
+        "saw the light, that it was good: and God divided the light from the darkness. And God "
+        "called the light Day, and the darkness he called Night. And the evening and the "
+        "morning were the first day.\n"
+        "And God said, Let there be a firmament in the midst of the waters, and let it divide "
+        "the waters from the waters. And God made the firmament, and divided the waters which "
+        "were under the firmament from the waters which were above the firmament: and it was "
+        "so. And God called the firmament Heaven. And the evening and the morning were the "
+        "second day.\n"
+        "And God said, Let the waters under the heaven be gathered together unto one place, and "
+        "let the dry land appear: and it was so. And God called the dry land Earth; and the "
+        "gathering together of the waters called he Seas: and God saw that it was good. And God "
+        "said, Let the earth bring forth grass, the herb yielding seed, and the fruit tree "
+        "yielding fruit after his kind, whose seed is in itself, upon the earth: and it was so. "
+        "And the earth brought forth grass, and herb yielding seed after his kind, and the tree "
+        "yielding fruit, whose seed was in itself, after his kind: and God saw that it was "
+        "good. And the evening and the morning were the third day.\n"
+        "And God said, Let there be lights in the firmament of the heaven to divide the day "
+        "from the night; and let them be for signs, and for seasons, and for days, and years: "
+        "And let them be for lights in the firmament of the heaven to give light upon the "
+        "earth: and it was so. And God made two great lights; the greater light to rule the "
+        "day, and the lesser light to rule the night: he made the stars also. And God set them "
+        "in the firmament of the heaven to give light upon the earth, And to rule over the day "
+        "and over the night, and to divide the light from the darkness: and God saw that it was "
+        "good. And the evening and the morning were the fourth day.",
+        // Lewis Carroll, Alice's Adventures in Wonderland
+        "Alice was beginning to get very tired of sitting by her sister on the bank, and of "
+        "having nothing to do: once or twice she had peeped into the book her sister was "
+        "reading, but it had no pictures or conversations in it, \"and what is the use of a "
+        "book,\" thought Alice \"without pictures or conversations?\"\n"
+        "So she was considering in her own mind (as well as she could, for the hot day made her "
+        "feel very sleepy and stupid), whether the pleasure of making a daisy-chain would be "
+        "worth the trouble of getting up and picking the daisies, when suddenly a White Rabbit "
+        "with pink eyes ran close by her.\n"
+        "There was nothing so very remarkable in that; nor did Alice think it so very much out "
+        "of the way to hear the Rabbit say to itself, \"Oh dear! Oh dear! I shall be late!\" "
+        "(when she thought it over afterwards, it occurred to her that she ought to have "
+        "wondered at this, but at the time it all seemed quite natural); but when the Rabbit "
+        "actually took a watch out of its waistcoat-pocket, and looked at it, and then hurried "
+        "on, Alice started to her feet, for it flashed across her mind that she had never "
+        "before seen a rabbit with either a waistcoat-pocket, or a watch to take out of it, and "
+        "burning with curiosity, she ran across the field after it, and fortunately was just in "
+        "time to see it pop down a large rabbit-hole under the hedge.\n"
+        "In another moment down went Alice after it, never once considering how in the world "
+        "she was to get out again.\n"
+        "The rabbit-hole went straight on like a tunnel for some way, and then dipped suddenly "
+        "down, so suddenly that Alice had not a moment to think about stopping herself before "
+        "she found herself falling down a very deep well.\n"
+        "Either the well was very deep, or she fell very slowly, for she had plenty of time as "
+        "she went down to look about her and to wonder what was going to happen next. First, "
+        "she tried to look down and make out what she was coming to, but it was too dark to see "
+        "anything; then she looked at the sides of the well, and noticed that they were filled "
+        "with cupboards and book-shelves; here and there she saw maps and pictures hung upon "
+        "pegs.",
+        // Arthur Conan Doyle, A Scandal in Bohemia
+        "To Sherlock Holmes she is always the woman. I have seldom heard him mention her under "
+        "any other name. In his eyes she eclipses and predominates the whole of her sex. It was "
+        "not that he felt any emotion akin to love for Irene Adler. All emotions, and that one "
+        "particularly, were abhorrent to his cold, precise but admirably balanced mind. He was, "
+        "I take it, the most perfect reasoning and observing machine that the world has seen, "
+        "but as a lover he would have placed himself in a false position. He never spoke of the "
+        "softer passions, save with a gibe and a sneer. They were admirable things for the "
+        "observer, excellent for drawing the veil from men's motives and actions. But for the "
+        "trained reasoner to admit such intrusions into his own delicate and finely adjusted "
+        "temperament was to introduce a distracting factor which might throw a doubt upon all "
+        "his mental results. Grit in a sensitive instrument, or a crack in one of his own "
+        "high-power lenses, would not be more disturbing than a strong emotion in a nature such "
+        "as his. And yet there was but one woman to him, and that woman was the late Irene "
+        "Adler, of dubious and questionable memory.\n"
+        "I had seen little of Holmes lately. My marriage had drifted us away from each other. "
+        "My own complete happiness, and the home-centred interests which rise up around the man "
+        "who first finds himself master of his own establishment, were sufficient to absorb all "
+        "my attention, while Holmes, who loathed every form of society with his whole Bohemian "
+        "soul, remained in our lodgings in Baker Street, buried among his old books, and "
+        "alternating from week to week between cocaine and ambition, the drowsiness of the "
+        "drug, and the fierce energy of his own keen nature. He was still, as ever, deeply "
+        "attracted by the study of crime, and occupied his immense faculties and extraordinary "
+        "powers of observation in following out those clues, and clearing up those mysteries "
+        "which had been abandoned as hopeless by the official police.",
+        // Dickens, Tolstoy, Shelley and others
+        "Whether I shall turn out to be the hero of my own life, or whether that station will "
+        "be held by anybody else, these pages must show. To begin my life with the beginning of "
+        "my life, I record that I was born (as I have been informed and believe) on a Friday, "
+        "at twelve o'clock at night. It was remarked that the clock began to strike, and I "
+        "began to cry, simultaneously.\n"
+        "Happy families are all alike; every unhappy family is unhappy in its own way. "
+        "Everything was in confusion in the house. The wife had discovered that the husband was "
+        "carrying on an intrigue with a French girl, who had been a governess in their family, "
+        "and she had announced to her husband that she could not go on living in the same house "
+        "with him.\n"
+        "You will rejoice to hear that no disaster has accompanied the commencement of an "
+        "enterprise which you have regarded with such evil forebodings. I arrived here "
+        "yesterday, and my first task is to assure my dear sister of my welfare and increasing "
+        "confidence in the success of my undertaking. I am already far north of London, and as "
+        "I walk in the streets of Petersburgh, I feel a cold northern breeze play upon my "
+        "cheeks, which braces my nerves and fills me with delight.\n"
+        "The sun did not shine, it was too wet to play, so we sat in the house all that cold, "
+        "cold, wet day. Far out in the country there are some very old and quiet houses, and "
+        "the people who live in them speak slowly, work hard through the summer, and sit by the "
+        "fire through the long winter evenings, telling stories of the years that have gone.\n"
+        "Four score of the boys from the village school went down to the river every afternoon "
+        "when the weather was fine, to swim and to fish, and to watch the boats that came up "
+        "from the sea with the tide. Their fathers had done the same before them, and their "
+        "grandfathers before that, and nobody could remember a summer when the river had not "
+        "been full of shouting and laughter from noon until the bell rang for supper.",
+        // Charlotte Bronte, Dickens, Stevenson and Wilde
+        "There was no possibility of taking a walk that day. We had been wandering, indeed, in "
+        "the leafless shrubbery an hour in the morning; but since dinner the cold winter wind "
+        "had brought with it clouds so sombre, and a rain so penetrating, that further out-door "
+        "exercise was now out of the question. I was glad of it: I never liked long walks, "
+        "especially on chilly afternoons: dreadful to me was the coming home in the raw "
+        "twilight, with nipped fingers and toes, and a heart saddened by the chidings of "
+        "Bessie, the nurse, and humbled by the consciousness of my physical inferiority to "
+        "Eliza, John, and Georgiana Reed.\n"
+        "My father's family name being Pirrip, and my Christian name Philip, my infant tongue "
+        "could make of both names nothing longer or more explicit than Pip. So, I called myself "
+        "Pip, and came to be called Pip. I give Pirrip as my father's family name, on the "
+        "authority of his tombstone and my sister, who married the blacksmith. As I never saw "
+        "my father or my mother, and never saw any likeness of either of them, my first fancies "
+        "regarding what they were like were unreasonably derived from their tombstones.\n"
+        "Squire Trelawney, Doctor Livesey, and the rest of these gentlemen having asked me to "
+        "write down the whole particulars about Treasure Island, from the beginning to the end, "
+        "keeping nothing back but the bearings of the island, and that only because there is "
+        "still treasure not yet lifted, I take up my pen in the year of grace, and go back to "
+        "the time when my father kept the Admiral Benbow inn and the brown old seaman with the "
+        "sabre cut first took up his lodging under our roof. I remember him as if it were "
+        "yesterday, as he came plodding to the inn door, his sea-chest following behind him in "
+        "a hand-barrow; a tall, strong, heavy, nut-brown man, his tarry pigtail falling over "
+        "the shoulder of his soiled blue coat, his hands ragged and scarred, with black, broken "
+        "nails, and the sabre cut across one cheek, a dirty, livid white.\n"
+        "The studio was filled with the rich odour of roses, and when the light summer wind "
+        "stirred amidst the trees of the garden, there came through the open door the heavy "
+        "scent of the lilac, or the more delicate perfume of the pink-flowering thorn. From the "
+        "corner of the divan of Persian saddle-bags on which he was lying, smoking, as was his "
+        "custom, innumerable cigarettes, Lord Henry Wotton could just catch the gleam of the "
+        "honey-sweet and honey-coloured blossoms of a laburnum, whose tremulous branches seemed "
+        "hardly able to bear the burden of a beauty so flamelike as theirs.",
+        NULL,
+};
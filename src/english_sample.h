@@ -0,0 +1,10 @@
+#ifndef ENGLISH_SAMPLE_H
+#define ENGLISH_SAMPLE_H
+
+#include <stddef.h>
+
+
+// Passages of English text, ending with NULL
+extern const char* const english_sample[];
+
+#endif
@@ -0,0 +1,200 @@
+#ifndef KERNELS_H
+#define KERNELS_H
+
+#include "cipher.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+
+#if defined(__x86_64__) || defined(__i386__)
+#define CIPHER_X86 1
+#else
+#define CIPHER_X86 0
+#endif
+
+
+/*
+  Kernels read from 'in' and write to 'out', which may be the same buffer (but
+  must not otherwise overlap) to cipher in place. With 'nontemporal', whole
+  vectors are written with non-temporal stores, bypassing the cache; 'out' must
+  then be 64-byte aligned, and the caller must fence the stores afterwards.
+*/
+
+// 'rotation' is in the range 1 - 25. Non-alphabetic bytes are copied unchanged
+typedef void (*caesar_kernel_fn)(
+    unsigned rotation, size_t len, const char in[len], char out[len], bool nontemporal);
+
+void caesar_scalar(
+    unsigned rotation, size_t len, const char in[len], char out[len], bool nontemporal);
+
+/*
+  A Vigenère schedule is the key's rotations repeated until they cover 'span'
+  letters (the smallest multiple of the key period that is at least
+  VIGENERE_SCHEDULE_PAD), followed by another VIGENERE_SCHEDULE_PAD rotations.
+  From any position below 'span', a kernel can read a whole block of rotations
+  contiguously, and advancing by a block never needs more than one subtraction
+  to wrap.
+*/
+#define VIGENERE_SCHEDULE_PAD 64
+
+// Applies the schedule 'shifts' starting at 'position', returning the position
+// the next letter would use
+typedef size_t (*vigenere_kernel_fn)(size_t span,
+                                     const unsigned char shifts[],
+                                     size_t position,
+                                     size_t len,
+                                     const char in[len],
+                                     char out[len],
+                                     bool nontemporal);
+
+size_t vigenere_scalar(size_t span,
+                       const unsigned char shifts[],
+                       size_t position,
+                       size_t len,
+                       const char in[len],
+                       char out[len],
+                       bool nontemporal);
+
+// Number of ASCII letters in 'text'
+typedef size_t (*count_letters_kernel_fn)(size_t len, const char text[len]);
+
+size_t count_letters_scalar(size_t len, const char text[len]);
+
+// Adds the number of each letter in 'text' to 'counts', folding case
+typedef void (*letter_histogram_kernel_fn)(size_t len, const char text[len], size_t counts[26]);
+
+void letter_histogram_scalar(size_t len, const char text[len], size_t counts[26]);
+
+// Replaces each letter with the one at its index (0 - 25) in 'substitution',
+// keeping its case. Non-alphabetic bytes are copied unchanged
+typedef void (*substitute_kernel_fn)(const unsigned char substitution[26],
+                                     size_t len,
+                                     const char in[len],
+                                     char out[len]);
+
+void substitute_scalar(const unsigned char substitution[26],
+                       size_t len,
+                       const char in[len],
+                       char out[len]);
+
+// Writes the index (0 - 25) of each letter in 'text' to 'slots', one after
+// another, returning the number of letters. Kernels may write anything up to
+// VIGENERE_SCHEDULE_PAD bytes past the last letter's slot, so 'slots' needs
+// room for 'len + VIGENERE_SCHEDULE_PAD' bytes
+typedef size_t (*letter_slots_kernel_fn)(size_t len, const char text[len], unsigned char slots[]);
+
+size_t letter_slots_scalar(size_t len, const char text[len], unsigned char slots[]);
+
+// As crib_scan() in cipher.h
+typedef void (*crib_scan_kernel_fn)(size_t count,
+                                    const unsigned char letters[],
+                                    size_t crib_len,
+                                    const unsigned char crib[],
+                                    size_t max_period,
+                                    crib_match_fn match,
+                                    void* arg);
+
+void crib_scan_scalar(size_t count,
+                      const unsigned char letters[],
+                      size_t crib_len,
+                      const unsigned char crib[],
+                      size_t max_period,
+                      crib_match_fn match,
+                      void* arg);
+
+// Shortest of 'periods' (bit 'p' set for period 'p') that the key 'key'
+// repeats with, or 0 if none. The kernels only check the candidates that pass
+// their filter this way
+static inline size_t key_period(size_t len, const unsigned char key[len], uint64_t periods) {
+        for (; periods != 0; periods &= periods - 1) {
+                const size_t period = (size_t) __builtin_ctzll(periods);
+
+                if (memcmp(key, key + period, len - period) == 0) return period;
+        }
+
+        return 0;
+}
+
+// Length of the run of ASCII bytes (below 0x80) at the start of 'text'
+typedef size_t (*ascii_prefix_kernel_fn)(size_t len, const char text[len]);
+
+size_t ascii_prefix_scalar(size_t len, const char text[len]);
+
+#if CIPHER_X86
+void caesar_sse2(
+    unsigned rotation, size_t len, const char in[len], char out[len], bool nontemporal);
+void caesar_avx2(
+    unsigned rotation, size_t len, const char in[len], char out[len], bool nontemporal);
+void caesar_avx512(
+    unsigned rotation, size_t len, const char in[len], char out[len], bool nontemporal);
+
+size_t vigenere_ssse3(size_t span,
+                      const unsigned char shifts[],
+                      size_t position,
+                      size_t len,
+                      const char in[len],
+                      char out[len],
+                      bool nontemporal);
+size_t vigenere_avx2(size_t span,
+                     const unsigned char shifts[],
+                     size_t position,
+                     size_t len,
+                     const char in[len],
+                     char out[len],
+                     bool nontemporal);
+// Requires AVX-512 VBMI2 for the byte expand-load
+size_t vigenere_avx512(size_t span,
+                       const unsigned char shifts[],
+                       size_t position,
+                       size_t len,
+                       const char in[len],
+                       char out[len],
+                       bool nontemporal);
+
+size_t count_letters_sse2(size_t len, const char text[len]);
+size_t count_letters_avx2(size_t len, const char text[len]);
+size_t count_letters_avx512(size_t len, const char text[len]);
+
+void letter_histogram_avx2(size_t len, const char text[len], size_t counts[26]);
+void letter_histogram_avx512(size_t len, const char text[len], size_t counts[26]);
+
+void substitute_ssse3(const unsigned char substitution[26],
+                      size_t len,
+                      const char in[len],
+                      char out[len]);
+void substitute_avx2(const unsigned char substitution[26],
+                     size_t len,
+                     const char in[len],
+                     char out[len]);
+void substitute_avx512(const unsigned char substitution[26],
+                       size_t len,
+                       const char in[len],
+                       char out[len]);
+
+// Require BMI2 and AVX-512 VBMI2 respectively, to pack the letters together
+size_t letter_slots_avx2(size_t len, const char text[len], unsigned char slots[]);
+size_t letter_slots_avx512(size_t len, const char text[len], unsigned char slots[]);
+
+void crib_scan_avx2(size_t count,
+                    const unsigned char letters[],
+                    size_t crib_len,
+                    const unsigned char crib[],
+                    size_t max_period,
+                    crib_match_fn match,
+                    void* arg);
+void crib_scan_avx512(size_t count,
+                      const unsigned char letters[],
+                      size_t crib_len,
+                      const unsigned char crib[],
+                      size_t max_period,
+                      crib_match_fn match,
+                      void* arg);
+
+size_t ascii_prefix_sse2(size_t len, const char text[len]);
+size_t ascii_prefix_avx2(size_t len, const char text[len]);
+size_t ascii_prefix_avx512(size_t len, const char text[len]);
+#endif
+
+#endif
@@ -0,0 +1,842 @@
+#include "kernels.h"
+
+#if CIPHER_X86
+
+#include <immintrin.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+
+/*
+  All the SIMD kernels use the same branch-free formulation of a rotation:
+
+      t     = (c | 0x20) - 'a'        offset into the alphabet, for either case
+      alpha = t < 26                  anything else is left untouched
+      wraps = t >= 26 - rotation      rotating past 'Z'/'z'
+      c    += alpha ? rotation - (wraps ? 26 : 0) : 0
+
+  SSE2/AVX2 have no unsigned byte comparison, so 'x < y' is computed as
+  'min(x, y - 1) == x' and 'x >= y' as 'max(x, y) == x'.
+
+  Non-temporal stores write whole cache lines straight to memory, so a large
+  output doesn't evict everything else from the cache (or have its lines read
+  in first). They need 'out' to be aligned, and partial blocks are stored
+  normally.
+*/
+
+__attribute__((target("sse2")))
+static inline void store_sse2(char* out, __m128i value, bool nontemporal) {
+        if (nontemporal)
+                _mm_stream_si128((__m128i*) out, value);
+        else
+                _mm_storeu_si128((__m128i*) out, value);
+}
+
+__attribute__((target("avx2")))
+static inline void store_avx2(char* out, __m256i value, bool nontemporal) {
+        if (nontemporal)
+                _mm256_stream_si256((__m256i*) out, value);
+        else
+                _mm256_storeu_si256((__m256i*) out, value);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static inline void store_avx512(char* out, __mmask64 lanes, __m512i value, bool nontemporal) {
+        if (nontemporal && lanes == ~(__mmask64) 0)
+                _mm512_stream_si512((void*) out, value);
+        else
+                _mm512_mask_storeu_epi8(out, lanes, value);
+}
+
+__attribute__((target("sse2")))
+void caesar_sse2(
+    unsigned rotation, size_t len, const char in[len], char out[len], bool nontemporal) {
+        const __m128i fold = _mm_set1_epi8(0x20);
+        const __m128i base = _mm_set1_epi8('a');
+        const __m128i last = _mm_set1_epi8(25);
+        const __m128i wrap_from = _mm_set1_epi8((char) (26 - rotation));
+        const __m128i shift = _mm_set1_epi8((char) rotation);
+        const __m128i wrap = _mm_set1_epi8(26);
+
+        size_t i = 0;
+
+        for (; i + 16 <= len; i += 16) {
+                const __m128i c = _mm_loadu_si128((const __m128i*) (in + i));
+                const __m128i t = _mm_sub_epi8(_mm_or_si128(c, fold), base);
+                const __m128i alpha = _mm_cmpeq_epi8(_mm_min_epu8(t, last), t);
+                const __m128i wraps = _mm_cmpeq_epi8(_mm_max_epu8(t, wrap_from), t);
+                const __m128i delta = _mm_sub_epi8(shift, _mm_and_si128(wraps, wrap));
+
+                store_sse2(out + i, _mm_add_epi8(c, _mm_and_si128(alpha, delta)), nontemporal);
+        }
+
+        caesar_scalar(rotation, len - i, in + i, out + i, nontemporal);
+}
+
+__attribute__((target("avx2")))
+void caesar_avx2(
+    unsigned rotation, size_t len, const char in[len], char out[len], bool nontemporal) {
+        const __m256i fold = _mm256_set1_epi8(0x20);
+        const __m256i base = _mm256_set1_epi8('a');
+        const __m256i last = _mm256_set1_epi8(25);
+        const __m256i wrap_from = _mm256_set1_epi8((char) (26 - rotation));
+        const __m256i shift = _mm256_set1_epi8((char) rotation);
+        const __m256i wrap = _mm256_set1_epi8(26);
+
+        size_t i = 0;
+
+        for (; i + 32 <= len; i += 32) {
+                const __m256i c = _mm256_loadu_si256((const __m256i*) (in + i));
+                const __m256i t = _mm256_sub_epi8(_mm256_or_si256(c, fold), base);
+                const __m256i alpha = _mm256_cmpeq_epi8(_mm256_min_epu8(t, last), t);
+                const __m256i wraps = _mm256_cmpeq_epi8(_mm256_max_epu8(t, wrap_from), t);
+                const __m256i delta = _mm256_sub_epi8(shift, _mm256_and_si256(wraps, wrap));
+
+                store_avx2(
+                    out + i, _mm256_add_epi8(c, _mm256_and_si256(alpha, delta)), nontemporal);
+        }
+
+        // Finish off with at most one 16-byte block before going scalar
+        caesar_sse2(rotation, len - i, in + i, out + i, nontemporal);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+void caesar_avx512(
+    unsigned rotation, size_t len, const char in[len], char out[len], bool nontemporal) {
+        const __m512i fold = _mm512_set1_epi8(0x20);
+        const __m512i base = _mm512_set1_epi8('a');
+        const __m512i letters = _mm512_set1_epi8(26);
+        const __m512i wrap_from = _mm512_set1_epi8((char) (26 - rotation));
+        const __m512i shift = _mm512_set1_epi8((char) rotation);
+
+        for (size_t i = 0; i < len; i += 64) {
+                // Masked loads/stores handle the tail, so there is no scalar remainder
+                const __mmask64 lanes =
+                    len - i >= 64 ? ~(__mmask64) 0 : ((__mmask64) 1 << (len - i)) - 1;
+
+                const __m512i c = _mm512_maskz_loadu_epi8(lanes, in + i);
+                const __m512i t = _mm512_sub_epi8(_mm512_or_si512(c, fold), base);
+                const __mmask64 alpha = _mm512_cmplt_epu8_mask(t, letters);
+                const __mmask64 wraps = _mm512_mask_cmpge_epu8_mask(alpha, t, wrap_from);
+
+                __m512i rotated = _mm512_mask_add_epi8(c, alpha, c, shift);
+                rotated = _mm512_mask_sub_epi8(rotated, wraps, rotated, letters);
+
+                store_avx512(out + i, lanes, rotated, nontemporal);
+        }
+}
+
+
+/*
+  Vigenère only advances the key on letters, so the rotation for each letter in
+  a block is found by ranking it among the letters of the block (an exclusive
+  prefix sum of the letter mask) and using that rank to shuffle the next run of
+  rotations from the schedule into place. Non-letters pick up an arbitrary
+  rotation, which the letter mask then discards.
+
+  The rotation itself is the Caesar formulation above, with 'wraps' computed
+  per byte as 't + rotation >= 26'.
+*/
+
+__attribute__((target("ssse3,popcnt")))
+static inline __m128i letter_ranks_ssse3(__m128i ones) {
+        __m128i inclusive = _mm_add_epi8(ones, _mm_slli_si128(ones, 1));
+        inclusive = _mm_add_epi8(inclusive, _mm_slli_si128(inclusive, 2));
+        inclusive = _mm_add_epi8(inclusive, _mm_slli_si128(inclusive, 4));
+        inclusive = _mm_add_epi8(inclusive, _mm_slli_si128(inclusive, 8));
+
+        return _mm_sub_epi8(inclusive, ones);
+}
+
+__attribute__((target("ssse3,popcnt")))
+size_t vigenere_ssse3(size_t span,
+                      const unsigned char shifts[],
+                      size_t position,
+                      size_t len,
+                      const char in[len],
+                      char out[len],
+                      bool nontemporal) {
+        const __m128i fold = _mm_set1_epi8(0x20);
+        const __m128i base = _mm_set1_epi8('a');
+        const __m128i last = _mm_set1_epi8(25);
+        const __m128i one = _mm_set1_epi8(1);
+        const __m128i wrap = _mm_set1_epi8(26);
+
+        size_t i = 0;
+
+        for (; i + 16 <= len; i += 16) {
+                const __m128i c = _mm_loadu_si128((const __m128i*) (in + i));
+                const __m128i t = _mm_sub_epi8(_mm_or_si128(c, fold), base);
+                const __m128i alpha = _mm_cmpeq_epi8(_mm_min_epu8(t, last), t);
+
+                const __m128i ranks = letter_ranks_ssse3(_mm_and_si128(alpha, one));
+                const __m128i key = _mm_loadu_si128((const __m128i*) (shifts + position));
+                const __m128i rotation = _mm_shuffle_epi8(key, ranks);
+
+                const __m128i sum = _mm_add_epi8(t, rotation);
+                const __m128i wraps = _mm_cmpeq_epi8(_mm_max_epu8(sum, wrap), sum);
+                const __m128i delta = _mm_sub_epi8(rotation, _mm_and_si128(wraps, wrap));
+
+                store_sse2(out + i, _mm_add_epi8(c, _mm_and_si128(alpha, delta)), nontemporal);
+
+                position += (size_t) __builtin_popcount((unsigned) _mm_movemask_epi8(alpha));
+                if (position >= span) position -= span;
+        }
+
+        return vigenere_scalar(span, shifts, position, len - i, in + i, out + i, nontemporal);
+}
+
+__attribute__((target("avx2,popcnt")))
+size_t vigenere_avx2(size_t span,
+                     const unsigned char shifts[],
+                     size_t position,
+                     size_t len,
+                     const char in[len],
+                     char out[len],
+                     bool nontemporal) {
+        const __m256i fold = _mm256_set1_epi8(0x20);
+        const __m256i base = _mm256_set1_epi8('a');
+        const __m256i last = _mm256_set1_epi8(25);
+        const __m256i one = _mm256_set1_epi8(1);
+        const __m256i wrap = _mm256_set1_epi8(26);
+
+        size_t i = 0;
+
+        for (; i + 32 <= len; i += 32) {
+                const __m256i c = _mm256_loadu_si256((const __m256i*) (in + i));
+                const __m256i t = _mm256_sub_epi8(_mm256_or_si256(c, fold), base);
+                const __m256i alpha = _mm256_cmpeq_epi8(_mm256_min_epu8(t, last), t);
+                const unsigned mask = (unsigned) _mm256_movemask_epi8(alpha);
+
+                // Byte shifts and shuffles work within each 128-bit lane, so
+                // each lane is ranked separately and given its own run of
+                // rotations, the upper one starting after the lower lane's letters
+                const __m256i ones = _mm256_and_si256(alpha, one);
+                __m256i inclusive = _mm256_add_epi8(ones, _mm256_slli_si256(ones, 1));
+                inclusive = _mm256_add_epi8(inclusive, _mm256_slli_si256(inclusive, 2));
+                inclusive = _mm256_add_epi8(inclusive, _mm256_slli_si256(inclusive, 4));
+                inclusive = _mm256_add_epi8(inclusive, _mm256_slli_si256(inclusive, 8));
+                const __m256i ranks = _mm256_sub_epi8(inclusive, ones);
+
+                const size_t lower_letters = (size_t) __builtin_popcount(mask & 0xFFFF);
+                const __m128i lower_key = _mm_loadu_si128((const __m128i*) (shifts + position));
+                const __m128i upper_key =
+                    _mm_loadu_si128((const __m128i*) (shifts + position + lower_letters));
+                const __m256i key =
+                    _mm256_inserti128_si256(_mm256_castsi128_si256(lower_key), upper_key, 1);
+                const __m256i rotation = _mm256_shuffle_epi8(key, ranks);
+
+                const __m256i sum = _mm256_add_epi8(t, rotation);
+                const __m256i wraps = _mm256_cmpeq_epi8(_mm256_max_epu8(sum, wrap), sum);
+                const __m256i delta = _mm256_sub_epi8(rotation, _mm256_and_si256(wraps, wrap));
+
+                store_avx2(
+                    out + i, _mm256_add_epi8(c, _mm256_and_si256(alpha, delta)), nontemporal);
+
+                position += (size_t) __builtin_popcount(mask);
+                if (position >= span) position -= span;
+        }
+
+        return vigenere_ssse3(span, shifts, position, len - i, in + i, out + i, nontemporal);
+}
+
+__attribute__((target("avx512f,avx512bw,avx512vbmi2,popcnt")))
+size_t vigenere_avx512(size_t span,
+                       const unsigned char shifts[],
+                       size_t position,
+                       size_t len,
+                       const char in[len],
+                       char out[len],
+                       bool nontemporal) {
+        const __m512i fold = _mm512_set1_epi8(0x20);
+        const __m512i base = _mm512_set1_epi8('a');
+        const __m512i letters = _mm512_set1_epi8(26);
+
+        for (size_t i = 0; i < len; i += 64) {
+                const __mmask64 lanes =
+                    len - i >= 64 ? ~(__mmask64) 0 : ((__mmask64) 1 << (len - i)) - 1;
+
+                const __m512i c = _mm512_maskz_loadu_epi8(lanes, in + i);
+                const __m512i t = _mm512_sub_epi8(_mm512_or_si512(c, fold), base);
+                const __mmask64 alpha = _mm512_mask_cmplt_epu8_mask(lanes, t, letters);
+
+                // The expand-load does the ranking: it reads one rotation per
+                // letter and places them at the letters' positions
+                const __m512i rotation = _mm512_maskz_expandloadu_epi8(alpha, shifts + position);
+
+                const __m512i sum = _mm512_add_epi8(t, rotation);
+                const __mmask64 wraps = _mm512_mask_cmpge_epu8_mask(alpha, sum, letters);
+
+                __m512i rotated = _mm512_mask_add_epi8(c, alpha, c, rotation);
+                rotated = _mm512_mask_sub_epi8(rotated, wraps, rotated, letters);
+
+                store_avx512(out + i, lanes, rotated, nontemporal);
+
+                position += (size_t) __builtin_popcountll(alpha);
+                if (position >= span) position -= span;
+        }
+
+        return position;
+}
+
+
+/*
+  Letters are counted by subtracting the all-ones letter mask from per-byte
+  counters, which are summed into 64-bit lanes with 'psadbw' before they can
+  overflow (every 255 blocks).
+*/
+
+__attribute__((target("sse2")))
+static inline size_t sum_lanes_sse2(__m128i totals) {
+        uint64_t lanes[2];
+
+        _mm_storeu_si128((__m128i*) lanes, totals);
+
+        return (size_t) (lanes[0] + lanes[1]);
+}
+
+__attribute__((target("sse2")))
+size_t count_letters_sse2(size_t len, const char text[len]) {
+        const __m128i fold = _mm_set1_epi8(0x20);
+        const __m128i base = _mm_set1_epi8('a');
+        const __m128i last = _mm_set1_epi8(25);
+        const __m128i zero = _mm_setzero_si128();
+
+        __m128i total = zero;
+        size_t i = 0;
+
+        while (i + 16 <= len) {
+                __m128i counts = zero;
+
+                for (size_t block = 0; block < 255 && i + 16 <= len; block++, i += 16) {
+                        const __m128i c = _mm_loadu_si128((const __m128i*) (text + i));
+                        const __m128i t = _mm_sub_epi8(_mm_or_si128(c, fold), base);
+
+                        counts = _mm_sub_epi8(counts, _mm_cmpeq_epi8(_mm_min_epu8(t, last), t));
+                }
+
+                total = _mm_add_epi64(total, _mm_sad_epu8(counts, zero));
+        }
+
+        return sum_lanes_sse2(total) + count_letters_scalar(len - i, text + i);
+}
+
+__attribute__((target("avx2")))
+size_t count_letters_avx2(size_t len, const char text[len]) {
+        const __m256i fold = _mm256_set1_epi8(0x20);
+        const __m256i base = _mm256_set1_epi8('a');
+        const __m256i last = _mm256_set1_epi8(25);
+        const __m256i zero = _mm256_setzero_si256();
+
+        __m256i total = zero;
+        size_t i = 0;
+
+        while (i + 32 <= len) {
+                __m256i counts = zero;
+
+                for (size_t block = 0; block < 255 && i + 32 <= len; block++, i += 32) {
+                        const __m256i c = _mm256_loadu_si256((const __m256i*) (text + i));
+                        const __m256i t = _mm256_sub_epi8(_mm256_or_si256(c, fold), base);
+
+                        counts =
+                            _mm256_sub_epi8(counts, _mm256_cmpeq_epi8(_mm256_min_epu8(t, last), t));
+                }
+
+                total = _mm256_add_epi64(total, _mm256_sad_epu8(counts, zero));
+        }
+
+        const __m128i halves =
+            _mm_add_epi64(_mm256_castsi256_si128(total), _mm256_extracti128_si256(total, 1));
+
+        return sum_lanes_sse2(halves) + count_letters_sse2(len - i, text + i);
+}
+
+__attribute__((target("avx512f,avx512bw,popcnt")))
+size_t count_letters_avx512(size_t len, const char text[len]) {
+        const __m512i fold = _mm512_set1_epi8(0x20);
+        const __m512i base = _mm512_set1_epi8('a');
+        const __m512i letters = _mm512_set1_epi8(26);
+
+        size_t count = 0;
+
+        for (size_t i = 0; i < len; i += 64) {
+                const __mmask64 lanes =
+                    len - i >= 64 ? ~(__mmask64) 0 : ((__mmask64) 1 << (len - i)) - 1;
+
+                const __m512i c = _mm512_maskz_loadu_epi8(lanes, text + i);
+                const __m512i t = _mm512_sub_epi8(_mm512_or_si512(c, fold), base);
+
+                const __mmask64 alpha = _mm512_mask_cmplt_epu8_mask(lanes, t, letters);
+
+                count += (size_t) __builtin_popcountll(alpha);
+        }
+
+        return count;
+}
+
+
+/*
+  Histograms compare every byte against each letter in turn, counting matches
+  in per-byte counters as above. There aren't enough registers for counters
+  for all 26 letters, so each run of 255 blocks (small enough to stay in L1)
+  is scanned twice, 13 letters at a time.
+*/
+
+#define HISTOGRAM_PASS_LETTERS 13
+
+__attribute__((target("avx2")))
+void letter_histogram_avx2(size_t len, const char text[len], size_t counts[26]) {
+        const __m256i fold = _mm256_set1_epi8(0x20);
+        const __m256i zero = _mm256_setzero_si256();
+
+        size_t i = 0;
+
+        while (i + 32 <= len) {
+                const size_t blocks = (len - i) / 32 < 255 ? (len - i) / 32 : 255;
+                const size_t end = i + blocks * 32;
+
+                for (int first = 0; first < 26; first += HISTOGRAM_PASS_LETTERS) {
+                        // Offsets into the alphabet relative to this pass's first letter
+                        const __m256i base = _mm256_set1_epi8((char) ('a' + first));
+                        __m256i letters[HISTOGRAM_PASS_LETTERS];
+
+                        for (int l = 0; l < HISTOGRAM_PASS_LETTERS; l++)
+                                letters[l] = zero;
+
+                        for (size_t j = i; j < end; j += 32) {
+                                const __m256i c = _mm256_loadu_si256((const __m256i*) (text + j));
+                                const __m256i t = _mm256_sub_epi8(_mm256_or_si256(c, fold), base);
+
+                                for (int l = 0; l < HISTOGRAM_PASS_LETTERS; l++)
+                                        letters[l] = _mm256_sub_epi8(
+                                            letters[l],
+                                            _mm256_cmpeq_epi8(t, _mm256_set1_epi8((char) l)));
+                        }
+
+                        for (int l = 0; l < HISTOGRAM_PASS_LETTERS; l++) {
+                                const __m256i sums = _mm256_sad_epu8(letters[l], zero);
+
+                                counts[first + l] += sum_lanes_sse2(
+                                    _mm_add_epi64(_mm256_castsi256_si128(sums),
+                                                  _mm256_extracti128_si256(sums, 1)));
+                        }
+                }
+
+                i = end;
+        }
+
+        letter_histogram_scalar(len - i, text + i, counts);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+void letter_histogram_avx512(size_t len, const char text[len], size_t counts[26]) {
+        const __m512i fold = _mm512_set1_epi8(0x20);
+        const __m512i zero = _mm512_setzero_si512();
+        const __m512i one = _mm512_set1_epi8(1);
+
+        size_t i = 0;
+
+        while (i + 64 <= len) {
+                const size_t blocks = (len - i) / 64 < 255 ? (len - i) / 64 : 255;
+                const size_t end = i + blocks * 64;
+
+                for (int first = 0; first < 26; first += HISTOGRAM_PASS_LETTERS) {
+                        const __m512i base = _mm512_set1_epi8((char) ('a' + first));
+                        __m512i letters[HISTOGRAM_PASS_LETTERS];
+
+                        for (int l = 0; l < HISTOGRAM_PASS_LETTERS; l++)
+                                letters[l] = zero;
+
+                        for (size_t j = i; j < end; j += 64) {
+                                const __m512i c = _mm512_loadu_si512(text + j);
+                                const __m512i t = _mm512_sub_epi8(_mm512_or_si512(c, fold), base);
+
+                                for (int l = 0; l < HISTOGRAM_PASS_LETTERS; l++)
+                                        letters[l] = _mm512_mask_add_epi8(
+                                            letters[l],
+                                            _mm512_cmpeq_epi8_mask(t, _mm512_set1_epi8((char) l)),
+                                            letters[l],
+                                            one);
+                        }
+
+                        for (int l = 0; l < HISTOGRAM_PASS_LETTERS; l++)
+                                counts[first + l] += (size_t) _mm512_reduce_add_epi64(
+                                    _mm512_sad_epu8(letters[l], zero));
+                }
+
+                i = end;
+        }
+
+        letter_histogram_scalar(len - i, text + i, counts);
+}
+
+
+
+/*
+  Substitution looks each letter's index (0 - 25) up in the table with byte
+  shuffles, which only index 16 entries: the first 16 letters and the last 10
+  are looked up separately, and the right one picked by the index. Adding the
+  result back onto 'A', with the letter's lowercase bit, keeps its case.
+*/
+
+__attribute__((target("ssse3")))
+void substitute_ssse3(const unsigned char substitution[26],
+                      size_t len,
+                      const char in[len],
+                      char out[len]) {
+        unsigned char high_letters[16] = { 0 };
+
+        memcpy(high_letters, substitution + 16, 10);
+
+        const __m128i low_table = _mm_loadu_si128((const __m128i*) substitution);
+        const __m128i high_table = _mm_loadu_si128((const __m128i*) high_letters);
+        const __m128i fold = _mm_set1_epi8(0x20);
+        const __m128i base = _mm_set1_epi8('a');
+        const __m128i last = _mm_set1_epi8(25);
+        const __m128i fifteen = _mm_set1_epi8(15);
+        const __m128i sixteen = _mm_set1_epi8(16);
+        const __m128i upper = _mm_set1_epi8('A');
+
+        size_t i = 0;
+
+        for (; i + 16 <= len; i += 16) {
+                const __m128i c = _mm_loadu_si128((const __m128i*) (in + i));
+                const __m128i t = _mm_sub_epi8(_mm_or_si128(c, fold), base);
+                const __m128i letter = _mm_cmpeq_epi8(_mm_min_epu8(t, last), t);
+                const __m128i high = _mm_cmpgt_epi8(t, fifteen);
+
+                const __m128i low_sub = _mm_shuffle_epi8(low_table, t);
+                const __m128i high_sub = _mm_shuffle_epi8(high_table, _mm_sub_epi8(t, sixteen));
+                const __m128i sub = _mm_or_si128(_mm_and_si128(high, high_sub),
+                                                 _mm_andnot_si128(high, low_sub));
+                const __m128i result =
+                    _mm_or_si128(_mm_add_epi8(sub, upper), _mm_and_si128(c, fold));
+
+                _mm_storeu_si128(
+                    (__m128i*) (out + i),
+                    _mm_or_si128(_mm_and_si128(letter, result), _mm_andnot_si128(letter, c)));
+        }
+
+        substitute_scalar(substitution, len - i, in + i, out + i);
+}
+
+__attribute__((target("avx2")))
+void substitute_avx2(const unsigned char substitution[26],
+                     size_t len,
+                     const char in[len],
+                     char out[len]) {
+        unsigned char high_letters[16] = { 0 };
+
+        memcpy(high_letters, substitution + 16, 10);
+
+        // Shuffles only index within each 128-bit lane, so both lanes get the table
+        const __m256i low_table =
+            _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*) substitution));
+        const __m256i high_table =
+            _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*) high_letters));
+        const __m256i fold = _mm256_set1_epi8(0x20);
+        const __m256i base = _mm256_set1_epi8('a');
+        const __m256i last = _mm256_set1_epi8(25);
+        const __m256i fifteen = _mm256_set1_epi8(15);
+        const __m256i sixteen = _mm256_set1_epi8(16);
+        const __m256i upper = _mm256_set1_epi8('A');
+
+        size_t i = 0;
+
+        for (; i + 32 <= len; i += 32) {
+                const __m256i c = _mm256_loadu_si256((const __m256i*) (in + i));
+                const __m256i t = _mm256_sub_epi8(_mm256_or_si256(c, fold), base);
+                const __m256i letter = _mm256_cmpeq_epi8(_mm256_min_epu8(t, last), t);
+                const __m256i high = _mm256_cmpgt_epi8(t, fifteen);
+
+                const __m256i sub = _mm256_blendv_epi8(
+                    _mm256_shuffle_epi8(low_table, t),
+                    _mm256_shuffle_epi8(high_table, _mm256_sub_epi8(t, sixteen)),
+                    high);
+                const __m256i result =
+                    _mm256_or_si256(_mm256_add_epi8(sub, upper), _mm256_and_si256(c, fold));
+
+                _mm256_storeu_si256((__m256i*) (out + i), _mm256_blendv_epi8(c, result, letter));
+        }
+
+        substitute_ssse3(substitution, len - i, in + i, out + i);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+void substitute_avx512(const unsigned char substitution[26],
+                       size_t len,
+                       const char in[len],
+                       char out[len]) {
+        unsigned char high_letters[16] = { 0 };
+
+        memcpy(high_letters, substitution + 16, 10);
+
+        const __m512i low_table =
+            _mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i*) substitution));
+        const __m512i high_table =
+            _mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i*) high_letters));
+        const __m512i fold = _mm512_set1_epi8(0x20);
+        const __m512i base = _mm512_set1_epi8('a');
+        const __m512i letters = _mm512_set1_epi8(26);
+        const __m512i sixteen = _mm512_set1_epi8(16);
+        const __m512i upper = _mm512_set1_epi8('A');
+
+        for (size_t i = 0; i < len; i += 64) {
+                const __mmask64 lanes =
+                    len - i >= 64 ? ~(__mmask64) 0 : ((__mmask64) 1 << (len - i)) - 1;
+
+                const __m512i c = _mm512_maskz_loadu_epi8(lanes, in + i);
+                const __m512i t = _mm512_sub_epi8(_mm512_or_si512(c, fold), base);
+                const __mmask64 letter = _mm512_cmplt_epu8_mask(t, letters);
+                const __mmask64 high = _mm512_cmplt_epu8_mask(t, sixteen) ^ letter;
+
+                __m512i sub = _mm512_shuffle_epi8(low_table, t);
+                sub = _mm512_mask_shuffle_epi8(
+                    sub, high, high_table, _mm512_sub_epi8(t, sixteen));
+
+                const __m512i result =
+                    _mm512_or_si512(_mm512_add_epi8(sub, upper), _mm512_and_si512(c, fold));
+
+                _mm512_mask_storeu_epi8(out + i, lanes, _mm512_mask_blend_epi8(letter, c, result));
+        }
+}
+
+/*
+  Letters are packed together 8 bytes at a time: 'pext' gathers the index of
+  each letter's byte out of 0 - 7 into the low bytes of a shuffle control,
+  which moves the letters down to the front. AVX-512 VBMI2 can compress all
+  64 bytes of a vector directly.
+*/
+
+__attribute__((target("avx2,bmi2,popcnt")))
+size_t letter_slots_avx2(size_t len, const char text[len], unsigned char slots[]) {
+        const __m128i fold = _mm_set1_epi8(0x20);
+        const __m128i base = _mm_set1_epi8('a');
+        const __m128i last = _mm_set1_epi8(25);
+
+        size_t letters = 0;
+        size_t i = 0;
+
+        for (; i + 16 <= len; i += 16) {
+                const __m128i c = _mm_loadu_si128((const __m128i*) (text + i));
+                const __m128i t = _mm_sub_epi8(_mm_or_si128(c, fold), base);
+                const unsigned alpha =
+                    (unsigned) _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_min_epu8(t, last), t));
+
+                for (unsigned half = 0; half < 2; half++) {
+                        const uint64_t mask = (alpha >> (8 * half)) & 0xFF;
+                        // Each letter's bit widened to a whole byte
+                        const uint64_t bytes = _pdep_u64(mask, UINT64_C(0x0101010101010101)) * 0xFF;
+                        const uint64_t indices = _pext_u64(
+                            UINT64_C(0x0706050403020100) + half * UINT64_C(0x0808080808080808),
+                            bytes);
+                        const __m128i packed =
+                            _mm_shuffle_epi8(t, _mm_cvtsi64_si128((long long) indices));
+
+                        _mm_storel_epi64((__m128i*) (slots + letters), packed);
+                        letters += (size_t) __builtin_popcountll(mask);
+                }
+        }
+
+        return letters + letter_slots_scalar(len - i, text + i, slots + letters);
+}
+
+__attribute__((target("avx512f,avx512bw,avx512vbmi2,popcnt")))
+size_t letter_slots_avx512(size_t len, const char text[len], unsigned char slots[]) {
+        const __m512i fold = _mm512_set1_epi8(0x20);
+        const __m512i base = _mm512_set1_epi8('a');
+        const __m512i alphabet = _mm512_set1_epi8(26);
+
+        size_t letters = 0;
+
+        for (size_t i = 0; i < len; i += 64) {
+                const __mmask64 lanes =
+                    len - i >= 64 ? ~(__mmask64) 0 : ((__mmask64) 1 << (len - i)) - 1;
+
+                const __m512i c = _mm512_maskz_loadu_epi8(lanes, text + i);
+                const __m512i t = _mm512_sub_epi8(_mm512_or_si512(c, fold), base);
+                const __mmask64 alpha = _mm512_mask_cmplt_epu8_mask(lanes, t, alphabet);
+
+                _mm512_storeu_si512(slots + letters, _mm512_maskz_compress_epi8(alpha, t));
+                letters += (size_t) __builtin_popcountll(alpha);
+        }
+
+        return letters;
+}
+
+/*
+  Cribs are slid one offset at a time, with the key under the whole crib
+  computed at once: a subtraction per vector, adding 26 back where it went
+  negative. The key's first three letters are broadcast and compared with the
+  rest of it, and a period is only a candidate if all three repeat after it,
+  which leaves about 1 period in 17576 to be checked letter by letter.
+*/
+
+// (letters - crib) mod 26, for letters and crib in 0 - 25
+__attribute__((target("avx2")))
+static inline __m256i key_stream_avx2(__m256i letters, __m256i crib) {
+        const __m256i difference = _mm256_sub_epi8(letters, crib);
+        const __m256i negative = _mm256_cmpgt_epi8(_mm256_setzero_si256(), difference);
+
+        return _mm256_add_epi8(difference, _mm256_and_si256(negative, _mm256_set1_epi8(26)));
+}
+
+// Lanes of the 64-letter key in 'low' and 'high' equal to the letter in the
+// lowest byte of 'letter', as a bit mask
+__attribute__((target("avx2")))
+static inline uint64_t equal_lanes_avx2(__m256i low, __m256i high, __m128i letter) {
+        const __m256i broadcast = _mm256_broadcastb_epi8(letter);
+        const uint32_t low_mask =
+            (uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(low, broadcast));
+        const uint32_t high_mask =
+            (uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(high, broadcast));
+
+        return (uint64_t) high_mask << 32 | low_mask;
+}
+
+__attribute__((target("avx2")))
+void crib_scan_avx2(size_t count,
+                    const unsigned char letters[],
+                    size_t crib_len,
+                    const unsigned char crib[],
+                    size_t max_period,
+                    crib_match_fn match,
+                    void* arg) {
+        // Lanes past the end of the crib hold whatever follows it, and are
+        // never looked at
+        unsigned char padded[CRIB_MAX_LETTERS] = { 0 };
+
+        memcpy(padded, crib, crib_len);
+
+        const __m256i crib_low = _mm256_loadu_si256((const __m256i*) padded);
+        const __m256i crib_high = _mm256_loadu_si256((const __m256i*) (padded + 32));
+        const uint64_t periods = ((uint64_t) 2 << max_period) - 2;
+
+        for (size_t offset = 0; offset < count; offset++) {
+                const __m256i low = key_stream_avx2(
+                    _mm256_loadu_si256((const __m256i*) (letters + offset)), crib_low);
+                const __m256i high = key_stream_avx2(
+                    _mm256_loadu_si256((const __m256i*) (letters + offset + 32)), crib_high);
+                const __m128i first = _mm256_castsi256_si128(low);
+                // Bit 'p' is set where the letter 'p' places on repeats each of the first three
+                const uint64_t candidates =
+                    equal_lanes_avx2(low, high, first) &
+                    equal_lanes_avx2(low, high, _mm_srli_si128(first, 1)) >> 1 &
+                    equal_lanes_avx2(low, high, _mm_srli_si128(first, 2)) >> 2 & periods;
+
+                if (candidates == 0) continue;
+
+                unsigned char key[CRIB_MAX_LETTERS];
+
+                _mm256_storeu_si256((__m256i*) key, low);
+                _mm256_storeu_si256((__m256i*) (key + 32), high);
+
+                const size_t period = key_period(crib_len, key, candidates);
+
+                if (period > 0) match(offset, period, arg);
+        }
+}
+
+__attribute__((target("avx512f,avx512bw")))
+void crib_scan_avx512(size_t count,
+                      const unsigned char letters[],
+                      size_t crib_len,
+                      const unsigned char crib[],
+                      size_t max_period,
+                      crib_match_fn match,
+                      void* arg) {
+        unsigned char padded[CRIB_MAX_LETTERS] = { 0 };
+
+        memcpy(padded, crib, crib_len);
+
+        const __m512i crib_letters = _mm512_loadu_si512(padded);
+        const __m512i alphabet = _mm512_set1_epi8(26);
+        const uint64_t periods = ((uint64_t) 2 << max_period) - 2;
+
+        for (size_t offset = 0; offset < count; offset++) {
+                const __m512i difference =
+                    _mm512_sub_epi8(_mm512_loadu_si512(letters + offset), crib_letters);
+                const __m512i key_stream = _mm512_mask_add_epi8(
+                    difference, _mm512_movepi8_mask(difference), difference, alphabet);
+                const __m128i first = _mm512_castsi512_si128(key_stream);
+                const __m512i second = _mm512_broadcastb_epi8(_mm_srli_si128(first, 1));
+                const __m512i third = _mm512_broadcastb_epi8(_mm_srli_si128(first, 2));
+
+                const uint64_t candidates =
+                    _mm512_cmpeq_epi8_mask(key_stream, _mm512_broadcastb_epi8(first)) &
+                    _mm512_cmpeq_epi8_mask(key_stream, second) >> 1 &
+                    _mm512_cmpeq_epi8_mask(key_stream, third) >> 2 & periods;
+
+                if (candidates == 0) continue;
+
+                unsigned char key[CRIB_MAX_LETTERS];
+
+                _mm512_storeu_si512(key, key_stream);
+
+                const size_t period = key_period(crib_len, key, candidates);
+
+                if (period > 0) match(offset, period, arg);
+        }
+}
+
+/*
+  ASCII runs are found from the top bit of each byte, gathered into a mask
+  with 'pmovmskb' (or compared straight into a mask register with AVX-512).
+  The first set bit of the first non-zero mask is the first non-ASCII byte.
+*/
+
+__attribute__((target("sse2")))
+size_t ascii_prefix_sse2(size_t len, const char text[len]) {
+        size_t i = 0;
+
+        for (; i + 16 <= len; i += 16) {
+                const unsigned high =
+                    (unsigned) _mm_movemask_epi8(_mm_loadu_si128((const __m128i*) (text + i)));
+
+                if (high != 0) return i + (size_t) __builtin_ctz(high);
+        }
+
+        return i + ascii_prefix_scalar(len - i, text + i);
+}
+
+__attribute__((target("avx2")))
+size_t ascii_prefix_avx2(size_t len, const char text[len]) {
+        size_t i = 0;
+
+        // Two vectors at a time, only working out which byte it was once one has a high bit
+        for (; i + 64 <= len; i += 64) {
+                const __m256i a = _mm256_loadu_si256((const __m256i*) (text + i));
+                const __m256i b = _mm256_loadu_si256((const __m256i*) (text + i + 32));
+
+                if (_mm256_movemask_epi8(_mm256_or_si256(a, b)) != 0) break;
+        }
+
+        for (; i + 32 <= len; i += 32) {
+                const unsigned high = (unsigned) _mm256_movemask_epi8(
+                    _mm256_loadu_si256((const __m256i*) (text + i)));
+
+                if (high != 0) return i + (size_t) __builtin_ctz(high);
+        }
+
+        return i + ascii_prefix_sse2(len - i, text + i);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+size_t ascii_prefix_avx512(size_t len, const char text[len]) {
+        size_t i = 0;
+
+        for (; i + 64 <= len; i += 64) {
+                const __mmask64 high = _mm512_movepi8_mask(_mm512_loadu_si512(text + i));
+
+                if (high != 0) return i + (size_t) __builtin_ctzll(high);
+        }
+
+        // Only the tail needs a masked load
+        const __mmask64 lanes = ((__mmask64) 1 << (len - i)) - 1;
+        const __mmask64 high = _mm512_movepi8_mask(_mm512_maskz_loadu_epi8(lanes, text + i));
+
+        return high != 0 ? i + (size_t) __builtin_ctzll(high) : len;
+}
+
+#endif
@@ -1,86 +1,1184 @@
+// Needed for the POSIX I/O and memory mapping advice functions
+#define _POSIX_C_SOURCE 200809L
+
+#include "batch.h"
 #include "cipher.h"
+#include "cryptanalysis.h"
+#include "server.h"
+#include "stats.h"
+#include "tree.h"
 #include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <getopt.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 
+#define HELP_TEXT_SIZE 0x2000
+// Text is streamed through a single buffer of this size, so memory use is
+// constant regardless of the input size
+#define STREAM_BUFFER_SIZE 0x100000
+// With multiple threads each one gets a chunk of this size per buffer
+#define THREAD_BUFFER_SIZE 0x400000
+// In-place files are processed in windows of this size, which is a multiple of
+// any page size
+#define IN_PLACE_WINDOW_SIZE 0x1000000
+// Streams being cracked are read in chunks of this size, checking after each
+// one whether the key is already clear
+#define CRACK_CHUNK_SIZE 0x4000
+// Longest Vigenère key that cracking looks for
+#define CRACK_MAX_KEY_LEN 64
+// Number of candidate key lengths listed after cracking a Vigenère key
+#define CRACK_REPORTED_KEY_LENGTHS 5
+// Hill climbs from different random keys when cracking a substitution cipher,
+// from a fixed seed so the same ciphertext always gives the same key
+#define CRACK_SUBSTITUTION_RESTARTS 64
+#define CRACK_SUBSTITUTION_SEED 0x5DEECE66D
+// Streams being cracked as a substitution cipher are read up to this size,
+// which is usually far more than SUBSTITUTION_CRACK_MAX_LETTERS letters
+#define CRACK_SUBSTITUTION_SAMPLE_SIZE 0x40000
+// Bytes of the ciphertext shown deciphered with a cracked substitution key
+#define CRACK_PREVIEW_SIZE 0x200
+// Number of keys listed after dragging a crib over Vigenère ciphertext
+#define CRACK_REPORTED_CRIB_KEYS 10
+// Number of words listed after trying a wordlist as Vigenère keys
+#define CRACK_REPORTED_WORDS 10
 
-#define OUTPUT_TEXT_SIZE 0x400
+// Options that only have a long form
+enum LongOption {
+        OPTION_BEAUFORT = 0x100,
+        OPTION_VARIANT_BEAUFORT,
+        OPTION_AFFINE,
+        OPTION_AUTOKEY,
+        OPTION_RUNNING_KEY,
+        OPTION_IN_PLACE,
+        OPTION_BATCH,
+        OPTION_CRACK,
+        OPTION_QUADGRAMS,
+        OPTION_CRIB,
+        OPTION_WORDLIST,
+        OPTION_SERVE,
+        OPTION_CONNECT,
+        OPTION_RECURSIVE,
+        OPTION_STATS,
+        OPTION_UTF8,
+};
+
+typedef enum CipherType {
+        CIPHER_NONE,
+        CIPHER_CAESAR,
+        CIPHER_VIGENERE,
+        // Run by the polyalphabetic engine
+        CIPHER_BEAUFORT,
+        CIPHER_VARIANT_BEAUFORT,
+        CIPHER_AFFINE,
+        CIPHER_AUTOKEY,
+        CIPHER_RUNNING_KEY,
+        // Only cracked
+        CIPHER_SUBSTITUTION,
+} CipherType;
 
 typedef struct EncryptionConfig {
+        CipherType cipher;
+        bool decipher;
+        // 'a,b' for Affine, and the path of the key text for a running key
         char* key;
         size_t key_len;
-        char* text;
+        // Text given on the command line; NULL when streaming from a file or stdin
+        const char* text;
         size_t len;
+        char* input_path;
+        char* output_path;
+        char* in_place_path;
+        size_t threads;
+        bool batch;
+        BatchFormat batch_format;
+        // Cipher to recover the key of, instead of applying 'cipher'
+        CipherType crack;
+        // Quadgram table to score substitution keys with, instead of the built-in one
+        char* quadgrams_path;
+        // Known plaintext to recover a Vigenère key from, wherever it is in the text
+        char* crib;
+        // Likely Vigenère keys, one per line, to try instead of working the key out
+        char* wordlist_path;
+        // Unix socket to serve requests on, or to send the text to be ciphered to
+        char* serve_path;
+        char* connect_path;
+        // Directory tree to cipher every file of, into 'output_path' if given
+        char* recursive_path;
+        // Reject input that isn't valid UTF-8, before ciphering any of it
+        bool utf8;
+        // Print statistics to stderr on exit, if they were compiled in
+        bool stats;
+        StatsFormat stats_format;
 } EncryptionConfig;
 
+// Cipher state carried from one chunk of a stream to the next
+typedef struct CipherStream {
+        CipherType cipher;
+        bool decipher;
+        size_t threads;
+        char caesar_key;
+        vigenere_ctx vigenere;
+        poly_ctx poly;
+        // Letters of a running key not yet used up
+        size_t key_letters_left;
+} CipherStream;
+
+
+void validate_num_command_line_args(const EncryptionConfig* config, int num_positional_args) {
+        // Batch records carry their own cipher and key, and always use stdin/stdout
+        if (config->batch) {
+                if (num_positional_args != 0 || config->cipher != CIPHER_NONE ||
+                    config->input_path != NULL || config->output_path != NULL ||
+                    config->in_place_path != NULL || config->serve_path != NULL ||
+                    config->connect_path != NULL || config->recursive_path != NULL ||
+                    config->utf8) {
+                        fprintf(stderr, "Error: --batch cannot be combined with other options\n");
+                        exit(EXIT_FAILURE);
+                }
+
+                return;
+        }
+
+        // The server only takes its requests from the socket
+        if (config->serve_path != NULL) {
+                if (num_positional_args != 0 || config->cipher != CIPHER_NONE ||
+                    config->decipher || config->input_path != NULL ||
+                    config->output_path != NULL || config->in_place_path != NULL ||
+                    config->crack != CIPHER_NONE || config->connect_path != NULL ||
+                    config->recursive_path != NULL || config->utf8) {
+                        fprintf(stderr,
+                                "Error: --serve cannot be combined with options other than "
+                                "--threads\n");
+                        exit(EXIT_FAILURE);
+                }
+
+                return;
+        }
+
+        // Every file of the tree is both an input and an output
+        if (config->recursive_path != NULL &&
+            (num_positional_args != 0 || config->input_path != NULL ||
+             config->in_place_path != NULL || config->crack != CIPHER_NONE ||
+             config->connect_path != NULL || config->utf8)) {
+                fprintf(stderr,
+                        "Error: --recursive cannot be combined with other input, --in-place, "
+                        "--crack, --connect or --utf8\n");
+                exit(EXIT_FAILURE);
+        }
+
+        // Trees are ciphered and requests served with the Caesar and Vigenère kernels directly
+        if ((config->recursive_path != NULL || config->connect_path != NULL) &&
+            config->cipher > CIPHER_VIGENERE) {
+                fprintf(stderr,
+                        "Error: --recursive and --connect only support --caesar and --vigenere\n");
+                exit(EXIT_FAILURE);
+        }
+
+        if (config->connect_path != NULL &&
+            (config->in_place_path != NULL || config->crack != CIPHER_NONE)) {
+                fprintf(stderr, "Error: --connect cannot be combined with --in-place or --crack\n");
+                exit(EXIT_FAILURE);
+        }
+
+        // Cracking recovers the key and reports it, rather than writing any text
+        if (config->crack != CIPHER_NONE &&
+            (config->cipher != CIPHER_NONE || config->decipher || config->output_path != NULL ||
+             config->in_place_path != NULL || config->utf8)) {
+                fprintf(stderr,
+                        "Error: --crack cannot be combined with a key, --decipher, --output, "
+                        "--in-place or --utf8\n");
+                exit(EXIT_FAILURE);
+        }
+
+        if (config->crib != NULL && config->crack != CIPHER_VIGENERE) {
+                fprintf(stderr, "Error: --crib is only used by --crack vigenere\n");
+                exit(EXIT_FAILURE);
+        }
 
-void validate_num_command_line_args(bool decipher_mode, int num_command_line_args) {
-        if ((!decipher_mode && num_command_line_args != 4) ||
-            (decipher_mode && num_command_line_args != 5)) {
+        // Shorter cribs would match by chance at every period they can repeat within
+        if (config->crib != NULL &&
+            count_letters(strlen(config->crib), config->crib) <= CRIB_MIN_REPEATS) {
+                fprintf(stderr, "Error: The crib needs more than %d letters\n", CRIB_MIN_REPEATS);
+                exit(EXIT_FAILURE);
+        }
+
+        if (config->wordlist_path != NULL &&
+            (config->crack != CIPHER_VIGENERE || config->crib != NULL)) {
+                fprintf(stderr,
+                        "Error: --wordlist is only used by --crack vigenere, without --crib\n");
+                exit(EXIT_FAILURE);
+        }
+
+        if (config->quadgrams_path != NULL && config->crack != CIPHER_SUBSTITUTION &&
+            config->wordlist_path == NULL) {
+                fprintf(stderr,
+                        "Error: --quadgrams is only used by --crack substitution and --wordlist\n");
+                exit(EXIT_FAILURE);
+        }
+
+        // The text comes from either the command line, or a file/stdin
+        if (num_positional_args > 1 || (num_positional_args == 1 && config->input_path != NULL)) {
                 fprintf(stderr, "Error: Invalid number of arguments\n");
                 exit(EXIT_FAILURE);
         }
+
+        // In-place files are both the input and the output
+        if (config->in_place_path != NULL &&
+            (num_positional_args != 0 || config->input_path != NULL ||
+             config->output_path != NULL)) {
+                fprintf(stderr, "Error: --in-place cannot be combined with other input/output\n");
+                exit(EXIT_FAILURE);
+        }
+
+        if (config->cipher == CIPHER_NONE && config->crack == CIPHER_NONE) {
+                fprintf(stderr, "Error: No cipher specified\n");
+                exit(EXIT_FAILURE);
+        }
 }
 
 
 void write_help_string(size_t length, char output[length]) {
-        const char help_text[] =
-            "Usage: cipher [-d|--decipher] [cipher] key plaintext\n"
+        // In two parts, as ISO C only guarantees string literals of up to 4095 characters
+        const char options_text[] =
+            "Usage: cipher [-d|--decipher] [cipher] key [plaintext]\n"
             "Options:\n"
             "    -h, --help                     Display this help message\n"
             "    -d, --decipher                 Decipher the ciphertext\n"
             "    -c, --caesar   <key> <text>    Caesar cipher\n"
             "                                   Provide the key as a *single* letter to rotate by\n"
-            "    -v, --vigenere <key> <text>    Vigenère cipher\n\n"
+            "    -v, --vigenere <key> <text>    Vigenère cipher\n"
+            "        --beaufort <key> <text>    Beaufort cipher, which deciphers itself\n"
+            "        --variant-beaufort <key>   Variant Beaufort cipher, i.e. Vigenère backwards\n"
+            "        --affine   <a,b> <text>    Affine cipher, multiplying each letter by 'a'\n"
+            "                                   (coprime with 26) and adding 'b'\n"
+            "        --autokey  <key> <text>    Vigenère cipher with the key continued by the\n"
+            "                                   plaintext\n"
+            "        --running-key <file>       Vigenère cipher keyed by the letters of a text at\n"
+            "                                   least as long as the plaintext, such as a book\n"
+            "    -i, --input    <file>          Read the text from a file instead of the command line\n"
+            "    -o, --output   <file>          Write the result to a file instead of stdout\n"
+            "        --in-place <file>          Overwrite a file with the result, without copying it\n"
+            "    -t, --threads  <n>             Split the work across n threads (0 for every CPU)\n"
+            "        --batch[=lines|binary]     Process many records from stdin, see below\n"
+            "        --crack    <cipher>        Recover the key of 'caesar', 'vigenere' or\n"
+            "                                   'substitution' ciphertext by how closely it\n"
+            "                                   deciphers to English\n"
+            "        --quadgrams <file>         Score substitution and wordlist keys with a table of\n"
+            "                                   quadgram log10 probabilities (26^4 native floats)\n"
+            "        --crib     <text>          Recover a Vigenère key from plaintext known to be\n"
+            "                                   somewhere in the ciphertext, which may be huge\n"
+            "        --wordlist <file>          Recover a Vigenère key by trying each line of a file\n"
+            "        --serve    <socket>        Serve binary batch records on a Unix socket until\n"
+            "                                   interrupted, with --threads workers\n"
+            "        --connect  <socket>        Cipher the text on a server started with --serve\n"
+            "        --recursive <dir>          Cipher every file under a directory, into the\n"
+            "                                   --output directory, or else in place\n"
+            "        --utf8                     Reject input that isn't valid UTF-8, reporting the\n"
+            "                                   offset of the first invalid byte\n"
+            "        --stats[=text|json]        Report bytes, kernel and I/O times to stderr on exit\n"
+            "                                   (needs a build with 'make STATS=1')\n\n";
+        const char notes_text[] =
+            "If no text is given on the command line and no input file is provided, the text is\n"
+            "read from stdin, so the cipher can be used in a pipeline.\n\n"
+            "Batch records give the operation (e/d), cipher (c/v), key and text. In\n"
+            "'lines' format (the default) each record is a line of tab-separated fields\n"
+            "and each result is a line. In 'binary' format each record is\n"
+            "'op cipher key_len text_len key text' with 32-bit little-endian lengths,\n"
+            "and each result is 'text_len text'.\n\n"
+            "Only the ASCII letters are ciphered; every other byte, including all of any\n"
+            "multi-byte UTF-8 character, is passed through unchanged.\n\n"
             "NOTE: Any non-alphabetic characters in the plaintext, ciphertext or key are ignored\n"
             "      This is for readability, but when using you should strip all non-alphabetic characters (including spaces), and use only one case.\n\n"
             "Example Usages:\n"
             "    cipher --caesar J \"HELLOWORLD\"\n"
             "    cipher --decipher -c J \"QNUUX FXAUM\"\n"
             "    cipher --vigenere ARAGON \"Gondor calls for aid!\"\n"
-            "    cipher --decipher -v \"Legolas said\" \"Elkm\'ce lskqqr xns sottibv es Ogpnysrl\"\n";
+            "    cipher --decipher -v \"Legolas said\" \"Elkm\'ce lskqqr xns sottibv es Ogpnysrl\"\n"
+            "    cipher -v ARAGON --input plaintext.txt --output ciphertext.txt\n"
+            "    cipher --affine 5,8 \"Gondor calls for aid!\"\n"
+            "    cipher --running-key book.txt --input plaintext.txt\n"
+            "    cat plaintext.txt | cipher -c J > ciphertext.txt\n"
+            "    cipher -d -v ARAGON --in-place archive.txt\n"
+            "    cipher -v ARAGON --threads 0 --recursive exports/ --output encrypted/\n"
+            "    printf 'e\\tv\\tARAGON\\tGondor calls for aid!\\n' | cipher --batch\n"
+            "    cipher --crack caesar --input ciphertext.txt\n"
+            "    cipher --crack vigenere --threads 0 --input ciphertext.txt\n"
+            "    cipher --crib \"Project Gutenberg\" --threads 0 --input ciphertext.txt\n"
+            "    cipher --crack substitution --threads 0 --input ciphertext.txt\n"
+            "    cipher --wordlist words.txt --threads 0 --input ciphertext.txt\n"
+            "    cipher --serve /tmp/cipher.sock --threads 4 &\n"
+            "    cipher --connect /tmp/cipher.sock -v ARAGON \"Gondor calls for aid!\"\n";
+
+        snprintf(output, length, "%s%s", options_text, notes_text);
+}
+
+
+int open_file(const char* path, int flags) {
+        const int fd = open(path, flags, 0644);
+
+        if (fd < 0) {
+                fprintf(stderr, "Error: Failed to open '%s': %s\n", path, strerror(errno));
+                exit(EXIT_FAILURE);
+        }
+
+        return fd;
+}
+
+// 'a,b', where 'a' must be coprime with 26 for the cipher to be reversible
+void parse_affine_key(const char* key, poly_params* params) {
+        char* end = NULL;
+
+        errno = 0;
+        const unsigned long multiplier = strtoul(key, &end, 10);
+        bool valid = errno == 0 && end != key && *end == ',' && key[0] != '-';
+
+        const char* increment_text = valid ? end + 1 : key;
+        const unsigned long increment = strtoul(increment_text, &end, 10);
+
+        valid = valid && errno == 0 && end != increment_text && *end == '\0' &&
+                increment_text[0] != '-' && multiplier % 2 != 0 && multiplier % 13 != 0;
+
+        if (!valid) {
+                fprintf(stderr,
+                        "Error: Affine key should be 'a,b', with 'a' odd and not a multiple of "
+                        "13\n");
+                exit(EXIT_FAILURE);
+        }
+
+        params->multiplier = (unsigned) (multiplier % 26);
+        params->increment = (unsigned) (increment % 26);
+}
+
+// The key is only needed until it's compiled into the schedule, so the file is
+// mapped for just as long
+void open_poly_stream(CipherStream* stream, const EncryptionConfig* config) {
+        static const poly_cipher ciphers[] = {
+                [CIPHER_BEAUFORT] = POLY_BEAUFORT,
+                [CIPHER_VARIANT_BEAUFORT] = POLY_VARIANT_BEAUFORT,
+                [CIPHER_AFFINE] = POLY_AFFINE,
+                [CIPHER_AUTOKEY] = POLY_AUTOKEY,
+                [CIPHER_RUNNING_KEY] = POLY_RUNNING_KEY,
+        };
+        poly_params params = {
+                .cipher = ciphers[config->cipher],
+                .key_len = config->key_len,
+                .key = config->key,
+                .decipher = config->decipher,
+        };
+        char* mapped = NULL;
+
+        if (config->cipher == CIPHER_AFFINE) parse_affine_key(config->key, &params);
+
+        if (config->cipher == CIPHER_RUNNING_KEY) {
+                const int fd = open_file(config->key, O_RDONLY);
+                struct stat key_stat;
+
+                if (fstat(fd, &key_stat) != 0 || !S_ISREG(key_stat.st_mode)) {
+                        fprintf(stderr, "Error: '%s' is not a regular file\n", config->key);
+                        exit(EXIT_FAILURE);
+                }
+
+                params.key_len = (size_t) key_stat.st_size;
+                mapped = params.key_len > 0
+                             ? mmap(NULL, params.key_len, PROT_READ, MAP_PRIVATE, fd, 0)
+                             : NULL;
+
+                if (mapped == MAP_FAILED) {
+                        fprintf(stderr, "Error: Failed to map '%s': %s\n", config->key,
+                                strerror(errno));
+                        exit(EXIT_FAILURE);
+                }
+
+                params.key = mapped;
+                close(fd);
+        }
+
+        // A key without letters leaves the text unchanged, but a valid key
+        // failing means the schedule couldn't be allocated
+        if (!poly_ctx_init(&stream->poly, &params) && config->cipher != CIPHER_AFFINE &&
+            count_letters(params.key_len, params.key) > 0) {
+                fprintf(stderr, "Error: Out of memory\n");
+                exit(EXIT_FAILURE);
+        }
+
+        stream->key_letters_left = stream->poly.schedule.period;
+
+        if (mapped != NULL) munmap(mapped, params.key_len);
+}
+
+// A running key is never repeated, so the text can't have more letters than it
+void use_running_key(CipherStream* stream, size_t len, const char text[len]) {
+        const size_t letters = count_letters(len, text);
+
+        if (letters > stream->key_letters_left) {
+                fprintf(stderr, "Error: Running key has fewer letters than the text\n");
+                exit(EXIT_FAILURE);
+        }
+
+        stream->key_letters_left -= letters;
+}
+
+CipherStream open_cipher_stream(const EncryptionConfig* config) {
+        CipherStream stream = {
+                .cipher = config->cipher,
+                .decipher = config->decipher,
+                .threads = config->threads,
+        };
+
+        switch (config->cipher) {
+                case CIPHER_CAESAR:
+                        if (config->key_len != 1) {
+                                fprintf(stderr,
+                                        "Error: Key should be a single letter to rotate by\n");
+                                exit(EXIT_FAILURE);
+                        }
+
+                        stream.caesar_key = (char) toupper((unsigned char) config->key[0]);
+                        break;
+                case CIPHER_VIGENERE: {
+                        if (vigenere_ctx_init(
+                                &stream.vigenere, config->key_len, config->key, config->decipher))
+                                break;
+
+                        // A key without letters leaves the text unchanged, but a
+                        // valid key failing means the schedule couldn't be allocated
+                        for (size_t i = 0; i < config->key_len; i++) {
+                                if (isalpha((unsigned char) config->key[i])) {
+                                        fprintf(stderr, "Error: Out of memory\n");
+                                        exit(EXIT_FAILURE);
+                                }
+                        }
+
+                        break;
+                }
+                case CIPHER_BEAUFORT:
+                case CIPHER_VARIANT_BEAUFORT:
+                case CIPHER_AFFINE:
+                case CIPHER_AUTOKEY:
+                case CIPHER_RUNNING_KEY:
+                        open_poly_stream(&stream, config);
+                        break;
+                default:
+                        break;
+        }
+
+        return stream;
+}
+
+// WARNING: mutates 'text'!
+void apply_cipher_stream(CipherStream* stream, size_t len, char text[len]) {
+        switch (stream->cipher) {
+                case CIPHER_CAESAR:
+                        if (stream->threads == 1 && stream->decipher)
+                                decipher_caesar(stream->caesar_key, len, text);
+                        else if (stream->threads == 1)
+                                caesar(stream->caesar_key, len, text);
+                        else if (stream->decipher)
+                                decipher_caesar_parallel(
+                                    stream->caesar_key, len, text, stream->threads);
+                        else
+                                caesar_parallel(stream->caesar_key, len, text, stream->threads);
+                        break;
+                case CIPHER_VIGENERE:
+                        // The direction was baked into the key schedule
+                        if (stream->threads == 1)
+                                vigenere_ctx_update(&stream->vigenere, len, text);
+                        else
+                                vigenere_ctx_update_parallel(
+                                    &stream->vigenere, len, text, stream->threads);
+                        break;
+                case CIPHER_BEAUFORT:
+                case CIPHER_VARIANT_BEAUFORT:
+                case CIPHER_AFFINE:
+                case CIPHER_AUTOKEY:
+                case CIPHER_RUNNING_KEY:
+                        if (stream->cipher == CIPHER_RUNNING_KEY)
+                                use_running_key(stream, len, text);
 
-        snprintf(output, length, "%s", help_text);
+                        if (stream->threads == 1)
+                                poly_ctx_update(&stream->poly, len, text);
+                        else
+                                poly_ctx_update_parallel(&stream->poly, len, text, stream->threads);
+                        break;
+                default:
+                        break;
+        }
+}
+
+// Ciphers 'in' into 'out' in one pass, leaving 'in' unchanged. Always
+// single-threaded, as the only input is text from the command line
+void apply_cipher_stream_to(CipherStream* stream, size_t len, const char in[len], char out[len]) {
+        switch (stream->cipher) {
+                case CIPHER_CAESAR:
+                        if (stream->decipher)
+                                decipher_caesar_to(stream->caesar_key, len, in, out);
+                        else
+                                caesar_to(stream->caesar_key, len, in, out);
+                        break;
+                case CIPHER_VIGENERE:
+                        vigenere_ctx_update_to(&stream->vigenere, len, in, out);
+                        break;
+                case CIPHER_BEAUFORT:
+                case CIPHER_VARIANT_BEAUFORT:
+                case CIPHER_AFFINE:
+                case CIPHER_AUTOKEY:
+                case CIPHER_RUNNING_KEY:
+                        if (stream->cipher == CIPHER_RUNNING_KEY) use_running_key(stream, len, in);
+
+                        poly_ctx_update_to(&stream->poly, len, in, out);
+                        break;
+                default:
+                        memcpy(out, in, len);
+                        break;
+        }
+}
+
+void close_cipher_stream(CipherStream* stream) {
+        if (stream->cipher == CIPHER_VIGENERE) vigenere_ctx_free(&stream->vigenere);
+        if (stream->cipher > CIPHER_VIGENERE) poly_ctx_free(&stream->poly);
+}
+
+
+// Fills as much of 'buffer' as possible, returning 0 only at the end of the file.
+// Pipes return short reads, so keep reading to give the kernels large chunks
+size_t read_chunk(int fd, size_t size, char buffer[size]) {
+        size_t filled = 0;
+
+        while (filled < size) {
+                STATS_START(start);
+                const ssize_t bytes = read(fd, buffer + filled, size - filled);
+                STATS_STOP(STATS_IO, start);
+
+                if (bytes == 0) break;
+
+                if (bytes < 0) {
+                        if (errno == EINTR) continue;
+
+                        fprintf(stderr, "Error: Failed to read input: %s\n", strerror(errno));
+                        exit(EXIT_FAILURE);
+                }
+
+                filled += (size_t) bytes;
+        }
+
+        return filled;
+}
+
+void write_all(int fd, size_t len, const char buffer[len]) {
+        size_t written = 0;
+
+        while (written < len) {
+                STATS_START(start);
+                const ssize_t bytes = write(fd, buffer + written, len - written);
+                STATS_STOP(STATS_IO, start);
+
+                if (bytes < 0) {
+                        if (errno == EINTR) continue;
+
+                        fprintf(stderr, "Error: Failed to write output: %s\n", strerror(errno));
+                        exit(EXIT_FAILURE);
+                }
+
+                written += (size_t) bytes;
+        }
+}
+
+// Checked before opening the output, as truncating it would destroy the input
+void validate_distinct_files(int input_fd, const char* output_path) {
+        struct stat input_stat;
+        struct stat output_stat;
+
+        if (fstat(input_fd, &input_stat) != 0 || stat(output_path, &output_stat) != 0) return;
+
+        if (S_ISREG(input_stat.st_mode) && input_stat.st_dev == output_stat.st_dev &&
+            input_stat.st_ino == output_stat.st_ino) {
+                fprintf(stderr, "Error: Input and output must be different files\n");
+                exit(EXIT_FAILURE);
+        }
 }
 
-void run_caesar_cipher(const EncryptionConfig* config, bool decipher, char* output) {
-        // Destructure the EncryptionConfig for convenience
-        const char* key = config->key;
-        const size_t key_len = config->key_len;
-        const char* rawtext = config->text;
-        const size_t length = config->len;
+// Exits with an error at the first invalid UTF-8 in 'text', which starts 'offset' bytes into the
+// input. With 'more' to come, a sequence cut off by the end of 'text' may yet be finished, so the
+// length before it is returned instead
+size_t validate_utf8(size_t offset, size_t len, const char text[len], bool more) {
+        bool truncated = false;
+        const size_t valid = utf8_validate(len, text, &truncated);
+
+        if (valid == len || (truncated && more)) return valid;
+
+        fprintf(stderr, "Error: %s UTF-8 at byte %zu\n", truncated ? "Truncated" : "Invalid",
+                offset + valid);
+        exit(EXIT_FAILURE);
+}
+
+void stream_file(CipherStream* stream,
+                 bool utf8,
+                 int input_fd,
+                 int output_fd,
+                 size_t size,
+                 char buffer[size]) {
+#ifdef POSIX_FADV_SEQUENTIAL
+        // Let the kernel read ahead aggressively; fails harmlessly on pipes
+        posix_fadvise(input_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+        size_t offset = 0;
+        // Start of a UTF-8 sequence cut off by the end of the last chunk
+        size_t carried = 0;
+        size_t len = 0;
+
+        while ((len = read_chunk(input_fd, size - carried, buffer + carried)) > 0) {
+                len += carried;
+
+                const size_t complete = utf8 ? validate_utf8(offset, len, buffer, true) : len;
+
+                // 'buffer' is mutated here
+                apply_cipher_stream(stream, complete, buffer);
+                write_all(output_fd, complete, buffer);
+
+                carried = len - complete;
+                memmove(buffer, buffer + complete, carried);
+                offset += complete;
+        }
+
+        if (carried > 0) validate_utf8(offset, carried, buffer, false);
+}
+
+void stream_command_line_text(CipherStream* stream,
+                              const EncryptionConfig* config,
+                              int output_fd,
+                              size_t size,
+                              char buffer[size]) {
+        if (config->utf8) validate_utf8(0, config->len, config->text, false);
+
+        for (size_t offset = 0; offset < config->len; offset += size) {
+                const size_t len = config->len - offset < size ? config->len - offset : size;
+
+                apply_cipher_stream_to(stream, len, config->text + offset, buffer);
+                write_all(output_fd, len, buffer);
+        }
+
+        write_all(output_fd, 1, "\n");
+}
+
+// The ciphers work in place, so map the file and let them mutate the page
+// cache directly rather than copying through a buffer
+void cipher_file_in_place(CipherStream* stream, bool utf8, const char* path) {
+        const int fd = open_file(path, O_RDWR);
+        struct stat file_stat;
+
+        if (fstat(fd, &file_stat) != 0 || !S_ISREG(file_stat.st_mode)) {
+                fprintf(stderr, "Error: '%s' is not a regular file\n", path);
+                exit(EXIT_FAILURE);
+        }
+
+        const size_t len = (size_t) file_stat.st_size;
+
+        // mmap() rejects empty mappings, and there's nothing to do anyway
+        if (len == 0) {
+                close(fd);
+                return;
+        }
+
+        char* text = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+        if (text == MAP_FAILED) {
+                fprintf(stderr, "Error: Failed to map '%s': %s\n", path, strerror(errno));
+                exit(EXIT_FAILURE);
+        }
+
+        posix_madvise(text, len, POSIX_MADV_SEQUENTIAL);
+
+        // Checked in full first, so an invalid file is left untouched
+        if (utf8) validate_utf8(0, len, text, false);
+
+        for (size_t offset = 0; offset < len; offset += IN_PLACE_WINDOW_SIZE) {
+                const size_t window =
+                    len - offset < IN_PLACE_WINDOW_SIZE ? len - offset : IN_PLACE_WINDOW_SIZE;
+                const size_t next = offset + window;
+
+                // Fault the next window in while this one is being processed
+                if (next < len)
+                        posix_madvise(text + next,
+                                      len - next < IN_PLACE_WINDOW_SIZE ? len - next
+                                                                        : IN_PLACE_WINDOW_SIZE,
+                                      POSIX_MADV_WILLNEED);
+
+                // 'text' is mutated here
+                apply_cipher_stream(stream, window, text + offset);
+
+                // Start writing this window back without waiting for it
+                msync(text + offset, window, MS_ASYNC);
+        }
+
+        STATS_START(sync_start);
+        const int synced = msync(text, len, MS_SYNC);
+        STATS_STOP(STATS_IO, sync_start);
+
+        if (synced != 0) {
+                fprintf(stderr, "Error: Failed to write '%s': %s\n", path, strerror(errno));
+                exit(EXIT_FAILURE);
+        }
+
+        munmap(text, len);
+        close(fd);
+}
+
+void print_caesar_ranking(const caesar_candidate ranked[26]) {
+        printf("Rank  Key  Chi-squared\n");
+
+        for (size_t i = 0; i < 26; i++)
+                printf("%4zu  %3c  %11.2f\n", i + 1, ranked[i].key, ranked[i].chi_squared);
+}
+
+// Pipes can only be read in order, but reading still stops as soon as the key is clear
+size_t crack_caesar_stream(int fd, caesar_candidate ranked[26]) {
+        char* buffer = malloc(CRACK_CHUNK_SIZE);
+
+        if (buffer == NULL) {
+                fprintf(stderr, "Error: Out of memory\n");
+                exit(EXIT_FAILURE);
+        }
+
+        size_t counts[26] = { 0 };
+        size_t sampled = 0;
+        size_t len = 0;
+        bool decided = false;
+
+        while (!decided && (len = read_chunk(fd, CRACK_CHUNK_SIZE, buffer)) > 0) {
+                letter_histogram(len, buffer, counts);
+                sampled += len;
+                decided = rank_caesar_keys(counts, ranked);
+        }
+
+        // Empty input never ranks the keys in the loop
+        if (sampled == 0) rank_caesar_keys(counts, ranked);
+
+        free(buffer);
+
+        return sampled;
+}
+
+// Lists the most likely key lengths, in the order crack_vigenere() weighs them
+void print_key_lengths(size_t max_key_len, const double coincidence[max_key_len]) {
+        size_t ranked[max_key_len];
+        const size_t count = rank_key_lengths(max_key_len, coincidence, ranked);
+
+        printf("Key length  Index of coincidence\n");
+
+        for (size_t row = 0; row < CRACK_REPORTED_KEY_LENGTHS && row < count; row++)
+                printf("%10zu  %20.4f\n", ranked[row], coincidence[ranked[row] - 1]);
+}
+
+void crack_vigenere_text(size_t len, const char text[len], size_t threads) {
+        char key[CRACK_MAX_KEY_LEN];
+        double coincidence[CRACK_MAX_KEY_LEN];
+
+        const size_t key_len =
+            crack_vigenere(len, text, CRACK_MAX_KEY_LEN, key, coincidence, threads);
+
+        if (key_len == 0) {
+                fprintf(stderr, "Error: Too few letters to recover a Vigenère key\n");
+                exit(EXIT_FAILURE);
+        }
+
+        printf("Key: %.*s\n\n", (int) key_len, key);
+        print_key_lengths(CRACK_MAX_KEY_LEN, coincidence);
+}
 
-        if (key_len != 1) {
+// Lists the keys under which the crib appears, most often first
+void crack_crib_text(const EncryptionConfig* config, size_t len, const char text[len]) {
+        crib_candidate candidates[CRACK_REPORTED_CRIB_KEYS];
+        const size_t found = crack_vigenere_crib(len, text, strlen(config->crib), config->crib,
+                                                 CRACK_REPORTED_CRIB_KEYS, candidates,
+                                                 config->threads);
+
+        if (found == 0) {
+                fprintf(stderr, "Error: The crib isn't in the ciphertext under a repeating key\n");
+                exit(EXIT_FAILURE);
+        }
+
+        const size_t listed = found < CRACK_REPORTED_CRIB_KEYS ? found : CRACK_REPORTED_CRIB_KEYS;
+        int key_width = 3;
+
+        for (size_t i = 0; i < listed; i++)
+                if (candidates[i].key_len > (size_t) key_width)
+                        key_width = (int) candidates[i].key_len;
+
+        printf("Key: %.*s\n\n", (int) candidates[0].key_len, candidates[0].key);
+        printf("%-*s  Period  Matches  First offset\n", key_width, "Key");
+
+        for (size_t i = 0; i < listed; i++)
+                printf("%-*.*s  %6zu  %7zu  %12zu\n", key_width, (int) candidates[i].key_len,
+                       candidates[i].key, candidates[i].key_len, candidates[i].matches,
+                       candidates[i].offset);
+
+        if (found > listed) printf("(%zu more)\n", found - listed);
+}
+
+// Maps a table file read-only, so only the quadgrams the text uses are read in
+const float* map_quadgrams(const char* path) {
+        const int fd = open_file(path, O_RDONLY);
+        struct stat file_stat;
+
+        if (fstat(fd, &file_stat) != 0 ||
+            (size_t) file_stat.st_size != QUADGRAM_COUNT * sizeof(float)) {
+                fprintf(stderr, "Error: '%s' is not a table of %d quadgrams\n", path,
+                        QUADGRAM_COUNT);
+                exit(EXIT_FAILURE);
+        }
+
+        const float* quadgrams =
+            mmap(NULL, QUADGRAM_COUNT * sizeof(float), PROT_READ, MAP_PRIVATE, fd, 0);
+
+        if (quadgrams == MAP_FAILED) {
+                fprintf(stderr, "Error: Failed to map '%s': %s\n", path, strerror(errno));
+                exit(EXIT_FAILURE);
+        }
+
+        close(fd);
+
+        return quadgrams;
+}
+
+void crack_substitution_text(const EncryptionConfig* config, size_t len, const char text[len]) {
+        const float* quadgrams = config->quadgrams_path != NULL
+                                     ? map_quadgrams(config->quadgrams_path)
+                                     : english_quadgrams();
+        substitution_candidate best;
+
+        if (!crack_substitution(len, text, quadgrams, CRACK_SUBSTITUTION_RESTARTS,
+                                CRACK_SUBSTITUTION_SEED, config->threads, &best)) {
+                fprintf(stderr, "Error: Too few letters to recover a substitution key\n");
+                exit(EXIT_FAILURE);
+        }
+
+        if (config->quadgrams_path != NULL)
+                munmap((void*) quadgrams, QUADGRAM_COUNT * sizeof(float));
+
+        // Plaintext letter of each ciphertext letter
+        char plain[26];
+
+        for (size_t letter = 0; letter < 26; letter++)
+                plain[best.key[letter] - 'A'] = (char) ('A' + letter);
+
+        printf("Plaintext:  ABCDEFGHIJKLMNOPQRSTUVWXYZ\n"
+               "Ciphertext: %.26s\n"
+               "Score:      %.3f\n\n",
+               best.key, best.score);
+
+        const size_t preview_len = len < CRACK_PREVIEW_SIZE ? len : CRACK_PREVIEW_SIZE;
+
+        for (size_t i = 0; i < preview_len; i++) {
+                const unsigned char c = (unsigned char) text[i];
+                const unsigned letter = (unsigned char) ((c | 0x20) - 'a');
+
+                // Keeps the case of each letter
+                putchar(letter < 26 ? plain[letter] | (c & 0x20) : c);
+        }
+
+        if (preview_len > 0 && text[preview_len - 1] != '\n') putchar('\n');
+}
+
+// Maps the whole wordlist, which is read through once
+const char* map_wordlist(const char* path, size_t* len) {
+        const int fd = open_file(path, O_RDONLY);
+        struct stat file_stat;
+
+        if (fstat(fd, &file_stat) != 0 || !S_ISREG(file_stat.st_mode) || file_stat.st_size == 0) {
+                fprintf(stderr, "Error: '%s' is not a wordlist\n", path);
+                exit(EXIT_FAILURE);
+        }
+
+        *len = (size_t) file_stat.st_size;
+
+        const char* wordlist = mmap(NULL, *len, PROT_READ, MAP_PRIVATE, fd, 0);
+
+        if (wordlist == MAP_FAILED) {
+                fprintf(stderr, "Error: Failed to map '%s': %s\n", path, strerror(errno));
+                exit(EXIT_FAILURE);
+        }
+
+        posix_madvise((void*) wordlist, *len, POSIX_MADV_SEQUENTIAL);
+        close(fd);
+
+        return wordlist;
+}
+
+void crack_wordlist_text(const EncryptionConfig* config, size_t len, const char text[len]) {
+        const float* quadgrams = config->quadgrams_path != NULL
+                                     ? map_quadgrams(config->quadgrams_path)
+                                     : english_quadgrams();
+        size_t wordlist_len = 0;
+        const char* wordlist = map_wordlist(config->wordlist_path, &wordlist_len);
+        wordlist_candidate best[CRACK_REPORTED_WORDS];
+        const size_t found = crack_vigenere_wordlist(len, text, wordlist_len, wordlist, quadgrams,
+                                                     CRACK_REPORTED_WORDS, best, config->threads);
+
+        if (config->quadgrams_path != NULL)
+                munmap((void*) quadgrams, QUADGRAM_COUNT * sizeof(float));
+
+        if (found == 0) {
+                fprintf(stderr, "Error: Too few letters in the ciphertext or the wordlist\n");
+                exit(EXIT_FAILURE);
+        }
+
+        printf("Key: %.*s\n\n", (int) best[0].word_len, best[0].word);
+        printf("Rank   Score  Key\n");
+
+        for (size_t i = 0; i < found; i++)
+                printf("%4zu  %6.3f  %.*s\n", i + 1, best[i].score, (int) best[i].word_len,
+                       best[i].word);
+
+        const size_t preview_len = len < CRACK_PREVIEW_SIZE ? len : CRACK_PREVIEW_SIZE;
+        char preview[CRACK_PREVIEW_SIZE];
+
+        memcpy(preview, text, preview_len);
+        decipher_vigenere(best[0].word_len, best[0].word, preview_len, preview);
+        printf("\n%.*s", (int) preview_len, preview);
+
+        if (preview_len > 0 && preview[preview_len - 1] != '\n') putchar('\n');
+
+        munmap((void*) wordlist, wordlist_len);
+}
+
+// 'text' is the first 'len' bytes of a text 'total' bytes long
+void crack_text(const EncryptionConfig* config, size_t len, const char text[len], size_t total) {
+        if (config->crib != NULL) {
+                crack_crib_text(config, len, text);
+                return;
+        }
+
+        if (config->wordlist_path != NULL) {
+                crack_wordlist_text(config, len, text);
+                return;
+        }
+
+        if (config->crack == CIPHER_VIGENERE) {
+                crack_vigenere_text(len, text, config->threads);
+                return;
+        }
+
+        if (config->crack == CIPHER_SUBSTITUTION) {
+                crack_substitution_text(config, len, text);
+                return;
+        }
+
+        caesar_candidate ranked[26];
+        const size_t sampled = crack_caesar(len, text, ranked);
+
+        printf("Sampled %zu of %zu bytes\n\n", sampled, total);
+        print_caesar_ranking(ranked);
+}
+
+void crack_input(const EncryptionConfig* config) {
+        if (config->text != NULL) {
+                crack_text(config, config->len, config->text, config->len);
+                return;
+        }
+
+        const int fd =
+            config->input_path != NULL ? open_file(config->input_path, O_RDONLY) : STDIN_FILENO;
+        struct stat file_stat;
+
+        if (fstat(fd, &file_stat) == 0 && S_ISREG(file_stat.st_mode) && file_stat.st_size > 0) {
+                // Regular files are mapped, so only what the cracker samples is ever
+                // read: scattered blocks for Caesar, and a prefix for the others. A crib
+                // could be anywhere, so the whole file is read for one
+                const size_t total = (size_t) file_stat.st_size;
+                const bool vigenere = config->crack == CIPHER_VIGENERE && config->crib == NULL;
+                const bool prefix = config->crack != CIPHER_CAESAR;
+                const size_t len =
+                    vigenere && total > VIGENERE_CRACK_SAMPLE_SIZE ? VIGENERE_CRACK_SAMPLE_SIZE
+                                                                    : total;
+                const char* text = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+
+                if (text == MAP_FAILED) {
+                        fprintf(stderr, "Error: Failed to map the input: %s\n", strerror(errno));
+                        exit(EXIT_FAILURE);
+                }
+
+                posix_madvise(
+                    (void*) text, len, prefix ? POSIX_MADV_SEQUENTIAL : POSIX_MADV_RANDOM);
+                crack_text(config, len, text, total);
+                munmap((void*) text, len);
+        } else if (config->crack == CIPHER_CAESAR) {
+                caesar_candidate ranked[26];
+
+                printf("Sampled %zu bytes\n\n", crack_caesar_stream(fd, ranked));
+                print_caesar_ranking(ranked);
+        } else if (config->crib != NULL) {
+                char* buffer = NULL;
+                size_t capacity = 0;
+                size_t len = 0;
+                size_t chunk_len = 0;
+
+                do {
+                        buffer = grow_buffer(buffer, &capacity, len + STREAM_BUFFER_SIZE);
+                        chunk_len = read_chunk(fd, capacity - len, buffer + len);
+                        len += chunk_len;
+                } while (chunk_len > 0);
+
+                crack_text(config, len, buffer, len);
+                free(buffer);
+        } else {
+                const size_t size = config->crack == CIPHER_VIGENERE
+                                        ? VIGENERE_CRACK_SAMPLE_SIZE
+                                        : CRACK_SUBSTITUTION_SAMPLE_SIZE;
+                char* buffer = malloc(size);
+
+                if (buffer == NULL) {
+                        fprintf(stderr, "Error: Out of memory\n");
+                        exit(EXIT_FAILURE);
+                }
+
+                const size_t len = read_chunk(fd, size, buffer);
+
+                crack_text(config, len, buffer, len);
+                free(buffer);
+        }
+
+        if (fd != STDIN_FILENO) close(fd);
+}
+
+// The server takes the text as a single record, so the whole input is read first
+char* read_whole_input(int fd, size_t* len) {
+        char* buffer = NULL;
+        size_t capacity = 0;
+        size_t chunk_len = 0;
+
+        *len = 0;
+
+        do {
+                buffer = grow_buffer(buffer, &capacity, *len + STREAM_BUFFER_SIZE);
+                chunk_len = read_chunk(fd, capacity - *len, buffer + *len);
+                *len += chunk_len;
+
+                if (*len > SERVER_MAX_RECORD_SIZE) {
+                        fprintf(stderr, "Error: Input is too long to send to the server\n");
+                        exit(EXIT_FAILURE);
+                }
+        } while (chunk_len > 0);
+
+        return buffer;
+}
+
+void cipher_on_server(const EncryptionConfig* config) {
+        if (config->cipher == CIPHER_CAESAR && config->key_len != 1) {
                 fprintf(stderr, "Error: Key should be a single letter to rotate by\n");
                 exit(EXIT_FAILURE);
         }
 
-        strncpy(output, rawtext, length);
+        BatchRecord record = {
+                .operation = config->decipher ? 'd' : 'e',
+                .cipher = config->cipher == CIPHER_CAESAR ? 'c' : 'v',
+                .key = config->key,
+                .key_len = config->key_len,
+                .text = config->text,
+                .len = config->len,
+        };
+        char* buffer = NULL;
 
-        // 'output' is mutated here
-        if (decipher)
-                decipher_caesar((char) toupper(key[0]), length, output);
-        else
-                caesar((char) toupper(key[0]), length, output);
+        if (config->text == NULL) {
+                const int input_fd = config->input_path != NULL
+                                         ? open_file(config->input_path, O_RDONLY)
+                                         : STDIN_FILENO;
+
+                if (config->output_path != NULL)
+                        validate_distinct_files(input_fd, config->output_path);
+
+                buffer = read_whole_input(input_fd, &record.len);
+                record.text = buffer;
+
+                if (input_fd != STDIN_FILENO) close(input_fd);
+        } else {
+                // Command-line text can't be overwritten with the result
+                buffer = malloc(record.len + 1);
+
+                if (buffer == NULL) {
+                        fprintf(stderr, "Error: Out of memory\n");
+                        exit(EXIT_FAILURE);
+                }
+        }
+
+        if (config->utf8) validate_utf8(0, record.len, record.text, false);
+
+        request_from_server(config->connect_path, &record, buffer);
+
+        const int output_fd = config->output_path != NULL
+                                  ? open_file(config->output_path, O_WRONLY | O_CREAT | O_TRUNC)
+                                  : STDOUT_FILENO;
+
+        write_all(output_fd, record.len, buffer);
+
+        if (config->text != NULL) write_all(output_fd, 1, "\n");
+
+        free(buffer);
+
+        if (output_fd != STDOUT_FILENO && close(output_fd) != 0) {
+                fprintf(stderr, "Error: Failed to write output: %s\n", strerror(errno));
+                exit(EXIT_FAILURE);
+        }
 }
 
-void run_vigenere_cipher(const EncryptionConfig* config, bool decipher, char* output) {
-        // Destructure the EncryptionConfig for convenience
-        const char* key = config->key;
-        const size_t key_len = config->key_len;
-        const char* rawtext = config->text;
-        const size_t length = config->len;
+void select_cipher(EncryptionConfig* config, CipherType cipher, char* key) {
+        config->cipher = cipher;
+        config->key = key;
+        config->key_len = strlen(key);
+}
 
-        strncpy(output, rawtext, length);
+size_t parse_thread_count(const char* arg) {
+        char* end = NULL;
 
-        // 'output' is mutated here
-        if (decipher)
-                decipher_vigenere(key_len, key, length, output);
-        else
-                vigenere(key_len, key, length, output);
+        errno = 0;
+        const unsigned long threads = strtoul(arg, &end, 10);
+
+        if (errno != 0 || end == arg || *end != '\0' || arg[0] == '-' || threads > 0x400) {
+                fprintf(stderr, "Error: Number of threads should be between 0 and 1024\n");
+                exit(EXIT_FAILURE);
+        }
+
+        if (threads == 0) {
+                const long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+                return cpus > 0 ? (size_t) cpus : 1;
+        }
+
+        return (size_t) threads;
+}
+
+BatchFormat parse_batch_format(const char* arg) {
+        if (arg == NULL || strcmp(arg, "lines") == 0) return BATCH_LINES;
+        if (strcmp(arg, "binary") == 0) return BATCH_BINARY;
+
+        fprintf(stderr, "Error: Batch format should be 'lines' or 'binary'\n");
+        exit(EXIT_FAILURE);
+}
+
+StatsFormat parse_stats_format(const char* arg) {
+        if (arg == NULL || strcmp(arg, "text") == 0) return STATS_TEXT;
+        if (strcmp(arg, "json") == 0) return STATS_JSON;
+
+        fprintf(stderr, "Error: Statistics format should be 'text' or 'json'\n");
+        exit(EXIT_FAILURE);
+}
+
+CipherType parse_crack_cipher(const char* arg) {
+        if (strcmp(arg, "caesar") == 0) return CIPHER_CAESAR;
+        if (strcmp(arg, "vigenere") == 0) return CIPHER_VIGENERE;
+        if (strcmp(arg, "substitution") == 0) return CIPHER_SUBSTITUTION;
+
+        fprintf(stderr,
+                "Error: Cipher to crack should be 'caesar', 'vigenere' or 'substitution'\n");
+        exit(EXIT_FAILURE);
 }
 
 
@@ -91,68 +1189,229 @@ int main(const int argc, char const* argv[]) {
         }
 
         struct option long_options[] = {
-                {     "help",       no_argument, NULL, 'h' },
-                { "decipher",       no_argument, NULL, 'd' },
-                {   "caesar", required_argument, NULL, 'c' },
-                { "vigenere", required_argument, NULL, 'v' },
-                {       NULL,                 0, NULL,   0 }  // Null terminator for the options array
+                {             "help",       no_argument, NULL,                     'h' },
+                {         "decipher",       no_argument, NULL,                     'd' },
+                {           "caesar", required_argument, NULL,                     'c' },
+                {         "vigenere", required_argument, NULL,                     'v' },
+                {         "beaufort", required_argument, NULL,         OPTION_BEAUFORT },
+                { "variant-beaufort", required_argument, NULL, OPTION_VARIANT_BEAUFORT },
+                {           "affine", required_argument, NULL,           OPTION_AFFINE },
+                {          "autokey", required_argument, NULL,          OPTION_AUTOKEY },
+                {      "running-key", required_argument, NULL,      OPTION_RUNNING_KEY },
+                {            "input", required_argument, NULL,                     'i' },
+                {           "output", required_argument, NULL,                     'o' },
+                {         "in-place", required_argument, NULL,         OPTION_IN_PLACE },
+                {          "threads", required_argument, NULL,                     't' },
+                {            "batch", optional_argument, NULL,            OPTION_BATCH },
+                {            "crack", required_argument, NULL,            OPTION_CRACK },
+                {        "quadgrams", required_argument, NULL,        OPTION_QUADGRAMS },
+                {             "crib", required_argument, NULL,             OPTION_CRIB },
+                {         "wordlist", required_argument, NULL,         OPTION_WORDLIST },
+                {            "serve", required_argument, NULL,            OPTION_SERVE },
+                {          "connect", required_argument, NULL,          OPTION_CONNECT },
+                {        "recursive", required_argument, NULL,        OPTION_RECURSIVE },
+                {            "stats", optional_argument, NULL,            OPTION_STATS },
+                {             "utf8",       no_argument, NULL,             OPTION_UTF8 },
+                {               NULL,                 0, NULL,                       0 }  // Null terminator for the options array
         };
 
-        char output_text[OUTPUT_TEXT_SIZE] = { 0 };
+        EncryptionConfig config = { .threads = 1 };
 
         int option = 0;
         int option_index = 0;
-        bool decipher = false;
+        bool help = false;
 
-        while ((option = getopt_long(argc, argv, "hdc:v:", long_options, &option_index)) != -1) {
+        while ((option = getopt_long(argc, argv, "hdc:v:i:o:t:", long_options, &option_index)) !=
+               -1) {
                 switch (option) {
-                        case 'h': {
-                                write_help_string(OUTPUT_TEXT_SIZE, output_text);
+                        case 'h':
+                                help = true;
                                 break;
-                        }
                         case 'd':
-                                decipher = true;
+                                config.decipher = true;
+                                break;
+                        case 'c':
+                                select_cipher(&config, CIPHER_CAESAR, optarg);
+                                break;
+                        case 'v':
+                                select_cipher(&config, CIPHER_VIGENERE, optarg);
+                                break;
+                        case OPTION_BEAUFORT:
+                                select_cipher(&config, CIPHER_BEAUFORT, optarg);
+                                break;
+                        case OPTION_VARIANT_BEAUFORT:
+                                select_cipher(&config, CIPHER_VARIANT_BEAUFORT, optarg);
+                                break;
+                        case OPTION_AFFINE:
+                                select_cipher(&config, CIPHER_AFFINE, optarg);
+                                break;
+                        case OPTION_AUTOKEY:
+                                select_cipher(&config, CIPHER_AUTOKEY, optarg);
                                 break;
-                        case 'c': {
-                                validate_num_command_line_args(decipher, argc);
+                        case OPTION_RUNNING_KEY:
+                                select_cipher(&config, CIPHER_RUNNING_KEY, optarg);
+                                break;
+                        case 'i':
+                                config.input_path = optarg;
+                                break;
+                        case 'o':
+                                config.output_path = optarg;
+                                break;
+                        case OPTION_IN_PLACE:
+                                config.in_place_path = optarg;
+                                break;
+                        case 't':
+                                config.threads = parse_thread_count(optarg);
+                                break;
+                        case OPTION_BATCH:
+                                config.batch = true;
+                                config.batch_format = parse_batch_format(optarg);
+                                break;
+                        case OPTION_CRACK:
+                                config.crack = parse_crack_cipher(optarg);
+                                break;
+                        case OPTION_CRIB:
+                                config.crib = optarg;
 
-                                const char* key = argv[argc - 2];
-                                const char* rawtext = argv[argc - 1];
+                                if (config.crack == CIPHER_NONE) config.crack = CIPHER_VIGENERE;
 
-                                EncryptionConfig config = {
-                                        .key = key,
-                                        .key_len = strlen(key),
-                                        .text = rawtext,
-                                        .len = strlen(rawtext),
-                                };
+                                break;
+                        case OPTION_WORDLIST:
+                                config.wordlist_path = optarg;
 
-                                run_caesar_cipher(&config, decipher, output_text);
+                                if (config.crack == CIPHER_NONE) config.crack = CIPHER_VIGENERE;
 
                                 break;
-                        }
-                        case 'v': {
-                                validate_num_command_line_args(decipher, argc);
+                        case OPTION_QUADGRAMS:
+                                config.quadgrams_path = optarg;
+                                break;
+                        case OPTION_SERVE:
+                                config.serve_path = optarg;
+                                break;
+                        case OPTION_CONNECT:
+                                config.connect_path = optarg;
+                                break;
+                        case OPTION_RECURSIVE:
+                                config.recursive_path = optarg;
+                                break;
+                        case OPTION_UTF8:
+                                config.utf8 = true;
+                                break;
+                        case OPTION_STATS:
+                                config.stats = true;
+                                config.stats_format = parse_stats_format(optarg);
+                                break;
+                        default:
+                                exit(EXIT_FAILURE);
+                }
+        }
 
-                                const char* key = argv[argc - 2];
-                                const char* rawtext = argv[argc - 1];
+        if (help) {
+                char help_text[HELP_TEXT_SIZE] = { 0 };
 
-                                EncryptionConfig config = {
-                                        .key = key,
-                                        .key_len = strlen(key),
-                                        .text = rawtext,
-                                        .len = strlen(rawtext),
-                                };
+                write_help_string(HELP_TEXT_SIZE, help_text);
+                printf("%s\n", help_text);
 
-                                run_vigenere_cipher(&config, decipher, output_text);
+                return EXIT_SUCCESS;
+        }
 
-                                break;
-                        }
-                        default:
-                                exit(EXIT_FAILURE);
+        validate_num_command_line_args(&config, argc - optind);
+
+        if (config.stats) {
+                if (!STATS_COMPILED) {
+                        fprintf(stderr, "Error: Rebuild with 'make STATS=1' to use --stats\n");
+                        exit(EXIT_FAILURE);
                 }
+
+                stats_report_at_exit(config.stats_format);
+        }
+
+        if (optind < argc) {
+                config.text = argv[optind];
+                config.len = strlen(config.text);
+        }
+
+        if (config.batch) {
+                run_batch(config.batch_format);
+
+                return EXIT_SUCCESS;
+        }
+
+        if (config.serve_path != NULL) {
+                run_server(config.serve_path, config.threads);
+
+                return EXIT_SUCCESS;
+        }
+
+        if (config.crack != CIPHER_NONE) {
+                crack_input(&config);
+
+                return EXIT_SUCCESS;
         }
 
-        printf("%s\n", output_text);
+        if (config.connect_path != NULL) {
+                cipher_on_server(&config);
+
+                return EXIT_SUCCESS;
+        }
+
+        if (config.recursive_path != NULL) {
+                CipherStream stream = open_cipher_stream(&config);
+                const TreeCipher cipher = {
+                        .vigenere = stream.cipher == CIPHER_VIGENERE ? &stream.vigenere : NULL,
+                        .caesar_key = stream.caesar_key,
+                        .decipher = stream.decipher,
+                };
+
+                cipher_tree(&cipher, config.recursive_path, config.output_path, config.threads);
+                close_cipher_stream(&stream);
+
+                return EXIT_SUCCESS;
+        }
+
+        if (config.in_place_path != NULL) {
+                CipherStream stream = open_cipher_stream(&config);
+
+                cipher_file_in_place(&stream, config.utf8, config.in_place_path);
+                close_cipher_stream(&stream);
+
+                return EXIT_SUCCESS;
+        }
+
+        const int input_fd =
+            config.input_path != NULL ? open_file(config.input_path, O_RDONLY) : STDIN_FILENO;
+
+        if (config.text == NULL && config.output_path != NULL)
+                validate_distinct_files(input_fd, config.output_path);
+
+        const int output_fd = config.output_path != NULL
+                                  ? open_file(config.output_path, O_WRONLY | O_CREAT | O_TRUNC)
+                                  : STDOUT_FILENO;
+
+        // Give every thread a chunk worth handing over
+        const size_t buffer_size =
+            config.threads == 1 ? STREAM_BUFFER_SIZE : THREAD_BUFFER_SIZE * config.threads;
+        char* buffer = malloc(buffer_size);
+
+        if (buffer == NULL) {
+                fprintf(stderr, "Error: Out of memory\n");
+                exit(EXIT_FAILURE);
+        }
+
+        CipherStream stream = open_cipher_stream(&config);
+
+        if (config.text != NULL)
+                stream_command_line_text(&stream, &config, output_fd, buffer_size, buffer);
+        else
+                stream_file(&stream, config.utf8, input_fd, output_fd, buffer_size, buffer);
+
+        close_cipher_stream(&stream);
+        free(buffer);
+
+        if (output_fd != STDOUT_FILENO && close(output_fd) != 0) {
+                fprintf(stderr, "Error: Failed to write output: %s\n", strerror(errno));
+                exit(EXIT_FAILURE);
+        }
 
         return EXIT_SUCCESS;
 }
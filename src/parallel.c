@@ -0,0 +1,379 @@
+#include "parallel.h"
+#include "cipher.h"
+#include "thread_pool.h"
+#include <stdbool.h>
+#include <stdlib.h>
+
+
+// Chunks smaller than this aren't worth handing to another thread
+#define MIN_CHUNK_SIZE 0x40000
+// Split into more chunks than threads, so one slow thread doesn't hold up the rest
+#define CHUNKS_PER_THREAD 4
+// Consecutive buffers of a batch are grouped until they hold this many
+// bytes, so each task is big enough to be worth handing out but still fits in L2
+#define BATCH_GROUP_SIZE 0x40000
+
+typedef struct Chunks {
+        char* text;
+        size_t len;
+        size_t size; // Length of every chunk but the last
+        size_t count;
+} Chunks;
+
+typedef struct CaesarJob {
+        Chunks chunks;
+        char key;
+        bool decipher;
+} CaesarJob;
+
+typedef struct VigenereJob {
+        Chunks chunks;
+        const vigenere_ctx* ctx;
+        // See letters_before_chunks
+        size_t* letters;
+} VigenereJob;
+
+typedef struct PolyJob {
+        Chunks chunks;
+        const poly_ctx* ctx;
+        // See letters_before_chunks
+        size_t* letters;
+} PolyJob;
+
+typedef struct BatchJob {
+        const cipher_iov* iov;
+        // Index of the first buffer in each group, then the number of buffers
+        size_t* groups;
+        const vigenere_ctx* ctx;
+        bool restart_key;
+        // As for chunks, see letters_before_chunks
+        size_t* letters;
+} BatchJob;
+
+
+static size_t resolve_threads(size_t nthreads) {
+        return nthreads == 0 ? available_cpus() : nthreads;
+}
+
+static Chunks split_chunks(size_t len, char text[len], size_t nthreads) {
+        const size_t target_count = nthreads * CHUNKS_PER_THREAD;
+        size_t size = (len + target_count - 1) / target_count;
+
+        if (size < MIN_CHUNK_SIZE) size = MIN_CHUNK_SIZE;
+
+        // Keep chunk boundaries on cache lines, so threads don't share them
+        size = (size + 63) & ~(size_t) 63;
+
+        return (Chunks) {
+                .text = text,
+                .len = len,
+                .size = size,
+                .count = (len + size - 1) / size,
+        };
+}
+
+static inline char* chunk_text(const Chunks* chunks, size_t index) {
+        return chunks->text + index * chunks->size;
+}
+
+static inline size_t chunk_len(const Chunks* chunks, size_t index) {
+        const size_t remaining = chunks->len - index * chunks->size;
+
+        return remaining < chunks->size ? remaining : chunks->size;
+}
+
+
+static void caesar_task(size_t index, void* arg) {
+        const CaesarJob* job = arg;
+        const size_t len = chunk_len(&job->chunks, index);
+        char* text = chunk_text(&job->chunks, index);
+
+        // mutates 'text'!
+        if (job->decipher)
+                decipher_caesar(job->key, len, text);
+        else
+                caesar(job->key, len, text);
+}
+
+// WARNING: mutates 'text'!
+static void run_caesar_parallel(
+    char key, bool decipher, size_t len, char text[len], size_t nthreads) {
+        nthreads = resolve_threads(nthreads);
+
+        CaesarJob job = {
+                .chunks = split_chunks(len, text, nthreads),
+                .key = key,
+                .decipher = decipher,
+        };
+
+        parallel_for(nthreads, job.chunks.count, caesar_task, &job);
+}
+
+// WARNING: mutates 'plaintext'!
+void caesar_parallel(char key, size_t length, char plaintext[length], size_t nthreads) {
+        run_caesar_parallel(key, false, length, plaintext, nthreads);
+}
+
+// WARNING: mutates 'ciphertext'!
+void decipher_caesar_parallel(char key, size_t length, char ciphertext[length], size_t nthreads) {
+        run_caesar_parallel(key, true, length, ciphertext, nthreads);
+}
+
+
+static void count_letters_task(size_t index, void* arg) {
+        const VigenereJob* job = arg;
+
+        job->letters[index] =
+            count_letters(chunk_len(&job->chunks, index), chunk_text(&job->chunks, index));
+}
+
+size_t letters_before_chunks(size_t count, size_t letters[count]) {
+        size_t total = 0;
+
+        for (size_t i = 0; i < count; i++) {
+                const size_t chunk_letters = letters[i];
+
+                letters[i] = total;
+                total += chunk_letters;
+        }
+
+        return total;
+}
+
+static void vigenere_task(size_t index, void* arg) {
+        const VigenereJob* job = arg;
+
+        // Shares the key schedule, but starts at this chunk's own key position
+        vigenere_ctx chunk_ctx = *job->ctx;
+        vigenere_ctx_skip(&chunk_ctx, job->letters[index]);
+
+        const size_t len = chunk_len(&job->chunks, index);
+        char* text = chunk_text(&job->chunks, index);
+
+        // mutates 'text'!
+        vigenere_ctx_update(&chunk_ctx, len, text);
+}
+
+// WARNING: mutates 'text'!
+void vigenere_ctx_update_parallel(vigenere_ctx* ctx, size_t len, char text[len], size_t nthreads) {
+        nthreads = resolve_threads(nthreads);
+
+        const Chunks chunks = split_chunks(len, text, nthreads);
+        size_t* letters = nthreads > 1 && chunks.count > 1 ? malloc(chunks.count * sizeof(size_t))
+                                                           : NULL;
+
+        if (letters == NULL) {
+                vigenere_ctx_update(ctx, len, text);
+                return;
+        }
+
+        VigenereJob job = {
+                .chunks = chunks,
+                .ctx = ctx,
+                .letters = letters,
+        };
+
+        // Non-letters don't advance the key, so each chunk's starting key
+        // position is the number of letters in the chunks before it
+        parallel_for(nthreads, chunks.count, count_letters_task, &job);
+
+        const size_t total = letters_before_chunks(chunks.count, letters);
+
+        parallel_for(nthreads, chunks.count, vigenere_task, &job);
+
+        vigenere_ctx_skip(ctx, total);
+
+        free(letters);
+}
+
+static void count_poly_letters_task(size_t index, void* arg) {
+        const PolyJob* job = arg;
+
+        job->letters[index] =
+            count_letters(chunk_len(&job->chunks, index), chunk_text(&job->chunks, index));
+}
+
+static void poly_task(size_t index, void* arg) {
+        const PolyJob* job = arg;
+
+        // Shares the schedule, but starts at this chunk's own key position
+        poly_ctx chunk_ctx = *job->ctx;
+        vigenere_ctx_skip(&chunk_ctx.schedule, job->letters[index]);
+
+        const size_t len = chunk_len(&job->chunks, index);
+        char* text = chunk_text(&job->chunks, index);
+
+        // mutates 'text'!
+        poly_ctx_update(&chunk_ctx, len, text);
+}
+
+// WARNING: mutates 'text'!
+void poly_ctx_update_parallel(poly_ctx* ctx, size_t len, char text[len], size_t nthreads) {
+        nthreads = resolve_threads(nthreads);
+
+        const Chunks chunks = split_chunks(len, text, nthreads);
+        size_t* letters = ctx->cipher != POLY_AUTOKEY && nthreads > 1 && chunks.count > 1
+                              ? malloc(chunks.count * sizeof(size_t))
+                              : NULL;
+
+        if (letters == NULL) {
+                poly_ctx_update(ctx, len, text);
+                return;
+        }
+
+        PolyJob job = {
+                .chunks = chunks,
+                .ctx = ctx,
+                .letters = letters,
+        };
+
+        parallel_for(nthreads, chunks.count, count_poly_letters_task, &job);
+
+        const size_t total = letters_before_chunks(chunks.count, letters);
+
+        parallel_for(nthreads, chunks.count, poly_task, &job);
+
+        vigenere_ctx_skip(&ctx->schedule, total);
+
+        free(letters);
+}
+
+// WARNING: mutates 'text'!
+static void run_vigenere_parallel(size_t key_len,
+                                  const char key[key_len],
+                                  bool decipher,
+                                  size_t len,
+                                  char text[len],
+                                  size_t nthreads) {
+        vigenere_ctx ctx;
+
+        if (!vigenere_ctx_init(&ctx, key_len, key, decipher)) {
+                // Either the key is invalid, or there was no memory for the
+                // schedule; the single-threaded cipher handles both
+                if (decipher)
+                        decipher_vigenere(key_len, key, len, text);
+                else
+                        vigenere(key_len, key, len, text);
+
+                return;
+        }
+
+        vigenere_ctx_update_parallel(&ctx, len, text, nthreads);
+        vigenere_ctx_free(&ctx);
+}
+
+// WARNING: mutates 'plaintext'!
+void vigenere_parallel(
+    size_t key_len, const char key[key_len], size_t len, char plaintext[len], size_t nthreads) {
+        run_vigenere_parallel(key_len, key, false, len, plaintext, nthreads);
+}
+
+// WARNING: mutates 'ciphertext'!
+void decipher_vigenere_parallel(
+    size_t key_len, const char key[key_len], size_t len, char ciphertext[len], size_t nthreads) {
+        run_vigenere_parallel(key_len, key, true, len, ciphertext, nthreads);
+}
+
+
+// WARNING: mutates the buffers in 'iov'!
+static void cipher_buffers(
+    vigenere_ctx* ctx, size_t first, size_t end, const cipher_iov iov[end], bool restart_key) {
+        for (size_t i = first; i < end; i++) {
+                if (restart_key) vigenere_ctx_reset(ctx);
+
+                vigenere_ctx_update(ctx, iov[i].len, iov[i].base);
+        }
+}
+
+// Returns the number of groups, writing the index of each one's first buffer
+// to 'groups', followed by 'count'
+static size_t split_groups(size_t count, const cipher_iov iov[count], size_t groups[count + 1]) {
+        size_t group_count = 0;
+        size_t group_len = BATCH_GROUP_SIZE;
+
+        for (size_t i = 0; i < count; i++) {
+                if (group_len >= BATCH_GROUP_SIZE) {
+                        groups[group_count++] = i;
+                        group_len = 0;
+                }
+
+                group_len += iov[i].len;
+        }
+
+        groups[group_count] = count;
+
+        return group_count;
+}
+
+static void count_group_letters_task(size_t index, void* arg) {
+        const BatchJob* job = arg;
+        size_t letters = 0;
+
+        for (size_t i = job->groups[index]; i < job->groups[index + 1]; i++)
+                letters += count_letters(job->iov[i].len, job->iov[i].base);
+
+        job->letters[index] = letters;
+}
+
+static void batch_task(size_t index, void* arg) {
+        const BatchJob* job = arg;
+
+        // Shares the key schedule, but starts at this group's own key position
+        vigenere_ctx group_ctx = *job->ctx;
+
+        if (!job->restart_key) vigenere_ctx_skip(&group_ctx, job->letters[index]);
+
+        // mutates the buffers!
+        cipher_buffers(
+            &group_ctx, job->groups[index], job->groups[index + 1], job->iov, job->restart_key);
+}
+
+// WARNING: mutates the buffers in 'iov'!
+void vigenere_batch(vigenere_ctx* ctx,
+                    size_t count,
+                    const cipher_iov iov[count],
+                    bool restart_key,
+                    size_t nthreads) {
+        // An invalid key leaves every buffer unchanged
+        if (ctx->period == 0) return;
+
+        nthreads = resolve_threads(nthreads);
+
+        size_t* groups = nthreads > 1 && count > 1 ? malloc((count + 1) * sizeof(size_t)) : NULL;
+        const size_t group_count = groups != NULL ? split_groups(count, iov, groups) : 0;
+        size_t* letters = group_count > 1 ? malloc(group_count * sizeof(size_t)) : NULL;
+
+        if (letters == NULL) {
+                cipher_buffers(ctx, 0, count, iov, restart_key);
+
+                if (restart_key) vigenere_ctx_reset(ctx);
+
+                free(groups);
+                return;
+        }
+
+        BatchJob job = {
+                .iov = iov,
+                .groups = groups,
+                .ctx = ctx,
+                .restart_key = restart_key,
+                .letters = letters,
+        };
+
+        if (restart_key) {
+                parallel_for(nthreads, group_count, batch_task, &job);
+                vigenere_ctx_reset(ctx);
+        } else {
+                // As with chunks of a single text, each group's starting key
+                // position is the number of letters in the groups before it
+                parallel_for(nthreads, group_count, count_group_letters_task, &job);
+
+                const size_t total = letters_before_chunks(group_count, letters);
+
+                parallel_for(nthreads, group_count, batch_task, &job);
+                vigenere_ctx_skip(ctx, total);
+        }
+
+        free(letters);
+        free(groups);
+}
@@ -0,0 +1,11 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <stddef.h>
+
+
+// Turns the letters counted in each chunk into the letters in the chunks before
+// it (where that chunk's key position starts), returning the total
+size_t letters_before_chunks(size_t count, size_t letters[count]);
+
+#endif
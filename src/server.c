@@ -0,0 +1,528 @@
+// Needed for the POSIX socket and signal functions
+#define _POSIX_C_SOURCE 200809L
+
+#include "server.h"
+#include "batch.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+
+// Each read from a connection asks for at least this much
+#define SERVER_READ_SIZE 0x10000
+// Once this many bytes of results are waiting they're sent before reading
+// more requests, so a client that never reads can't grow them without bound
+#define SERVER_OUTPUT_HIGH_WATER 0x100000
+#define SERVER_MAX_EVENTS 64
+#define RESPONSE_HEADER_SIZE 4
+
+/*
+  The main thread accepts connections and hands each one to a worker, round
+  robin, through the worker's pipe. From then on the connection belongs to
+  that worker alone, which multiplexes all of its connections with epoll, so
+  none of their state is shared between threads.
+
+  A connection's buffers are kept for its whole life and only grow, so once
+  they've reached the size of its largest record, ciphering more records
+  doesn't allocate. Records are ciphered straight from the input buffer into
+  the output buffer, after their length.
+*/
+
+typedef struct Connection {
+        int fd;
+        // Received bytes that haven't been processed yet, at most a partial record
+        char* input;
+        size_t input_len;
+        size_t input_capacity;
+        // Results that haven't been sent yet start at 'output_start'
+        char* output;
+        size_t output_start;
+        size_t output_len;
+        size_t output_capacity;
+        KeyCache cache;
+        // The client shut down its side, or sent an invalid record
+        bool closing;
+        // Waiting for the client to read the results, so not reading requests
+        bool writing;
+        struct Connection* prev;
+        struct Connection* next;
+} Connection;
+
+typedef struct Worker {
+        pthread_t thread;
+        int epoll_fd;
+        // New connections arrive through this pipe, which is closed on shutdown
+        int pipe_fds[2];
+        Connection* connections;
+} Worker;
+
+
+static void set_nonblocking(int fd) {
+        const int flags = fcntl(fd, F_GETFL);
+
+        if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) != 0) {
+                fprintf(stderr, "Error: Failed to configure a socket: %s\n", strerror(errno));
+                exit(EXIT_FAILURE);
+        }
+}
+
+// 'data' is NULL for the worker's pipe
+static void watch(int epoll_fd, int operation, int fd, uint32_t events, void* data) {
+        struct epoll_event event = { .events = events, .data.ptr = data };
+
+        if (epoll_ctl(epoll_fd, operation, fd, &event) != 0) {
+                fprintf(stderr, "Error: Failed to watch a socket: %s\n", strerror(errno));
+                exit(EXIT_FAILURE);
+        }
+}
+
+static int open_unix_socket(const char* socket_path, struct sockaddr_un* address) {
+        *address = (struct sockaddr_un) { .sun_family = AF_UNIX };
+
+        if (strlen(socket_path) >= sizeof(address->sun_path)) {
+                fprintf(stderr, "Error: Socket path is too long\n");
+                exit(EXIT_FAILURE);
+        }
+
+        strcpy(address->sun_path, socket_path);
+
+        const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+        if (fd < 0) {
+                fprintf(stderr, "Error: Failed to create a socket: %s\n", strerror(errno));
+                exit(EXIT_FAILURE);
+        }
+
+        return fd;
+}
+
+
+static void add_connection(Worker* worker, int fd) {
+        Connection* connection = calloc(1, sizeof(Connection));
+
+        if (connection == NULL) {
+                fprintf(stderr, "Error: Out of memory\n");
+                exit(EXIT_FAILURE);
+        }
+
+        connection->fd = fd;
+        connection->next = worker->connections;
+
+        if (worker->connections != NULL) worker->connections->prev = connection;
+
+        worker->connections = connection;
+
+        watch(worker->epoll_fd, EPOLL_CTL_ADD, fd, EPOLLIN, connection);
+}
+
+static void close_connection(Worker* worker, Connection* connection) {
+        if (connection->prev != NULL)
+                connection->prev->next = connection->next;
+        else
+                worker->connections = connection->next;
+
+        if (connection->next != NULL) connection->next->prev = connection->prev;
+
+        // Closing the socket also removes it from the epoll set
+        close(connection->fd);
+        key_cache_free(&connection->cache);
+        free(connection->input);
+        free(connection->output);
+        free(connection);
+}
+
+// Ciphers every complete record received so far, appending the results to the output
+static void process_records(Connection* connection) {
+        size_t offset = 0;
+
+        while (connection->input_len - offset >= BATCH_BINARY_HEADER_SIZE) {
+                BatchRecord record;
+                parse_binary_header((const unsigned char*) connection->input + offset, &record);
+
+                if (record.key_len + record.len > SERVER_MAX_RECORD_SIZE) {
+                        connection->closing = true;
+                        break;
+                }
+
+                const size_t record_size = BATCH_BINARY_HEADER_SIZE + record.key_len + record.len;
+
+                if (connection->input_len - offset < record_size) break;
+
+                record.key = connection->input + offset + BATCH_BINARY_HEADER_SIZE;
+                record.text = record.key + record.key_len;
+
+                connection->output =
+                    grow_buffer(connection->output,
+                                &connection->output_capacity,
+                                connection->output_len + RESPONSE_HEADER_SIZE + record.len);
+
+                char* response = connection->output + connection->output_len;
+
+                if (!cipher_record(&connection->cache, &record, response + RESPONSE_HEADER_SIZE)) {
+                        connection->closing = true;
+                        break;
+                }
+
+                write_u32_le((uint32_t) record.len, (unsigned char*) response);
+                connection->output_len += RESPONSE_HEADER_SIZE + record.len;
+                offset += record_size;
+        }
+
+        // Keep the partial record at the start of the buffer
+        memmove(connection->input, connection->input + offset, connection->input_len - offset);
+        connection->input_len -= offset;
+}
+
+// Returns false if the connection failed
+static bool receive_requests(Connection* connection) {
+        while (!connection->closing && connection->output_len < SERVER_OUTPUT_HIGH_WATER) {
+                connection->input = grow_buffer(connection->input,
+                                                &connection->input_capacity,
+                                                connection->input_len + SERVER_READ_SIZE);
+
+                const ssize_t bytes = recv(connection->fd,
+                                           connection->input + connection->input_len,
+                                           connection->input_capacity - connection->input_len,
+                                           0);
+
+                if (bytes == 0) {
+                        connection->closing = true;
+                        break;
+                }
+
+                if (bytes < 0) {
+                        if (errno == EINTR) continue;
+
+                        return errno == EAGAIN || errno == EWOULDBLOCK;
+                }
+
+                connection->input_len += (size_t) bytes;
+                process_records(connection);
+        }
+
+        return true;
+}
+
+// Returns false if the connection failed
+static bool send_results(Connection* connection) {
+        while (connection->output_start < connection->output_len) {
+                const ssize_t bytes = send(connection->fd,
+                                           connection->output + connection->output_start,
+                                           connection->output_len - connection->output_start,
+                                           MSG_NOSIGNAL);
+
+                if (bytes < 0) {
+                        if (errno == EINTR) continue;
+
+                        return errno == EAGAIN || errno == EWOULDBLOCK;
+                }
+
+                connection->output_start += (size_t) bytes;
+        }
+
+        connection->output_start = 0;
+        connection->output_len = 0;
+
+        return true;
+}
+
+// Returns false once the connection should be closed
+static bool serve_connection(Worker* worker, Connection* connection, uint32_t events) {
+        if (events & EPOLLERR) return false;
+
+        if (!connection->writing && !receive_requests(connection)) return false;
+        if (!send_results(connection)) return false;
+
+        const bool writing = connection->output_len > 0;
+
+        if (!writing && connection->closing) return false;
+
+        // Stop reading requests until the client has caught up with the results
+        if (writing != connection->writing) {
+                watch(worker->epoll_fd,
+                      EPOLL_CTL_MOD,
+                      connection->fd,
+                      writing ? EPOLLOUT : EPOLLIN,
+                      connection);
+                connection->writing = writing;
+        }
+
+        return true;
+}
+
+// Returns false once the pipe has been closed
+static bool receive_connections(Worker* worker) {
+        int fds[SERVER_MAX_EVENTS];
+
+        for (;;) {
+                // Every write to the pipe is a single descriptor, which pipes
+                // never split, so reads always return whole ones
+                const ssize_t bytes = read(worker->pipe_fds[0], fds, sizeof(fds));
+
+                if (bytes == 0) return false;
+
+                if (bytes < 0) {
+                        if (errno == EINTR) continue;
+
+                        return true;
+                }
+
+                for (size_t i = 0; i < (size_t) bytes / sizeof(fds[0]); i++)
+                        add_connection(worker, fds[i]);
+        }
+}
+
+static void* run_worker(void* arg) {
+        Worker* worker = arg;
+        struct epoll_event events[SERVER_MAX_EVENTS];
+        bool running = true;
+
+        while (running) {
+                const int count = epoll_wait(worker->epoll_fd, events, SERVER_MAX_EVENTS, -1);
+
+                if (count < 0) {
+                        if (errno == EINTR) continue;
+
+                        fprintf(
+                            stderr, "Error: Failed to wait for requests: %s\n", strerror(errno));
+                        exit(EXIT_FAILURE);
+                }
+
+                for (int i = 0; i < count; i++) {
+                        Connection* connection = events[i].data.ptr;
+
+                        if (connection == NULL)
+                                running = receive_connections(worker);
+                        else if (!serve_connection(worker, connection, events[i].events))
+                                close_connection(worker, connection);
+                }
+        }
+
+        while (worker->connections != NULL)
+                close_connection(worker, worker->connections);
+
+        return NULL;
+}
+
+static void start_worker(Worker* worker) {
+        worker->epoll_fd = epoll_create1(0);
+
+        if (worker->epoll_fd < 0 || pipe(worker->pipe_fds) != 0) {
+                fprintf(stderr, "Error: Failed to start a worker: %s\n", strerror(errno));
+                exit(EXIT_FAILURE);
+        }
+
+        set_nonblocking(worker->pipe_fds[0]);
+        watch(worker->epoll_fd, EPOLL_CTL_ADD, worker->pipe_fds[0], EPOLLIN, NULL);
+
+        if (pthread_create(&worker->thread, NULL, run_worker, worker) != 0) {
+                fprintf(stderr, "Error: Failed to start a worker thread\n");
+                exit(EXIT_FAILURE);
+        }
+}
+
+static void stop_worker(Worker* worker) {
+        close(worker->pipe_fds[1]);
+        pthread_join(worker->thread, NULL);
+        close(worker->pipe_fds[0]);
+        close(worker->epoll_fd);
+}
+
+
+// A socket left behind by a server that didn't shut down cleanly refuses
+// connections, and can be replaced
+static bool is_stale_socket(const char* socket_path) {
+        struct stat socket_stat;
+
+        if (stat(socket_path, &socket_stat) != 0 || !S_ISSOCK(socket_stat.st_mode)) return false;
+
+        struct sockaddr_un address;
+        const int fd = open_unix_socket(socket_path, &address);
+        const bool refused =
+            connect(fd, (struct sockaddr*) &address, sizeof(address)) != 0 && errno == ECONNREFUSED;
+
+        close(fd);
+
+        return refused;
+}
+
+static int open_listening_socket(const char* socket_path) {
+        struct sockaddr_un address;
+        const int fd = open_unix_socket(socket_path, &address);
+
+        if (bind(fd, (struct sockaddr*) &address, sizeof(address)) != 0) {
+                const int bind_error = errno;
+
+                if (bind_error != EADDRINUSE || !is_stale_socket(socket_path) ||
+                    unlink(socket_path) != 0 ||
+                    bind(fd, (struct sockaddr*) &address, sizeof(address)) != 0) {
+                        fprintf(stderr, "Error: Failed to bind '%s': %s\n", socket_path,
+                                strerror(bind_error));
+                        exit(EXIT_FAILURE);
+                }
+        }
+
+        if (listen(fd, SOMAXCONN) != 0) {
+                fprintf(stderr, "Error: Failed to listen on '%s': %s\n", socket_path,
+                        strerror(errno));
+                exit(EXIT_FAILURE);
+        }
+
+        // A client that disconnects before being accepted mustn't block the loop
+        set_nonblocking(fd);
+
+        return fd;
+}
+
+void run_server(const char* socket_path, size_t nthreads) {
+        const int listen_fd = open_listening_socket(socket_path);
+
+        // The signals are blocked before the workers start, so they inherit the
+        // mask, and are only ever read from the signalfd by this thread
+        sigset_t signals;
+        sigemptyset(&signals);
+        sigaddset(&signals, SIGINT);
+        sigaddset(&signals, SIGTERM);
+        pthread_sigmask(SIG_BLOCK, &signals, NULL);
+
+        const int signal_fd = signalfd(-1, &signals, 0);
+        Worker* workers = calloc(nthreads, sizeof(Worker));
+
+        if (signal_fd < 0 || workers == NULL) {
+                fprintf(stderr, "Error: Failed to start the server\n");
+                exit(EXIT_FAILURE);
+        }
+
+        for (size_t i = 0; i < nthreads; i++)
+                start_worker(&workers[i]);
+
+        struct pollfd fds[] = {
+                { .fd = listen_fd, .events = POLLIN },
+                { .fd = signal_fd, .events = POLLIN },
+        };
+
+        for (size_t next_worker = 0; fds[1].revents == 0;) {
+                if (poll(fds, 2, -1) < 0) {
+                        if (errno == EINTR) continue;
+
+                        fprintf(stderr, "Error: Failed to wait for connections: %s\n",
+                                strerror(errno));
+                        exit(EXIT_FAILURE);
+                }
+
+                if (!(fds[0].revents & POLLIN)) continue;
+
+                const int fd = accept(listen_fd, NULL, NULL);
+
+                // The client may already have gone, or the process may be out of
+                // descriptors for now; either way, carry on serving the others
+                if (fd < 0) continue;
+
+                set_nonblocking(fd);
+
+                const Worker* worker = &workers[next_worker++ % nthreads];
+
+                if (write(worker->pipe_fds[1], &fd, sizeof(fd)) != sizeof(fd)) {
+                        fprintf(stderr, "Error: Failed to hand over a connection\n");
+                        exit(EXIT_FAILURE);
+                }
+        }
+
+        for (size_t i = 0; i < nthreads; i++)
+                stop_worker(&workers[i]);
+
+        free(workers);
+        close(signal_fd);
+        close(listen_fd);
+        unlink(socket_path);
+}
+
+
+static void send_all(int fd, size_t len, const void* data) {
+        for (size_t sent = 0; sent < len;) {
+                const ssize_t bytes = send(fd, (const char*) data + sent, len - sent, MSG_NOSIGNAL);
+
+                if (bytes < 0) {
+                        if (errno == EINTR) continue;
+
+                        fprintf(stderr, "Error: Failed to send the request: %s\n", strerror(errno));
+                        exit(EXIT_FAILURE);
+                }
+
+                sent += (size_t) bytes;
+        }
+}
+
+// Returns false if the server closed the connection first
+static bool receive_all(int fd, size_t len, void* data) {
+        for (size_t received = 0; received < len;) {
+                const ssize_t bytes = recv(fd, (char*) data + received, len - received, 0);
+
+                if (bytes == 0) return false;
+
+                if (bytes < 0) {
+                        if (errno == EINTR) continue;
+
+                        fprintf(stderr, "Error: Failed to receive the result: %s\n",
+                                strerror(errno));
+                        exit(EXIT_FAILURE);
+                }
+
+                received += (size_t) bytes;
+        }
+
+        return true;
+}
+
+void request_from_server(const char* socket_path,
+                         const BatchRecord* record,
+                         char out[record->len]) {
+        if (record->key_len + record->len > SERVER_MAX_RECORD_SIZE) {
+                fprintf(stderr, "Error: Text is too long to send to the server\n");
+                exit(EXIT_FAILURE);
+        }
+
+        struct sockaddr_un address;
+        const int fd = open_unix_socket(socket_path, &address);
+
+        if (connect(fd, (struct sockaddr*) &address, sizeof(address)) != 0) {
+                fprintf(stderr, "Error: Failed to connect to '%s': %s\n", socket_path,
+                        strerror(errno));
+                exit(EXIT_FAILURE);
+        }
+
+        unsigned char header[BATCH_BINARY_HEADER_SIZE] = {
+                (unsigned char) record->operation,
+                (unsigned char) record->cipher,
+        };
+
+        write_u32_le((uint32_t) record->key_len, header + 2);
+        write_u32_le((uint32_t) record->len, header + 6);
+
+        send_all(fd, sizeof(header), header);
+        send_all(fd, record->key_len, record->key);
+        send_all(fd, record->len, record->text);
+
+        unsigned char length[RESPONSE_HEADER_SIZE];
+
+        if (!receive_all(fd, sizeof(length), length) || read_u32_le(length) != record->len ||
+            !receive_all(fd, record->len, out)) {
+                fprintf(stderr, "Error: The server rejected the request\n");
+                exit(EXIT_FAILURE);
+        }
+
+        close(fd);
+}
@@ -0,0 +1,35 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include "batch.h"
+#include <stddef.h>
+
+
+/*
+  Server mode keeps the ciphers resident behind a Unix domain socket, so
+  callers don't pay for process startup on every message. Each connection
+  carries binary batch records (see 'batch.h'), and may send as many as it
+  likes before reading the results, which come back in the same order:
+
+      <e|d> <c|v> key_len text_len key text   ->   text_len result
+
+  An invalid or oversized record closes the connection once the results
+  before it have been sent.
+*/
+
+// Records larger than this (key and text together) are rejected
+#define SERVER_MAX_RECORD_SIZE 0x4000000
+
+// Serves connections on 'nthreads' worker threads until interrupted by
+// SIGINT or SIGTERM, then removes the socket. Exits with an error if the
+// socket can't be created
+void run_server(const char* socket_path, size_t nthreads);
+
+// Sends a single record to the server at 'socket_path' and receives the
+// result into 'out'. Exits with an error if the server can't be reached or
+// rejects the record
+void request_from_server(const char* socket_path,
+                         const BatchRecord* record,
+                         char out[record->len]);
+
+#endif
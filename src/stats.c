@@ -0,0 +1,156 @@
+// Needed for clock_gettime()
+#define _POSIX_C_SOURCE 200809L
+
+#include "stats.h"
+
+#ifdef CIPHER_STATS
+
+#include "cipher.h"
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+
+typedef struct Stats {
+        atomic_uint_fast64_t bytes;
+        atomic_uint_fast64_t letters;
+        atomic_uint_fast64_t kernel_calls;
+        // Bit 'v' is set once variant 'v' of each kernel has run
+        atomic_uint kernel_variants[STATS_KERNEL_COUNT];
+        atomic_uint_fast64_t timers_ns[STATS_TIMER_COUNT];
+} Stats;
+
+static Stats stats;
+static StatsFormat report_format = STATS_TEXT;
+
+// Enough for every kernel with every variant
+#define KERNELS_DESCRIPTION_SIZE 0x200
+
+static const char* const kernel_names[STATS_KERNEL_COUNT] = {
+        [STATS_CAESAR_KERNEL] = "caesar",
+        [STATS_VIGENERE_KERNEL] = "vigenere",
+        [STATS_SUBSTITUTE_KERNEL] = "substitute",
+        [STATS_LETTER_SLOTS_KERNEL] = "letter_slots",
+};
+
+
+uint64_t stats_now_ns(void) {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+
+        return (uint64_t) now.tv_sec * 1000000000 + (uint64_t) now.tv_nsec;
+}
+
+void stats_add_time(StatsTimer timer, uint64_t start_ns) {
+        atomic_fetch_add_explicit(
+            &stats.timers_ns[timer], stats_now_ns() - start_ns, memory_order_relaxed);
+}
+
+void stats_add_bytes(size_t bytes, size_t letters) {
+        atomic_fetch_add_explicit(&stats.bytes, bytes, memory_order_relaxed);
+        atomic_fetch_add_explicit(&stats.letters, letters, memory_order_relaxed);
+        atomic_fetch_add_explicit(&stats.kernel_calls, 1, memory_order_relaxed);
+}
+
+void stats_add_kernel(StatsKernel kernel, cipher_kernel variant) {
+        atomic_fetch_or_explicit(
+            &stats.kernel_variants[kernel], 1u << variant, memory_order_relaxed);
+}
+
+static inline double milliseconds(StatsTimer timer) {
+        return (double) atomic_load(&stats.timers_ns[timer]) / 1e6;
+}
+
+// Lists each kernel that ran with its variants, e.g. 'caesar avx512, vigenere
+// avx2' in text, or '"caesar": "avx512", "vigenere": "avx2"' in JSON. Fits in
+// KERNELS_DESCRIPTION_SIZE
+static void describe_kernels(bool json, char description[KERNELS_DESCRIPTION_SIZE]) {
+        size_t used = 0;
+
+        description[0] = '\0';
+
+        for (StatsKernel kernel = 0; kernel < STATS_KERNEL_COUNT; kernel++) {
+                const unsigned variants = atomic_load(&stats.kernel_variants[kernel]);
+                const char* separator = "";
+
+                if (variants == 0) continue;
+
+                used += (size_t) snprintf(description + used,
+                                          KERNELS_DESCRIPTION_SIZE - used,
+                                          json ? "%s\"%s\": \"" : "%s%s ",
+                                          used > 0 ? ", " : "",
+                                          kernel_names[kernel]);
+
+                // Several only if the kernel was switched while running
+                for (int variant = CIPHER_KERNEL_COUNT - 1; variant >= 0; variant--) {
+                        if ((variants >> variant & 1) == 0) continue;
+
+                        used += (size_t) snprintf(description + used,
+                                                  KERNELS_DESCRIPTION_SIZE - used,
+                                                  "%s%s",
+                                                  separator,
+                                                  cipher_kernel_name((cipher_kernel) variant));
+                        separator = "/";
+                }
+
+                if (json)
+                        used += (size_t) snprintf(
+                            description + used, KERNELS_DESCRIPTION_SIZE - used, "\"");
+        }
+}
+
+static void report_stats(void) {
+        const uint64_t bytes = atomic_load(&stats.bytes);
+        const uint64_t letters = atomic_load(&stats.letters);
+        const uint64_t kernel_ns = atomic_load(&stats.timers_ns[STATS_KERNEL]);
+        const double alpha_ratio = bytes > 0 ? (double) letters / (double) bytes : 0;
+        // Bytes per nanosecond is GB/s
+        const double kernel_gb_per_s = kernel_ns > 0 ? (double) bytes / (double) kernel_ns : 0;
+        char kernels[KERNELS_DESCRIPTION_SIZE];
+
+        describe_kernels(report_format == STATS_JSON, kernels);
+
+        if (report_format == STATS_JSON) {
+                fprintf(stderr,
+                        "{\"kernels\": {%s}, \"bytes\": %llu, \"letters\": %llu, "
+                        "\"bytes_skipped\": %llu, \"alpha_ratio\": %.4f, \"kernel_calls\": %llu, "
+                        "\"schedule_ms\": %.3f, \"kernel_ms\": %.3f, \"kernel_gb_per_s\": %.3f, "
+                        "\"io_wait_ms\": %.3f}\n",
+                        kernels,
+                        (unsigned long long) bytes,
+                        (unsigned long long) letters,
+                        (unsigned long long) (bytes - letters),
+                        alpha_ratio,
+                        (unsigned long long) atomic_load(&stats.kernel_calls),
+                        milliseconds(STATS_SCHEDULE),
+                        milliseconds(STATS_KERNEL),
+                        kernel_gb_per_s,
+                        milliseconds(STATS_IO));
+                return;
+        }
+
+        fprintf(stderr,
+                "Kernels:          %s\n"
+                "Bytes processed:  %llu in %llu calls\n"
+                "Alphabetic:       %.1f%% (%llu bytes skipped)\n"
+                "Key schedules:    %.3f ms\n"
+                "Kernel time:      %.3f ms (%.3f GB/s)\n"
+                "I/O wait:         %.3f ms\n",
+                kernels[0] != '\0' ? kernels : "none",
+                (unsigned long long) bytes,
+                (unsigned long long) atomic_load(&stats.kernel_calls),
+                100 * alpha_ratio,
+                (unsigned long long) (bytes - letters),
+                milliseconds(STATS_SCHEDULE),
+                milliseconds(STATS_KERNEL),
+                kernel_gb_per_s,
+                milliseconds(STATS_IO));
+}
+
+void stats_report_at_exit(StatsFormat format) {
+        report_format = format;
+        atexit(report_stats);
+}
+
+#endif
@@ -0,0 +1,77 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+
+/*
+  Optional instrumentation of the ciphers and I/O, reported by --stats. It is
+  only compiled in when CIPHER_STATS is defined (make STATS=1); otherwise the
+  macros below expand to nothing, so the default build pays nothing for it.
+
+  Counters are updated once per call into a kernel, never per byte. Times are
+  summed over every thread, so with several threads they can add up to more
+  than the time the program ran for.
+*/
+
+typedef enum StatsFormat {
+        STATS_TEXT,
+        STATS_JSON,
+} StatsFormat;
+
+#ifdef CIPHER_STATS
+
+#include "cipher.h"
+
+#define STATS_COMPILED 1
+
+// Kernels whose variant is reported, as a CPU tier can fall back to a lower
+// tier's kernel for some of them
+typedef enum StatsKernel {
+        STATS_CAESAR_KERNEL,
+        STATS_VIGENERE_KERNEL,
+        STATS_SUBSTITUTE_KERNEL,
+        STATS_LETTER_SLOTS_KERNEL,
+        STATS_KERNEL_COUNT,
+} StatsKernel;
+
+typedef enum StatsTimer {
+        STATS_SCHEDULE, // Building Vigenère key schedules
+        STATS_KERNEL,   // Running the cipher kernels
+        STATS_IO,       // Waiting on reads and writes
+        STATS_TIMER_COUNT,
+} StatsTimer;
+
+uint64_t stats_now_ns(void);
+void stats_add_time(StatsTimer timer, uint64_t start_ns);
+void stats_add_bytes(size_t bytes, size_t letters);
+void stats_add_kernel(StatsKernel kernel, cipher_kernel variant);
+// Prints the statistics to stderr when the program exits
+void stats_report_at_exit(StatsFormat format);
+
+#define STATS_START(name) const uint64_t name = stats_now_ns()
+#define STATS_STOP(timer, name) stats_add_time(timer, name)
+// Letters are counted after the kernel has been timed, and pass through any
+// cipher unchanged as letters, so 'text' can be the input or the output
+#define STATS_BYTES(len, text) stats_add_bytes(len, count_letters(len, text))
+// Records which variant of a kernel was actually called
+#define STATS_KERNEL_RAN(kernel, variant) stats_add_kernel(kernel, variant)
+
+#else
+
+#define STATS_COMPILED 0
+
+#define STATS_START(name)
+#define STATS_STOP(timer, name)
+#define STATS_BYTES(len, text)
+#define STATS_KERNEL_RAN(kernel, variant)
+
+static inline void stats_report_at_exit(StatsFormat format) {
+        (void) format;
+}
+
+#endif
+
+#endif
@@ -0,0 +1,122 @@
+// Needed for sysconf(_SC_NPROCESSORS_ONLN)
+#define _POSIX_C_SOURCE 200809L
+
+#include "thread_pool.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <unistd.h>
+
+
+#define MAX_POOL_THREADS 0x400
+
+typedef struct Job {
+        parallel_task_fn task;
+        void* arg;
+        size_t count;
+        atomic_size_t next;
+        size_t workers;  // Pool threads taking part, not counting the caller
+        size_t claimed;  // Pool threads that have joined so far
+        size_t finished; // Pool threads that have run out of indices
+} Job;
+
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t job_posted = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t job_finished = PTHREAD_COND_INITIALIZER;
+static atomic_flag pool_busy = ATOMIC_FLAG_INIT;
+
+// Everything below is guarded by 'pool_lock'
+static size_t pool_threads = 0;
+static unsigned long generation = 0;
+static Job job;
+
+
+static void run_job(Job* current) {
+        size_t index = 0;
+
+        while ((index = atomic_fetch_add(&current->next, 1)) < current->count)
+                current->task(index, current->arg);
+}
+
+// 'arg' is the generation before the job the worker was created for, which
+// may already have been posted by the time the worker gets the lock
+static void* pool_worker(void* arg) {
+        unsigned long seen = (unsigned long) (uintptr_t) arg;
+
+        pthread_mutex_lock(&pool_lock);
+
+        for (;;) {
+                while (generation == seen)
+                        pthread_cond_wait(&job_posted, &pool_lock);
+
+                seen = generation;
+
+                // Jobs can ask for fewer threads than the pool has
+                if (job.claimed == job.workers) continue;
+
+                job.claimed++;
+
+                pthread_mutex_unlock(&pool_lock);
+                run_job(&job);
+                pthread_mutex_lock(&pool_lock);
+
+                if (++job.finished == job.workers) pthread_cond_signal(&job_finished);
+        }
+
+        return NULL;
+}
+
+void parallel_for(size_t nthreads, size_t count, parallel_task_fn task, void* arg) {
+        if (nthreads > count) nthreads = count;
+        if (nthreads > MAX_POOL_THREADS + 1) nthreads = MAX_POOL_THREADS + 1;
+
+        if (nthreads <= 1 || atomic_flag_test_and_set(&pool_busy)) {
+                for (size_t i = 0; i < count; i++)
+                        task(i, arg);
+
+                return;
+        }
+
+        pthread_mutex_lock(&pool_lock);
+
+        // Workers that fail to start just mean less parallelism
+        while (pool_threads < nthreads - 1) {
+                pthread_t thread;
+
+                if (pthread_create(&thread, NULL, pool_worker, (void*) (uintptr_t) generation) != 0)
+                        break;
+
+                pthread_detach(thread);
+                pool_threads++;
+        }
+
+        job.task = task;
+        job.arg = arg;
+        job.count = count;
+        atomic_store(&job.next, 0);
+        job.workers = nthreads - 1 < pool_threads ? nthreads - 1 : pool_threads;
+        job.claimed = 0;
+        job.finished = 0;
+
+        generation++;
+        pthread_cond_broadcast(&job_posted);
+        pthread_mutex_unlock(&pool_lock);
+
+        run_job(&job);
+
+        pthread_mutex_lock(&pool_lock);
+
+        while (job.finished < job.workers)
+                pthread_cond_wait(&job_finished, &pool_lock);
+
+        pthread_mutex_unlock(&pool_lock);
+
+        atomic_flag_clear(&pool_busy);
+}
+
+size_t available_cpus(void) {
+        const long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+        return cpus > 0 ? (size_t) cpus : 1;
+}
@@ -0,0 +1,21 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <stddef.h>
+
+
+// Called once for each index of a parallel loop
+typedef void (*parallel_task_fn)(size_t index, void* arg);
+
+// Runs 'task' for every index in [0, count) on up to 'nthreads' threads,
+// including the caller, and returns once they have all finished. Indices are
+// handed out one at a time, so uneven tasks still balance.
+// The worker threads are created on first use and kept for later calls. If the
+// pool is already busy (e.g. when called from inside a task) the loop runs on
+// the calling thread alone
+void parallel_for(size_t nthreads, size_t count, parallel_task_fn task, void* arg);
+
+// Number of online CPUs, at least 1
+size_t available_cpus(void);
+
+#endif
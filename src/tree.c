@@ -0,0 +1,353 @@
+// Needed for pread(), pwrite() and posix_fadvise()
+#define _POSIX_C_SOURCE 200809L
+
+#include "tree.h"
+#include "stats.h"
+#include "thread_pool.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+// Each file is streamed through a buffer of this size
+#define TREE_BUFFER_SIZE 0x100000
+// Files in flight per thread, so while some wait on the disk others keep the
+// cores busy
+#define FILES_PER_THREAD 4
+
+typedef struct TreeFile {
+        char* input_path;
+        char* output_path; // NULL when ciphering in place
+        size_t size;
+        mode_t mode;
+} TreeFile;
+
+typedef struct FileList {
+        TreeFile* files;
+        size_t count;
+        size_t capacity;
+} FileList;
+
+// Buffers are allocated as files need them and returned for the next file, so
+// there are never more than there are files in flight
+typedef struct BufferPool {
+        pthread_mutex_t lock;
+        char** free;
+        size_t free_count;
+} BufferPool;
+
+typedef struct TreeJob {
+        const TreeCipher* cipher;
+        const TreeFile* files;
+        BufferPool* buffers;
+} TreeJob;
+
+
+static void* checked_malloc(size_t size) {
+        void* memory = malloc(size);
+
+        if (memory == NULL) {
+                fprintf(stderr, "Error: Out of memory\n");
+                exit(EXIT_FAILURE);
+        }
+
+        return memory;
+}
+
+static char* join_path(const char* dir, const char* name) {
+        const size_t size = strlen(dir) + strlen(name) + 2;
+        char* path = checked_malloc(size);
+
+        snprintf(path, size, "%s/%s", dir, name);
+
+        return path;
+}
+
+static void make_directory(const char* path, mode_t mode) {
+        struct stat dir_stat;
+
+        // The owner always needs to be able to fill it
+        if (mkdir(path, (mode & 0777) | 0700) != 0 &&
+            (errno != EEXIST || stat(path, &dir_stat) != 0 || !S_ISDIR(dir_stat.st_mode))) {
+                fprintf(stderr, "Error: Failed to create '%s': %s\n", path, strerror(errno));
+                exit(EXIT_FAILURE);
+        }
+}
+
+static void add_file(FileList* list, TreeFile file) {
+        if (list->count == list->capacity) {
+                list->capacity = list->capacity > 0 ? 2 * list->capacity : 0x100;
+
+                TreeFile* grown = realloc(list->files, list->capacity * sizeof(TreeFile));
+
+                if (grown == NULL) {
+                        fprintf(stderr, "Error: Out of memory\n");
+                        exit(EXIT_FAILURE);
+                }
+
+                list->files = grown;
+        }
+
+        list->files[list->count++] = file;
+}
+
+// Collects the regular files under 'input_dir', creating the matching
+// directories under 'output_dir' (if any) on the way. 'skip' is the output
+// directory, which mustn't be walked if it's inside the input tree
+static void walk_tree(const char* input_dir,
+                      const char* output_dir,
+                      const struct stat* skip,
+                      FileList* list) {
+        DIR* dir = opendir(input_dir);
+
+        if (dir == NULL) {
+                fprintf(stderr, "Error: Failed to open '%s': %s\n", input_dir, strerror(errno));
+                exit(EXIT_FAILURE);
+        }
+
+        const struct dirent* entry = NULL;
+
+        while ((entry = readdir(dir)) != NULL) {
+                if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+
+                char* input_path = join_path(input_dir, entry->d_name);
+                char* output_path =
+                    output_dir != NULL ? join_path(output_dir, entry->d_name) : NULL;
+                struct stat entry_stat;
+
+                if (lstat(input_path, &entry_stat) != 0) {
+                        fprintf(stderr, "Error: Failed to read '%s': %s\n", input_path,
+                                strerror(errno));
+                        exit(EXIT_FAILURE);
+                }
+
+                if (S_ISREG(entry_stat.st_mode)) {
+                        add_file(list,
+                                 (TreeFile) {
+                                         .input_path = input_path,
+                                         .output_path = output_path,
+                                         .size = (size_t) entry_stat.st_size,
+                                         .mode = entry_stat.st_mode,
+                                 });
+                        continue;
+                }
+
+                const bool skipped = skip != NULL && entry_stat.st_dev == skip->st_dev &&
+                                     entry_stat.st_ino == skip->st_ino;
+
+                if (S_ISDIR(entry_stat.st_mode) && !skipped) {
+                        if (output_path != NULL) make_directory(output_path, entry_stat.st_mode);
+
+                        walk_tree(input_path, output_path, skip, list);
+                }
+
+                // Symbolic links, devices, sockets and so on are left alone
+                free(input_path);
+                free(output_path);
+        }
+
+        closedir(dir);
+}
+
+// Largest first, so a big file found last doesn't run on alone at the end
+static int compare_sizes(const void* a, const void* b) {
+        const TreeFile* x = a;
+        const TreeFile* y = b;
+
+        return (x->size < y->size) - (x->size > y->size);
+}
+
+
+static char* acquire_buffer(BufferPool* pool) {
+        pthread_mutex_lock(&pool->lock);
+        char* buffer = pool->free_count > 0 ? pool->free[--pool->free_count] : NULL;
+        pthread_mutex_unlock(&pool->lock);
+
+        return buffer != NULL ? buffer : checked_malloc(TREE_BUFFER_SIZE);
+}
+
+static void release_buffer(BufferPool* pool, char* buffer) {
+        pthread_mutex_lock(&pool->lock);
+        pool->free[pool->free_count++] = buffer;
+        pthread_mutex_unlock(&pool->lock);
+}
+
+static int open_tree_file(const char* path, int flags, mode_t mode) {
+        const int fd = open(path, flags, mode & 0777);
+
+        if (fd < 0) {
+                fprintf(stderr, "Error: Failed to open '%s': %s\n", path, strerror(errno));
+                exit(EXIT_FAILURE);
+        }
+
+        return fd;
+}
+
+// Fills as much of 'buffer' as possible from 'offset', returning 0 only at the end of the file
+static size_t read_block(int fd, const char* path, off_t offset, size_t size, char buffer[size]) {
+        size_t filled = 0;
+
+        while (filled < size) {
+                STATS_START(start);
+                const ssize_t bytes =
+                    pread(fd, buffer + filled, size - filled, offset + (off_t) filled);
+                STATS_STOP(STATS_IO, start);
+
+                if (bytes == 0) break;
+
+                if (bytes < 0) {
+                        if (errno == EINTR) continue;
+
+                        fprintf(stderr, "Error: Failed to read '%s': %s\n", path, strerror(errno));
+                        exit(EXIT_FAILURE);
+                }
+
+                filled += (size_t) bytes;
+        }
+
+        return filled;
+}
+
+static void write_block(
+    int fd, const char* path, off_t offset, size_t len, const char buffer[len]) {
+        size_t written = 0;
+
+        while (written < len) {
+                STATS_START(start);
+                const ssize_t bytes =
+                    pwrite(fd, buffer + written, len - written, offset + (off_t) written);
+                STATS_STOP(STATS_IO, start);
+
+                if (bytes < 0) {
+                        if (errno == EINTR) continue;
+
+                        fprintf(stderr, "Error: Failed to write '%s': %s\n", path, strerror(errno));
+                        exit(EXIT_FAILURE);
+                }
+
+                written += (size_t) bytes;
+        }
+}
+
+static void cipher_file(const TreeCipher* cipher,
+                        const TreeFile* file,
+                        char buffer[TREE_BUFFER_SIZE]) {
+        const bool in_place = file->output_path == NULL;
+        const int input_fd = open_tree_file(file->input_path, in_place ? O_RDWR : O_RDONLY, 0);
+        const int output_fd =
+            in_place ? input_fd
+                     : open_tree_file(file->output_path, O_WRONLY | O_CREAT | O_TRUNC, file->mode);
+        const char* output_path = in_place ? file->input_path : file->output_path;
+
+#ifdef POSIX_FADV_SEQUENTIAL
+        posix_fadvise(input_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+        // Shares the key schedule, but starts from the beginning of the key
+        vigenere_ctx ctx = { 0 };
+
+        if (cipher->vigenere != NULL) {
+                ctx = *cipher->vigenere;
+                vigenere_ctx_reset(&ctx);
+        }
+
+        off_t offset = 0;
+        size_t len = 0;
+
+        while ((len = read_block(input_fd, file->input_path, offset, TREE_BUFFER_SIZE, buffer)) >
+               0) {
+                // 'buffer' is mutated here
+                if (cipher->vigenere != NULL)
+                        vigenere_ctx_update(&ctx, len, buffer);
+                else if (cipher->decipher)
+                        decipher_caesar(cipher->caesar_key, len, buffer);
+                else
+                        caesar(cipher->caesar_key, len, buffer);
+
+                write_block(output_fd, output_path, offset, len, buffer);
+                offset += (off_t) len;
+        }
+
+        if (close(output_fd) != 0) {
+                fprintf(stderr, "Error: Failed to write '%s': %s\n", output_path, strerror(errno));
+                exit(EXIT_FAILURE);
+        }
+
+        if (!in_place) close(input_fd);
+}
+
+static void cipher_file_task(size_t index, void* arg) {
+        const TreeJob* job = arg;
+        char* buffer = acquire_buffer(job->buffers);
+
+        cipher_file(job->cipher, &job->files[index], buffer);
+        release_buffer(job->buffers, buffer);
+}
+
+
+void cipher_tree(const TreeCipher* cipher,
+                 const char* input_dir,
+                 const char* output_dir,
+                 size_t nthreads) {
+        struct stat input_stat;
+
+        if (stat(input_dir, &input_stat) != 0 || !S_ISDIR(input_stat.st_mode)) {
+                fprintf(stderr, "Error: '%s' is not a directory\n", input_dir);
+                exit(EXIT_FAILURE);
+        }
+
+        struct stat output_stat;
+
+        if (output_dir != NULL) {
+                make_directory(output_dir, input_stat.st_mode);
+
+                if (stat(output_dir, &output_stat) != 0) {
+                        fprintf(stderr, "Error: Failed to read '%s': %s\n", output_dir,
+                                strerror(errno));
+                        exit(EXIT_FAILURE);
+                }
+
+                if (output_stat.st_dev == input_stat.st_dev &&
+                    output_stat.st_ino == input_stat.st_ino) {
+                        fprintf(stderr, "Error: Input and output must be different directories\n");
+                        exit(EXIT_FAILURE);
+                }
+        }
+
+        FileList list = { 0 };
+
+        walk_tree(input_dir, output_dir, output_dir != NULL ? &output_stat : NULL, &list);
+        qsort(list.files, list.count, sizeof(TreeFile), compare_sizes);
+
+        if (nthreads == 0) nthreads = available_cpus();
+
+        const size_t workers = nthreads * FILES_PER_THREAD;
+        BufferPool buffers = {
+                .lock = PTHREAD_MUTEX_INITIALIZER,
+                .free = checked_malloc(workers * sizeof(char*)),
+        };
+        TreeJob job = {
+                .cipher = cipher,
+                .files = list.files,
+                .buffers = &buffers,
+        };
+
+        parallel_for(workers, list.count, cipher_file_task, &job);
+
+        for (size_t i = 0; i < buffers.free_count; i++)
+                free(buffers.free[i]);
+
+        for (size_t i = 0; i < list.count; i++) {
+                free(list.files[i].input_path);
+                free(list.files[i].output_path);
+        }
+
+        free(buffers.free);
+        free(list.files);
+}
@@ -0,0 +1,29 @@
+#ifndef TREE_H
+#define TREE_H
+
+#include "cipher.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+
+// Cipher applied to every file of a directory tree
+typedef struct TreeCipher {
+        // Compiled once and shared by every file; NULL for the Caesar cipher
+        const vigenere_ctx* vigenere;
+        char caesar_key;
+        // Caesar only, as a Vigenère context has its direction built in
+        bool decipher;
+} TreeCipher;
+
+// Ciphers every regular file under 'input_dir'. With an 'output_dir' the tree
+// is mirrored there, creating directories as needed; without one, each file is
+// overwritten in place. Symbolic links aren't followed.
+// Files are processed on 'nthreads' threads, several at a time per thread so
+// that waiting on the disk doesn't leave the cores idle. Exits with an error
+// if any file can't be read or written
+void cipher_tree(const TreeCipher* cipher,
+                 const char* input_dir,
+                 const char* output_dir,
+                 size_t nthreads);
+
+#endif
@@ -1,5 +1,7 @@
 #include "cipher.h"
+#include "cryptanalysis.h"
 #include <assert.h>
+#include <stdlib.h>
 #include <string.h>
 
 
@@ -66,6 +68,57 @@ void test_decipher_caesar_with_invalid_key(void) {
                "Deciphering Caesar cipher with invalid key failed");
 }
 
+void test_caesar_kernels_agree(void) {
+        // Long enough to cover full SIMD blocks and a scalar/masked tail
+        char plaintext[200];
+
+        for (size_t i = 0; i < sizeof(plaintext); i++)
+                plaintext[i] = (char) (i * 37 + 11);
+
+        const cipher_kernel original = cipher_active_kernel();
+
+        char expected[sizeof(plaintext)];
+        memcpy(expected, plaintext, sizeof(plaintext));
+        cipher_select_kernel(CIPHER_KERNEL_SCALAR);
+        caesar('Q', sizeof(expected), expected);
+
+        for (int kernel = 0; kernel < CIPHER_KERNEL_COUNT; kernel++) {
+                if (!cipher_select_kernel((cipher_kernel) kernel)) continue;
+
+                char text[sizeof(plaintext)];
+                memcpy(text, plaintext, sizeof(plaintext));
+
+                caesar('Q', sizeof(text), text);
+                assert(memcmp(text, expected, sizeof(text)) == 0 &&
+                       "Caesar cipher kernels produced different output");
+
+                decipher_caesar('Q', sizeof(text), text);
+                assert(memcmp(text, plaintext, sizeof(text)) == 0 &&
+                       "Deciphering Caesar cipher kernel failed");
+        }
+
+        cipher_select_kernel(original);
+}
+
+
+void test_caesar_to_leaves_input(void) {
+        const char plaintext[] = "Gondor calls for aid!";
+        char ciphertext[sizeof(plaintext)] = { 0 };
+
+        caesar_to('J', strlen(plaintext), plaintext, ciphertext);
+
+        assert(strcmp(ciphertext, "Pxwmxa ljuub oxa jrm!") == 0 &&
+               "Out-of-place Caesar cipher failed");
+        assert(strcmp(plaintext, "Gondor calls for aid!") == 0 &&
+               "Out-of-place Caesar cipher changed its input");
+
+        // Invalid keys still copy the text across
+        char copy[sizeof(plaintext)] = { 0 };
+
+        decipher_caesar_to('!', strlen(plaintext), plaintext, copy);
+        assert(strcmp(copy, plaintext) == 0 &&
+               "Out-of-place Caesar cipher with invalid key failed");
+}
 
 void test_vigenere_cipher_non_alphabetic(void) {
         char plaintext[] = "As we wind on down the road, our shadows taller than our souls...";
@@ -127,3 +180,570 @@ void test_decipher_vigenere_with_non_alphabetic_in_key(void) {
         assert(strcmp(ciphertext, "In the land of the blind, the one-eyed man is king.") == 0 &&
                "Deciphering Vigenère cipher with non-alphabetic char in key failed");
 }
+
+void test_vigenere_to_leaves_input(void) {
+        const char plaintext[] = "Gondor calls for aid!";
+        const char* key = "ARAGON";
+        char ciphertext[sizeof(plaintext)] = { 0 };
+        char deciphered[sizeof(plaintext)] = { 0 };
+
+        vigenere_to(strlen(key), key, strlen(plaintext), plaintext, ciphertext);
+
+        assert(strcmp(ciphertext, "Gfnjce crlrg soi aor!") == 0 &&
+               "Out-of-place Vigenère cipher failed");
+        assert(strcmp(plaintext, "Gondor calls for aid!") == 0 &&
+               "Out-of-place Vigenère cipher changed its input");
+
+        decipher_vigenere_to(strlen(key), key, strlen(ciphertext), ciphertext, deciphered);
+        assert(strcmp(deciphered, plaintext) == 0 &&
+               "Deciphering out-of-place Vigenère cipher failed");
+}
+
+void test_ciphers_leave_utf8_unchanged(void) {
+        // "Gondor – calls for aid!" with an en dash, and a key starting with 'é'
+        const char plaintext[] = "Gondor \xE2\x80\x93 calls for aid!";
+        const char* key = "\xC3\xA9" "ARAGON";
+        char ciphertext[sizeof(plaintext)] = { 0 };
+
+        vigenere_to(strlen(key), key, strlen(plaintext), plaintext, ciphertext);
+        assert(strcmp(ciphertext, "Gfnjce \xE2\x80\x93 crlrg soi aor!") == 0 &&
+               "Vigenère cipher changed UTF-8 bytes in the text or key");
+
+        caesar_to('J', strlen(plaintext), plaintext, ciphertext);
+        assert(strcmp(ciphertext, "Pxwmxa \xE2\x80\x93 ljuub oxa jrm!") == 0 &&
+               "Caesar cipher changed UTF-8 bytes in the text");
+
+        caesar_to('\xC3', strlen(plaintext), plaintext, ciphertext);
+        assert(strcmp(ciphertext, plaintext) == 0 &&
+               "Caesar cipher with a non-ASCII key changed the text");
+}
+
+void test_vigenere_ctx_chunked(void) {
+        char plaintext[] = "As we wind on down the road, our shadows taller than our souls...";
+        const char* key = "Led Zeppelin";
+        vigenere_ctx ctx;
+
+        const bool initialised = vigenere_ctx_init(&ctx, strlen(key), key, false);
+
+        assert(initialised && "Vigenère context with valid key failed to initialise");
+
+        // Split mid-word and on non-alphabetic characters
+        const size_t splits[] = { 0, 3, 4, 17, 30, 31, strlen(plaintext) };
+
+        for (size_t i = 0; i + 1 < sizeof(splits) / sizeof(splits[0]); i++)
+                vigenere_ctx_update(&ctx, splits[i + 1] - splits[i], plaintext + splits[i]);
+
+        vigenere_ctx_free(&ctx);
+
+        assert(strcmp(plaintext,
+                      "Lw zd axch zv qzaq slt gsll, bfv vgesdad bnwphq xwpr zce dsxkw...") == 0 &&
+               "Vigenère cipher with context in chunks failed");
+}
+
+void test_decipher_vigenere_ctx_reset(void) {
+        char first[] = "GFNJCE CRLRG";
+        char second[] = "GFNJCE";
+        const char* key = "ARAGON";
+        vigenere_ctx ctx;
+
+        const bool initialised = vigenere_ctx_init(&ctx, strlen(key), key, true);
+
+        assert(initialised && "Vigenère context with valid key failed to initialise");
+
+        vigenere_ctx_update(&ctx, strlen(first), first);
+        vigenere_ctx_reset(&ctx);
+        vigenere_ctx_update(&ctx, strlen(second), second);
+
+        vigenere_ctx_free(&ctx);
+
+        assert(strcmp(first, "GONDOR CALLS") == 0 && strcmp(second, "GONDOR") == 0 &&
+               "Deciphering Vigenère cipher with context after reset failed");
+}
+
+void test_vigenere_ctx_with_invalid_key(void) {
+        char plaintext[] = "UNCHANGED";
+        const char* key = "123 !";
+        vigenere_ctx ctx;
+
+        const bool initialised = vigenere_ctx_init(&ctx, strlen(key), key, false);
+
+        assert(!initialised && "Vigenère context accepted a key without letters");
+
+        vigenere_ctx_update(&ctx, strlen(plaintext), plaintext);
+        vigenere_ctx_free(&ctx);
+
+        assert(strcmp(plaintext, "UNCHANGED") == 0 &&
+               "Vigenère context with invalid key changed the text");
+}
+
+void test_vigenere_kernels_agree(void) {
+        // Mixed letters and punctuation, so byte and key positions drift apart
+        char plaintext[300];
+
+        for (size_t i = 0; i < sizeof(plaintext); i++)
+                plaintext[i] = (char) (i % 7 == 0 ? ' ' : i * 13 + 5);
+
+        // Periods below, equal to and above a SIMD block
+        const char* keys[] = {
+                "k",
+                "Led Zeppelin",
+                "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz!",
+        };
+
+        const cipher_kernel original = cipher_active_kernel();
+
+        for (size_t k = 0; k < sizeof(keys) / sizeof(keys[0]); k++) {
+                char expected[sizeof(plaintext)];
+                memcpy(expected, plaintext, sizeof(plaintext));
+                cipher_select_kernel(CIPHER_KERNEL_SCALAR);
+                vigenere(strlen(keys[k]), keys[k], sizeof(expected), expected);
+
+                for (int kernel = 0; kernel < CIPHER_KERNEL_COUNT; kernel++) {
+                        if (!cipher_select_kernel((cipher_kernel) kernel)) continue;
+
+                        char text[sizeof(plaintext)];
+                        memcpy(text, plaintext, sizeof(plaintext));
+
+                        vigenere(strlen(keys[k]), keys[k], sizeof(text), text);
+                        assert(memcmp(text, expected, sizeof(text)) == 0 &&
+                               "Vigenère cipher kernels produced different output");
+
+                        decipher_vigenere(strlen(keys[k]), keys[k], sizeof(text), text);
+                        assert(memcmp(text, plaintext, sizeof(text)) == 0 &&
+                               "Deciphering Vigenère cipher kernel failed");
+                }
+        }
+
+        cipher_select_kernel(original);
+}
+
+void test_poly_ciphers(void) {
+        struct {
+                poly_params params;
+                const char* plaintext;
+                const char* ciphertext;
+        } const cases[] = {
+                { { .cipher = POLY_CAESAR, .key_len = 1, .key = "J" },
+                  "Gondor calls for aid!",
+                  "Pxwmxa ljuub oxa jrm!" },
+                { { .cipher = POLY_VIGENERE, .key_len = 6, .key = "ARAGON" },
+                  "Gondor calls for aid!",
+                  "Gfnjce crlrg soi aor!" },
+                { { .cipher = POLY_BEAUFORT, .key_len = 13, .key = "FORTIFICATION" },
+                  "DEFENDTHEEASTWALLOFTHECASTLE",
+                  "CKMPVCPVWPIWUJOGIUAPVWRIWUUK" },
+                { { .cipher = POLY_VARIANT_BEAUFORT, .key_len = 6, .key = "ARAGON" },
+                  "Gondor calls for aid!",
+                  "Gxnxae cjlfe soa acp!" },
+                { { .cipher = POLY_AFFINE, .multiplier = 5, .increment = 8 },
+                  "AFFINECIPHER",
+                  "IHHWVCSWFRCP" },
+                { { .cipher = POLY_AUTOKEY, .key_len = 7, .key = "QUEENLY" },
+                  "ATTACKATDAWN",
+                  "QNXEPVYTWTWP" },
+                { { .cipher = POLY_RUNNING_KEY, .key_len = 21, .key = "Errands of grief, and" },
+                  "Gondor calls for aid!",
+                  "Kfedbu uoqrj nsw avg!" },
+        };
+
+        for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+                poly_params params = cases[c].params;
+                char text[64] = { 0 };
+                poly_ctx ctx;
+
+                strcpy(text, cases[c].plaintext);
+
+                const bool initialised = poly_ctx_init(&ctx, &params);
+
+                assert(initialised && "Polyalphabetic cipher failed to initialise");
+                poly_ctx_update(&ctx, strlen(text), text);
+                poly_ctx_free(&ctx);
+                assert(strcmp(text, cases[c].ciphertext) == 0 && "Polyalphabetic cipher failed");
+
+                params.decipher = true;
+                poly_ctx_init(&ctx, &params);
+                poly_ctx_update(&ctx, strlen(text), text);
+                poly_ctx_free(&ctx);
+                assert(strcmp(text, cases[c].plaintext) == 0 &&
+                       "Deciphering polyalphabetic cipher failed");
+        }
+
+        poly_ctx ctx;
+        const poly_params invalid = { .cipher = POLY_AFFINE, .multiplier = 13 };
+        const bool initialised = poly_ctx_init(&ctx, &invalid);
+
+        assert(!initialised && "Affine cipher accepted a multiplier without an inverse");
+
+        // Long enough for the substitution kernels, with a tail
+        const size_t len = 0x1000 + 37;
+        char* expected = malloc(len);
+        char* text = malloc(len);
+
+        assert(expected != NULL && text != NULL);
+
+        // Beaufort runs the substitution kernels, Autokey the letter packing ones
+        const poly_params kernel_params[] = {
+                { .cipher = POLY_BEAUFORT, .key_len = 5, .key = "Rohan" },
+                { .cipher = POLY_AUTOKEY, .key_len = 5, .key = "Rohan" },
+        };
+        const cipher_kernel original = cipher_active_kernel();
+
+        for (size_t p = 0; p < sizeof(kernel_params) / sizeof(kernel_params[0]); p++) {
+                for (size_t i = 0; i < len; i++)
+                        expected[i] = (char) (i * 37 + i / 11);
+
+                cipher_select_kernel(CIPHER_KERNEL_SCALAR);
+                poly_ctx_init(&ctx, &kernel_params[p]);
+                poly_ctx_update(&ctx, len, expected);
+                poly_ctx_free(&ctx);
+
+                for (int kernel = 0; kernel < CIPHER_KERNEL_COUNT; kernel++) {
+                        if (!cipher_select_kernel((cipher_kernel) kernel)) continue;
+
+                        for (size_t i = 0; i < len; i++)
+                                text[i] = (char) (i * 37 + i / 11);
+
+                        poly_ctx_init(&ctx, &kernel_params[p]);
+                        poly_ctx_update(&ctx, len, text);
+                        poly_ctx_free(&ctx);
+                        assert(memcmp(text, expected, len) == 0 &&
+                               "Polyalphabetic kernels produced different output");
+                }
+        }
+
+        cipher_select_kernel(original);
+        free(expected);
+        free(text);
+}
+
+void test_count_letters(void) {
+        const char text[] = "Gondor calls for aid! 123 ...";
+
+        assert(count_letters(strlen(text), text) == 17 && "Counting letters failed");
+}
+
+void test_parallel_ciphers_match(void) {
+        // Large enough to be split into several chunks
+        const size_t len = 0x500000 + 123;
+        char* plaintext = malloc(len);
+        char* expected = malloc(len);
+        char* text = malloc(len);
+        const char* key = "Led Zeppelin";
+
+        assert(plaintext != NULL && expected != NULL && text != NULL);
+
+        for (size_t i = 0; i < len; i++)
+                plaintext[i] = (char) (i % 5 == 0 ? ' ' : i * 31 + i / 7);
+
+        memcpy(expected, plaintext, len);
+        memcpy(text, plaintext, len);
+        vigenere(strlen(key), key, len, expected);
+        vigenere_parallel(strlen(key), key, len, text, 4);
+        assert(memcmp(text, expected, len) == 0 && "Parallel Vigenère cipher failed");
+
+        decipher_vigenere_parallel(strlen(key), key, len, text, 0);
+        assert(memcmp(text, plaintext, len) == 0 && "Deciphering parallel Vigenère cipher failed");
+
+        memcpy(expected, plaintext, len);
+        caesar('K', len, expected);
+        caesar_parallel('K', len, text, 3);
+        assert(memcmp(text, expected, len) == 0 && "Parallel Caesar cipher failed");
+
+        decipher_caesar_parallel('K', len, text, 3);
+        assert(memcmp(text, plaintext, len) == 0 && "Deciphering parallel Caesar cipher failed");
+
+        free(plaintext);
+        free(expected);
+        free(text);
+}
+
+void test_vigenere_batch(void) {
+        // Enough buffers of uneven sizes to be split into several groups
+        const size_t count = 200;
+        const size_t len = 0x80000;
+        char* plaintext = malloc(len);
+        char* expected = malloc(len);
+        char* text = malloc(len);
+        cipher_iov* iov = malloc(count * sizeof(cipher_iov));
+        const char* key = "Led Zeppelin";
+        vigenere_ctx ctx;
+
+        assert(plaintext != NULL && expected != NULL && text != NULL && iov != NULL);
+
+        const bool initialised = vigenere_ctx_init(&ctx, strlen(key), key, false);
+
+        assert(initialised && "Vigenère context with valid key failed to initialise");
+
+        for (size_t i = 0; i < len; i++)
+                plaintext[i] = (char) (i % 5 == 0 ? ' ' : i * 31 + i / 7);
+
+        size_t offset = 0;
+
+        for (size_t i = 0; i < count; i++) {
+                // The last buffer takes the rest of the text
+                const size_t buffer_len = i + 1 < count ? (i * 37) % 5000 : len - offset;
+
+                iov[i] = (cipher_iov) { .base = text + offset, .len = buffer_len };
+                offset += buffer_len;
+        }
+
+        // Continuing the key across buffers matches ciphering them as one text
+        memcpy(expected, plaintext, len);
+        memcpy(text, plaintext, len);
+        vigenere(strlen(key), key, len, expected);
+        vigenere_batch(&ctx, count, iov, false, 4);
+        assert(memcmp(text, expected, len) == 0 && "Vigenère batch continuing the key failed");
+
+        // Restarting the key matches ciphering each buffer separately
+        memcpy(expected, plaintext, len);
+        memcpy(text, plaintext, len);
+
+        for (size_t i = 0; i < count; i++)
+                vigenere(strlen(key), key, iov[i].len, expected + (iov[i].base - text));
+
+        vigenere_batch(&ctx, count, iov, true, 0);
+        assert(memcmp(text, expected, len) == 0 && "Vigenère batch restarting the key failed");
+        assert(ctx.position == 0 && "Vigenère batch restarting the key didn't reset the context");
+
+        vigenere_ctx_free(&ctx);
+        free(iov);
+        free(plaintext);
+        free(expected);
+        free(text);
+}
+
+void test_letter_histogram_kernels_agree(void) {
+        // Long enough that the SIMD kernels flush their byte counters, with a tail
+        const size_t len = 0x9000 + 37;
+        char* text = malloc(len);
+
+        assert(text != NULL);
+
+        size_t expected[26] = { 0 };
+
+        for (size_t i = 0; i < len; i++) {
+                text[i] = (char) (i * 37 + i / 11);
+
+                const unsigned char c = (unsigned char) text[i];
+
+                if (c >= 'A' && c <= 'Z') expected[c - 'A']++;
+                else if (c >= 'a' && c <= 'z') expected[c - 'a']++;
+        }
+
+        const cipher_kernel original = cipher_active_kernel();
+
+        for (int kernel = 0; kernel < CIPHER_KERNEL_COUNT; kernel++) {
+                if (!cipher_select_kernel((cipher_kernel) kernel)) continue;
+
+                size_t counts[26] = { 0 };
+
+                letter_histogram(len, text, counts);
+                assert(memcmp(counts, expected, sizeof(counts)) == 0 &&
+                       "Letter histogram kernels produced different counts");
+        }
+
+        cipher_select_kernel(original);
+        free(text);
+}
+
+void test_utf8_validate(void) {
+        // Long ASCII runs so the SIMD kernels find the sequences after them
+        const size_t len = 0x1000;
+        char* text = malloc(len);
+
+        assert(text != NULL);
+
+        struct {
+                const char* sequence;
+                size_t length;
+                size_t valid;
+                bool truncated;
+        } const cases[] = {
+                { "\xC3\xA9", 2, 2, false },         // é
+                { "\xE2\x80\x93", 3, 3, false },     // En dash
+                { "\xF0\x9F\x97\xA1", 4, 4, false }, // Dagger emoji
+                { "\xC0\xAF", 2, 0, false },         // Overlong '/'
+                { "\xED\xA0\x80", 3, 0, false },     // Surrogate
+                { "\xF4\x90\x80\x80", 4, 0, false }, // Above U+10FFFF
+                { "\x80", 1, 0, false },             // Stray continuation byte
+                { "\xE2\x80", 2, 0, true },          // Cut off by the end of the text
+        };
+        const cipher_kernel original = cipher_active_kernel();
+
+        for (int kernel = 0; kernel < CIPHER_KERNEL_COUNT; kernel++) {
+                if (!cipher_select_kernel((cipher_kernel) kernel)) continue;
+
+                for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+                        // At the very end of the text, so cut off sequences are truncated
+                        const size_t start = len - cases[c].length;
+                        bool truncated = false;
+
+                        memset(text, 'a', len);
+                        memcpy(text + start, cases[c].sequence, cases[c].length);
+
+                        assert(utf8_validate(len, text, &truncated) == start + cases[c].valid &&
+                               truncated == cases[c].truncated &&
+                               "UTF-8 validation gave the wrong offset");
+                }
+        }
+
+        cipher_select_kernel(original);
+        free(text);
+}
+
+void test_crack_caesar(void) {
+        char text[] = "It is a period of civil war. Rebel spaceships, striking from a hidden base, "
+                      "have won their first victory against the evil Galactic Empire. During the "
+                      "battle, Rebel spies managed to steal secret plans to the Empire's ultimate "
+                      "weapon, the DEATH STAR, an armored space station with enough power to "
+                      "destroy an entire planet.";
+        caesar_candidate ranked[26];
+
+        caesar('J', strlen(text), text);
+
+        const size_t sampled = crack_caesar(strlen(text), text, ranked);
+
+        assert(sampled == strlen(text) && "Cracking Caesar cipher skipped some of a short text");
+        assert(ranked[0].key == 'J' && "Cracking Caesar cipher failed");
+
+        for (size_t i = 1; i < 26; i++)
+                assert(ranked[i - 1].chi_squared <= ranked[i].chi_squared &&
+                       "Cracked Caesar keys are not ranked");
+}
+
+void test_crack_vigenere(void) {
+        const char paragraph[] =
+            "It is a period of civil war. Rebel spaceships, striking from a hidden base, have won "
+            "their first victory against the evil Galactic Empire. During the battle, Rebel spies "
+            "managed to steal secret plans to the Empire's ultimate weapon, the DEATH STAR, an "
+            "armored space station with enough power to destroy an entire planet. ";
+        const char* key = "Aragorn";
+        char text[4 * sizeof(paragraph)] = { 0 };
+
+        for (size_t i = 0; i < 4; i++)
+                strcat(text, paragraph);
+
+        vigenere(strlen(key), key, strlen(text), text);
+
+        char cracked[20];
+        double coincidence[20];
+        const size_t key_len = crack_vigenere(strlen(text), text, 20, cracked, coincidence, 2);
+
+        assert(key_len == strlen(key) && memcmp(cracked, "ARAGORN", key_len) == 0 &&
+               "Cracking Vigenère cipher failed");
+        assert(coincidence[key_len - 1] > coincidence[0] &&
+               "Cracked Vigenère key length has a low index of coincidence");
+
+        size_t ranked[20];
+        const size_t ranked_count = rank_key_lengths(20, coincidence, ranked);
+
+        assert(ranked_count > 0 && ranked[0] == key_len &&
+               "Ranked key lengths don't start with the cracked key length");
+}
+
+void test_crack_substitution(void) {
+        // Not part of the sample the built-in quadgram table is built from
+        const char plaintext[] =
+            "Marley was dead: to begin with. There is no doubt whatever about that. The register "
+            "of his burial was signed by the clergyman, the clerk, the undertaker, and the chief "
+            "mourner. Scrooge signed it: and Scrooge's name was good upon 'Change, for anything "
+            "he chose to put his hand to. Old Marley was as dead as a door-nail. Mind! I don't "
+            "mean to say that I know, of my own knowledge, what there is particularly dead about "
+            "a door-nail. I might have been inclined, myself, to regard a coffin-nail as the "
+            "deadest piece of ironmongery in the trade.";
+        const char* key = "QWERTYUIOPASDFGHJKLZXCVBNM";
+        char text[sizeof(plaintext)];
+
+        for (size_t i = 0; i < sizeof(plaintext); i++) {
+                const unsigned letter = (unsigned char) ((plaintext[i] | 0x20) - 'a');
+
+                text[i] = letter < 26 ? (char) (key[letter] | (plaintext[i] & 0x20)) : plaintext[i];
+        }
+
+        substitution_candidate best;
+        substitution_candidate threaded;
+        const bool cracked =
+            crack_substitution(strlen(text), text, english_quadgrams(), 16, 1, 1, &best);
+        const bool cracked_threaded =
+            crack_substitution(strlen(text), text, english_quadgrams(), 16, 1, 4, &threaded);
+
+        assert(cracked && cracked_threaded && "Cracking substitution cipher found too few letters");
+        assert(memcmp(best.key, threaded.key, 26) == 0 && best.score == threaded.score &&
+               "Cracked substitution key depends on the number of threads");
+
+        // Letters the plaintext doesn't use can't be told apart
+        for (size_t letter = 0; letter < 26; letter++)
+                if (strchr(plaintext, 'a' + (int) letter) != NULL)
+                        assert(best.key[letter] == key[letter] &&
+                               "Cracking substitution cipher failed");
+
+        float* quadgrams = malloc(QUADGRAM_COUNT * sizeof(float));
+
+        assert(quadgrams != NULL);
+        assert(!build_quadgrams(3, "a b", quadgrams) &&
+               !crack_substitution(7, "ABC 123", quadgrams, 1, 1, 1, &best) &&
+               "Quadgrams were built from fewer than 4 letters");
+        free(quadgrams);
+}
+
+void test_crack_vigenere_crib(void) {
+        const cipher_kernel original = cipher_active_kernel();
+        const char crib[] = "Four score and seven years ago";
+        const char filler[] = "Now we are engaged in a great civil war, testing whether that ";
+        // Spans several chunks, with one of the cribs across the boundary between two
+        const size_t len = 0x280000;
+        const size_t offsets[] = { 1000, 0x100000 - 10, len - sizeof(crib) };
+        char* text = malloc(len);
+
+        assert(text != NULL);
+
+        for (size_t i = 0; i < len; i++)
+                text[i] = filler[i % (sizeof(filler) - 1)];
+
+        for (size_t i = 0; i < sizeof(offsets) / sizeof(offsets[0]); i++)
+                memcpy(text + offsets[i], crib, strlen(crib));
+
+        vigenere(5, "LEMON", len, text);
+
+        for (int kernel = 0; kernel < CIPHER_KERNEL_COUNT; kernel++) {
+                if (!cipher_select_kernel((cipher_kernel) kernel)) continue;
+
+                crib_candidate found[2];
+
+                assert(crack_vigenere_crib(len, text, strlen(crib), crib, 2, found, 2) == 1 &&
+                       memcmp(found[0].key, "LEMON", 5) == 0 && found[0].key_len == 5 &&
+                       found[0].matches == 3 && found[0].offset == offsets[0] &&
+                       "Cracking Vigenère cipher with a crib failed");
+                assert(crack_vigenere_crib(len, text, 12, "Gondor calls", 2, found, 1) == 0 &&
+                       "Crib found in a ciphertext without it");
+        }
+
+        cipher_select_kernel(original);
+        free(text);
+}
+
+void test_crack_vigenere_wordlist(void) {
+        char text[] = "The brave men, living and dead, who struggled here, have consecrated it, "
+                      "far above our poor power to add or detract. The world will little note, "
+                      "nor long remember what we say here, but it can never forget what they "
+                      "did here.";
+        const char wordlist[] = "gondor\r\nARAGON\r\n\r\nLegolas said\r\nminas tirith\r\n12345";
+
+        vigenere(12, "Legolas said", strlen(text), text);
+
+        wordlist_candidate best[3];
+        wordlist_candidate threaded[3];
+        const size_t found = crack_vigenere_wordlist(strlen(text), text, strlen(wordlist),
+                                                     wordlist, english_quadgrams(), 3, best, 1);
+
+        assert(found >= 1 && best[0].word_len == 12 &&
+               memcmp(best[0].word, "Legolas said", 12) == 0 &&
+               "Cracking Vigenère cipher with a wordlist failed");
+        assert(crack_vigenere_wordlist(strlen(text), text, strlen(wordlist), wordlist,
+                                       english_quadgrams(), 3, threaded, 4) == found &&
+               memcmp(best, threaded, found * sizeof(wordlist_candidate)) == 0 &&
+               "Wordlist attack depends on the number of threads");
+        assert(crack_vigenere_wordlist(3, "ABC", strlen(wordlist), wordlist, english_quadgrams(),
+                                       3, best, 1) == 0 &&
+               "Wordlist attack on fewer than 4 letters");
+}
@@ -9,6 +9,8 @@ void test_caesar_cipher_with_invalid_key(void);
 void test_decipher_caesar(void);
 void test_decipher_caesar_non_alphabetic(void);
 void test_decipher_caesar_with_invalid_key(void);
+void test_caesar_to_leaves_input(void);
+void test_caesar_kernels_agree(void);
 
 void test_vigenere_cipher_non_alphabetic(void);
 void test_vigenere_cipher_key_longer_than_plaintext(void);
@@ -16,6 +18,25 @@ void test_vigenere_cipher_with_non_alphabetic_in_key(void);
 void test_decipher_vigenere(void);
 void test_decipher_vigenere_non_alphabetic(void);
 void test_decipher_vigenere_with_non_alphabetic_in_key(void);
+void test_vigenere_to_leaves_input(void);
+void test_ciphers_leave_utf8_unchanged(void);
+void test_vigenere_ctx_chunked(void);
+void test_decipher_vigenere_ctx_reset(void);
+void test_vigenere_ctx_with_invalid_key(void);
+void test_vigenere_kernels_agree(void);
+void test_poly_ciphers(void);
+
+void test_count_letters(void);
+void test_parallel_ciphers_match(void);
+void test_vigenere_batch(void);
+
+void test_letter_histogram_kernels_agree(void);
+void test_utf8_validate(void);
+void test_crack_caesar(void);
+void test_crack_vigenere(void);
+void test_crack_substitution(void);
+void test_crack_vigenere_crib(void);
+void test_crack_vigenere_wordlist(void);
 
 
 #endif
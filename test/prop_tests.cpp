@@ -1,3 +1,4 @@
+#include <iostream>
 #include <rapidcheck.h>
 
 extern "C" {
@@ -5,7 +6,7 @@ extern "C" {
 }
 
 
-int main(const int argc, char const* argv[]) {
+static void check_properties() {
         rc::check(
             "Caesar: Encryption followed by decryption returns original text\n(decryption is the inverse of encryption)",
             [] {
@@ -108,4 +109,149 @@ int main(const int argc, char const* argv[]) {
                 decipher_vigenere(1, &key, vigenereText.length(), vigenereText.data());
                 RC_ASSERT(caesarText == vigenereText);
         });
+
+        rc::check("Vigenère: Processing in chunks with a context matches a single call", [] {
+                const std::string plaintext = *rc::gen::nonEmpty(rc::gen::string<std::string>());
+                const std::string key = *rc::gen::nonEmpty(rc::gen::string<std::string>());
+                const bool decipher = *rc::gen::arbitrary<bool>;
+                std::string expected = plaintext;
+                std::string text = plaintext;
+
+                if (decipher)
+                        decipher_vigenere(
+                            key.length(), key.data(), expected.length(), expected.data());
+                else
+                        vigenere(key.length(), key.data(), expected.length(), expected.data());
+
+                vigenere_ctx ctx;
+                vigenere_ctx_init(&ctx, key.length(), key.data(), decipher);
+
+                for (size_t start = 0; start < text.length();) {
+                        const size_t chunk =
+                            *rc::gen::inRange<size_t>(0, text.length() - start + 1);
+
+                        vigenere_ctx_update(&ctx, chunk, text.data() + start);
+                        start += chunk;
+                }
+
+                vigenere_ctx_free(&ctx);
+
+                RC_ASSERT(text == expected);
+        });
+
+        rc::check("Polyalphabetic engine: Deciphering undoes enciphering, in any chunks", [] {
+                static const unsigned multipliers[] = { 1, 3, 5, 7, 9, 11, 15, 17, 19, 21, 23, 25 };
+                const std::string plaintext = *rc::gen::nonEmpty(rc::gen::string<std::string>());
+                const std::string key = *rc::gen::nonEmpty(rc::gen::string<std::string>());
+                poly_params params = {
+                        .cipher = static_cast<poly_cipher>(
+                            *rc::gen::inRange<int>(POLY_CAESAR, POLY_RUNNING_KEY + 1)),
+                        .key_len = key.length(),
+                        .key = key.data(),
+                        .multiplier = multipliers[*rc::gen::inRange<size_t>(0, 12)],
+                        .increment = *rc::gen::inRange<unsigned>(0, 26),
+                        .decipher = false,
+                };
+                std::string text = plaintext;
+
+                for (const bool decipher : { false, true }) {
+                        poly_ctx ctx;
+
+                        params.decipher = decipher;
+                        poly_ctx_init(&ctx, &params);
+
+                        for (size_t start = 0; start < text.length();) {
+                                const size_t chunk =
+                                    *rc::gen::inRange<size_t>(0, text.length() - start + 1);
+
+                                poly_ctx_update(&ctx, chunk, text.data() + start);
+                                start += chunk;
+                        }
+
+                        poly_ctx_free(&ctx);
+                }
+
+                RC_ASSERT(text == plaintext);
+        });
+
+        rc::check("Out-of-place ciphers match in-place ones and leave the input unchanged", [] {
+                const std::string plaintext = *rc::gen::nonEmpty(rc::gen::string<std::string>());
+                const std::string key = *rc::gen::nonEmpty(rc::gen::string<std::string>());
+                std::string expected = plaintext;
+                std::string output(plaintext.length(), '\0');
+
+                caesar(key[0], expected.length(), expected.data());
+                caesar_to(key[0], plaintext.length(), plaintext.data(), output.data());
+                RC_ASSERT(output == expected);
+
+                decipher_caesar_to(key[0], output.length(), expected.data(), output.data());
+                RC_ASSERT(output == plaintext);
+
+                expected = plaintext;
+                vigenere(key.length(), key.data(), expected.length(), expected.data());
+                vigenere_to(
+                    key.length(), key.data(), plaintext.length(), plaintext.data(), output.data());
+                RC_ASSERT(output == expected);
+
+                decipher_vigenere_to(
+                    key.length(), key.data(), output.length(), expected.data(), output.data());
+                RC_ASSERT(output == plaintext);
+        });
+}
+
+static void check_kernels_agree() {
+        rc::check("Every kernel produces identical output to the scalar kernel", [] {
+                const std::string plaintext = *rc::gen::nonEmpty(rc::gen::string<std::string>());
+                const char key = *rc::gen::character<char>();
+                const cipher_kernel kernel = cipher_active_kernel();
+                std::string expected = plaintext;
+                std::string text = plaintext;
+
+                cipher_select_kernel(CIPHER_KERNEL_SCALAR);
+                caesar(key, expected.length(), expected.data());
+                cipher_select_kernel(kernel);
+                caesar(key, text.length(), text.data());
+                RC_ASSERT(text == expected);
+
+                cipher_select_kernel(CIPHER_KERNEL_SCALAR);
+                decipher_caesar(key, expected.length(), expected.data());
+                cipher_select_kernel(kernel);
+                decipher_caesar(key, text.length(), text.data());
+                RC_ASSERT(text == expected);
+        });
+
+        rc::check("Every kernel produces identical Vigenère output to the scalar kernel", [] {
+                const std::string plaintext = *rc::gen::nonEmpty(rc::gen::string<std::string>());
+                const std::string key = *rc::gen::nonEmpty(rc::gen::string<std::string>());
+                const cipher_kernel kernel = cipher_active_kernel();
+                std::string expected = plaintext;
+                std::string text = plaintext;
+
+                cipher_select_kernel(CIPHER_KERNEL_SCALAR);
+                vigenere(key.length(), key.data(), expected.length(), expected.data());
+                cipher_select_kernel(kernel);
+                vigenere(key.length(), key.data(), text.length(), text.data());
+                RC_ASSERT(text == expected);
+
+                cipher_select_kernel(CIPHER_KERNEL_SCALAR);
+                decipher_vigenere(key.length(), key.data(), expected.length(), expected.data());
+                cipher_select_kernel(kernel);
+                decipher_vigenere(key.length(), key.data(), text.length(), text.data());
+                RC_ASSERT(text == expected);
+        });
+}
+
+
+int main(const int argc, char const* argv[]) {
+        // Run every property against each kernel variant the CPU supports
+        for (int k = 0; k < CIPHER_KERNEL_COUNT; k++) {
+                const auto kernel = static_cast<cipher_kernel>(k);
+
+                if (!cipher_select_kernel(kernel)) continue;
+
+                std::cout << "Kernel: " << cipher_kernel_name(kernel) << std::endl;
+
+                check_properties();
+                check_kernels_agree();
+        }
 }
@@ -9,6 +9,8 @@ int main(const int argc, char const* argv[]) {
         test_decipher_caesar();
         test_decipher_caesar_non_alphabetic();
         test_decipher_caesar_with_invalid_key();
+        test_caesar_to_leaves_input();
+        test_caesar_kernels_agree();
 
         test_vigenere_cipher_non_alphabetic();
         test_vigenere_cipher_key_longer_than_plaintext();
@@ -16,4 +18,23 @@ int main(const int argc, char const* argv[]) {
         test_decipher_vigenere();
         test_decipher_vigenere_non_alphabetic();
         test_decipher_vigenere_with_non_alphabetic_in_key();
+        test_vigenere_to_leaves_input();
+        test_ciphers_leave_utf8_unchanged();
+        test_vigenere_ctx_chunked();
+        test_decipher_vigenere_ctx_reset();
+        test_vigenere_ctx_with_invalid_key();
+        test_vigenere_kernels_agree();
+        test_poly_ciphers();
+
+        test_count_letters();
+        test_parallel_ciphers_match();
+        test_vigenere_batch();
+
+        test_letter_histogram_kernels_agree();
+        test_utf8_validate();
+        test_crack_caesar();
+        test_crack_vigenere();
+        test_crack_substitution();
+        test_crack_vigenere_crib();
+        test_crack_vigenere_wordlist();
 }